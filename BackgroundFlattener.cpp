@@ -0,0 +1,174 @@
+// BackgroundFlattener.cpp - Removes plate-to-plate sky differences from a composed mosaic
+#include "BackgroundFlattener.h"
+#include "BackgroundModel.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include <QList>
+#include <QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#include <emmintrin.h>
+#define BACKGROUND_FLATTENER_SSE2 1
+#endif
+
+namespace {
+    const int BAND_ROWS = 64;
+    const float EMPTY_LEVEL = 0.5f;     // Cell median of a canvas area no tile covered
+    const float MAX_GAIN = 4.0f;        // Divide: caps the noise boost of near-black cells
+
+    // Median of the covered cells; empty cells take it, so a missing tile does not drag
+    // its neighbours' background down. Returns false when nothing is covered.
+    bool fillEmptyCells(BackgroundModel& model, float& pedestal) {
+        std::vector<float> levels;
+        for (int row = 0; row < model.rows(); row++) {
+            for (int column = 0; column < model.columns(); column++) {
+                if (model.level(column, row) >= EMPTY_LEVEL) {
+                    levels.push_back(model.level(column, row));
+                }
+            }
+        }
+        if (levels.empty()) {
+            return false;
+        }
+
+        std::nth_element(levels.begin(), levels.begin() + levels.size() / 2, levels.end());
+        pedestal = levels[levels.size() / 2];
+        for (int row = 0; row < model.rows(); row++) {
+            for (int column = 0; column < model.columns(); column++) {
+                if (model.level(column, row) < EMPTY_LEVEL) {
+                    model.setLevel(column, row, pedestal);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Missing tiles (pure black) stay black; alpha is forced opaque
+    void flattenRow(const quint32* in, quint32* out, const qint16* adjust, int width, bool divide) {
+        int x = 0;
+#ifdef BACKGROUND_FLATTENER_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i colour = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+        const __m128i half = _mm_set1_epi16(0x80);
+        for (; x + 4 <= width; x += 4) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+            __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+            const __m128i adjustLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(adjust + 4 * x));
+            const __m128i adjustHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(adjust + 4 * x + 8));
+            if (divide) {
+                // ((level << 8) | 0x80) * gain >> 16: the level times the 8.8 gain, rounded
+                lo = _mm_mulhi_epu16(_mm_or_si128(_mm_slli_epi16(lo, 8), half), adjustLo);
+                hi = _mm_mulhi_epu16(_mm_or_si128(_mm_slli_epi16(hi, 8), half), adjustHi);
+            } else {
+                lo = _mm_add_epi16(lo, adjustLo);
+                hi = _mm_add_epi16(hi, adjustHi);
+            }
+            const __m128i black = _mm_cmpeq_epi32(_mm_and_si128(pixels, colour), zero);
+            const __m128i flattened = _mm_andnot_si128(black, _mm_packus_epi16(lo, hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_or_si128(flattened, alpha));
+        }
+#endif
+        for (; x < width; x++) {
+            if ((in[x] & 0x00FFFFFF) == 0) {
+                out[x] = 0xFF000000u;
+                continue;
+            }
+            quint32 pixel = 0xFF000000u;
+            for (int c = 0; c < 3; c++) {
+                const int level = (in[x] >> (8 * c)) & 0xFF;
+                const int adjusted = divide ? int((quint32((level << 8) | 0x80) * quint16(adjust[4 * x + c])) >> 16)
+                                            : level + adjust[4 * x + c];
+                pixel |= quint32(std::clamp(adjusted, 0, 255)) << (8 * c);
+            }
+            out[x] = pixel;
+        }
+    }
+}
+
+QImage BackgroundFlattener::apply(const QImage& image, const FlattenParams& params, bool multithreaded) {
+    if (image.isNull() || params.isIdentity()) {
+        return image;
+    }
+
+    const QImage source = PixelFormat::toInternal(image, "flatten");
+    const int width = source.width();
+    const int height = source.height();
+
+    // R, G, B: the plates differ in colour as well as in level
+    std::array<BackgroundModel, 3> models;
+    std::array<float, 3> pedestals{};
+    const std::array<BackgroundChannel, 3> channels = {BackgroundChannel::Red, BackgroundChannel::Green,
+                                                       BackgroundChannel::Blue};
+    for (int c = 0; c < 3; c++) {
+        models[c] = BackgroundModel::estimate(source, params.cellSize, params.clipSigma, multithreaded, channels[c]);
+        models[c].setInterpolation(BackgroundInterpolation::Bicubic);
+        if (!fillEmptyCells(models[c], pedestals[c])) {
+            return image;
+        }
+    }
+
+    QImage result(width, height, QImage::Format_RGB32);
+    uchar* resultBits = result.bits();     // Taken once: scanLine() on workers could detach
+    const qsizetype resultStride = result.bytesPerLine();
+    const bool divide = params.mode == FlattenMode::Divide;
+
+    auto flattenBand = [&](int firstRow) {
+        std::array<std::vector<float>, 3> background;
+        for (std::vector<float>& row : background) {
+            row.resize(width);
+        }
+        std::vector<qint16> adjust(size_t(width) * 4, 0);
+        for (int y = firstRow; y < std::min(height, firstRow + BAND_ROWS); y++) {
+            for (int c = 0; c < 3; c++) {
+                models[c].backgroundRow(y, 0, width, background[c].data());
+            }
+
+            // Per pixel and channel, in the B, G, R, A byte order of the pixels: an offset
+            // (subtract) or a gain in 8.8 fixed point (divide)
+            for (int c = 0; c < 3; c++) {
+                const float* row = background[c].data();
+                qint16* out = adjust.data() + (2 - c);
+                if (divide) {
+                    const float floor = std::max(1.0f, pedestals[c] / MAX_GAIN);
+                    for (int x = 0; x < width; x++) {
+                        out[size_t(x) * 4] = qint16(256.0f * pedestals[c] / std::max(row[x], floor) + 0.5f);
+                    }
+                } else {
+                    for (int x = 0; x < width; x++) {
+                        // Rounded through a positive bias so the conversion is a plain truncation
+                        out[size_t(x) * 4] = qint16(int(pedestals[c] - row[x] + 1024.5f) - 1024);
+                    }
+                }
+            }
+            flattenRow(reinterpret_cast<const quint32*>(source.constScanLine(y)),
+                       reinterpret_cast<quint32*>(resultBits + y * resultStride), adjust.data(), width, divide);
+        }
+    };
+
+    QList<int> bands;
+    for (int y = 0; y < height; y += BAND_ROWS) {
+        bands.append(y);
+    }
+    if (multithreaded && bands.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, flattenBand);
+    } else {
+        for (int firstRow : bands) {
+            flattenBand(firstRow);
+        }
+    }
+    return result;
+}
+
+QString BackgroundFlattener::modeName(FlattenMode mode) {
+    switch (mode) {
+    case FlattenMode::None: return "Off";
+    case FlattenMode::Subtract: return "Subtract";
+    case FlattenMode::Divide: return "Divide";
+    }
+    return QString();
+}
@@ -0,0 +1,38 @@
+// BackgroundFlattener.h - Removes plate-to-plate sky differences from a composed mosaic
+#ifndef BACKGROUNDFLATTENER_H
+#define BACKGROUNDFLATTENER_H
+
+#include <QImage>
+#include <QString>
+
+enum class FlattenMode {
+    None,
+    Subtract,           // Additive sky differences (plate fog, airglow)
+    Divide              // Multiplicative ones (vignetting, plate sensitivity)
+};
+
+struct FlattenParams {
+    FlattenMode mode = FlattenMode::None;
+    int cellSize = 128;         // Larger than the stars, smaller than a 512 px survey tile
+    double clipSigma = 3.0;
+
+    bool isIdentity() const { return mode == FlattenMode::None; }
+};
+
+// DSS plates differ in sky level, so a 3x3 mosaic shows a checkerboard of tiles. Each of
+// R, G and B gets a BackgroundModel (sigma-clipped median per mesh cell, cell rows on the
+// render pool) interpolated with bicubic splines. The background is then removed in one
+// streaming pass of row bands: each row's three background rows are interpolated and
+// applied at once, so no background image is ever built.
+//
+// The result sits on a pedestal, the median cell background of each channel, so the sky
+// keeps its overall level and colour while the tile-to-tile differences go.
+class BackgroundFlattener {
+public:
+    // Format_RGB32 result with alpha forced opaque; the identity returns image unchanged
+    static QImage apply(const QImage& image, const FlattenParams& params, bool multithreaded = true);
+
+    static QString modeName(FlattenMode mode);
+};
+
+#endif // BACKGROUNDFLATTENER_H
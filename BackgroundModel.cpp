@@ -0,0 +1,258 @@
+// BackgroundModel.cpp - Sky background and noise on a coarse mesh of a mosaic
+#include "BackgroundModel.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include <QList>
+#include <QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+    const int MAX_CLIP_PASSES = 5;
+    const float MIN_NOISE = 0.5f;   // Flat cells (padding, saturation) still need a usable threshold
+
+    // Weights of the four cell centres around a point a fraction t past the second one
+    void catmullRom(float t, float* weights) {
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        weights[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+        weights[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+        weights[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+        weights[3] = 0.5f * (t3 - t2);
+    }
+
+    // Sigma-clipped median and standard deviation of one cell's levels
+    void clippedStats(const std::array<int, 256>& histogram, double clipSigma, float& median, float& sigma) {
+        int low = 0, high = 255;
+        median = 0.0f;
+        sigma = 0.0f;
+        for (int pass = 0; pass < MAX_CLIP_PASSES; pass++) {
+            qint64 count = 0;
+            double sum = 0.0, sumSquares = 0.0;
+            for (int level = low; level <= high; level++) {
+                count += histogram[level];
+                sum += double(level) * histogram[level];
+                sumSquares += double(level) * level * histogram[level];
+            }
+            if (count == 0) {
+                break;
+            }
+
+            // Median within the level: each level's samples are spread over [level - 0.5, level + 0.5)
+            const double half = count / 2.0;
+            qint64 below = 0;
+            int level = low;
+            while (level < high && below + histogram[level] < half) {
+                below += histogram[level++];
+            }
+            median = float(level - 0.5 + (half - below) / std::max(1, histogram[level]));
+
+            const double mean = sum / count;
+            sigma = float(std::sqrt(std::max(0.0, sumSquares / count - mean * mean)));
+
+            int clippedLow = std::max(low, int(std::ceil(median - clipSigma * sigma)));
+            int clippedHigh = std::min(high, int(std::floor(median + clipSigma * sigma)));
+            if (clippedLow == low && clippedHigh == high) {
+                break;
+            }
+            low = clippedLow;
+            high = std::max(clippedLow, clippedHigh);
+        }
+    }
+}
+
+BackgroundModel BackgroundModel::estimate(const QImage& image, int cellSize, double clipSigma, bool multithreaded,
+                                          BackgroundChannel channel) {
+    if (image.isNull()) {
+        return BackgroundModel();
+    }
+    const QImage source = PixelFormat::toInternal(image, "background");
+    if (channel == BackgroundChannel::Luminance) {
+        return estimateMesh(source.size(), cellSize, clipSigma, multithreaded, [&source](int y, quint8* levels) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            for (int x = 0; x < source.width(); x++) {
+                levels[x] = quint8(qGray(line[x]));
+            }
+        });
+    }
+
+    const int shift = channel == BackgroundChannel::Red ? 16 : channel == BackgroundChannel::Green ? 8 : 0;
+    return estimateMesh(source.size(), cellSize, clipSigma, multithreaded, [&source, shift](int y, quint8* levels) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        for (int x = 0; x < source.width(); x++) {
+            levels[x] = quint8(line[x] >> shift);
+        }
+    });
+}
+
+BackgroundModel BackgroundModel::estimate(const float* luminance, const QSize& size, int cellSize,
+                                          double clipSigma, bool multithreaded) {
+    if (!luminance || size.isEmpty()) {
+        return BackgroundModel();
+    }
+    // Rounded, so each level holds [level - 0.5, level + 0.5) as the median interpolation assumes
+    return estimateMesh(size, cellSize, clipSigma, multithreaded, [luminance, size](int y, quint8* levels) {
+        const float* row = luminance + size_t(y) * size.width();
+        for (int x = 0; x < size.width(); x++) {
+            levels[x] = quint8(std::clamp(int(row[x] + 0.5f), 0, 255));
+        }
+    });
+}
+
+BackgroundModel BackgroundModel::estimateMesh(const QSize& size, int cellSize, double clipSigma, bool multithreaded,
+                                              const std::function<void(int, quint8*)>& levelRow) {
+    BackgroundModel model;
+    model.m_imageSize = size;
+    model.m_cellSize = std::max(8, cellSize);
+    model.m_columns = (size.width() + model.m_cellSize - 1) / model.m_cellSize;
+    model.m_rows = (size.height() + model.m_cellSize - 1) / model.m_cellSize;
+    model.m_level.assign(size_t(model.m_columns) * model.m_rows, 0.0f);
+    model.m_noise.assign(model.m_level.size(), MIN_NOISE);
+
+    auto estimateCellRow = [&](int row) {
+        const int top = row * model.m_cellSize;
+        const int bottom = std::min(size.height(), top + model.m_cellSize);
+        std::vector<std::array<int, 256>> histograms(model.m_columns, std::array<int, 256>{});
+        std::vector<quint8> levels(size.width());
+        for (int y = top; y < bottom; y++) {
+            levelRow(y, levels.data());
+            for (int column = 0; column < model.m_columns; column++) {
+                std::array<int, 256>& histogram = histograms[column];
+                const int end = std::min(size.width(), (column + 1) * model.m_cellSize);
+                for (int x = column * model.m_cellSize; x < end; x++) {
+                    histogram[levels[x]]++;
+                }
+            }
+        }
+        for (int column = 0; column < model.m_columns; column++) {
+            float median, sigma;
+            clippedStats(histograms[column], clipSigma, median, sigma);
+            const size_t index = size_t(row) * model.m_columns + column;
+            model.m_level[index] = median;
+            model.m_noise[index] = std::max(MIN_NOISE, sigma);
+        }
+    };
+
+    QList<int> cellRows;
+    for (int row = 0; row < model.m_rows; row++) {
+        cellRows.append(row);
+    }
+    if (multithreaded && cellRows.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), cellRows, estimateCellRow);
+    } else {
+        for (int row : cellRows) {
+            estimateCellRow(row);
+        }
+    }
+
+    // Cell centres sit at (i + 0.5) * cellSize; outside the outermost centres the edge value holds
+    model.m_columnCell.resize(size.width());
+    model.m_columnWeight.resize(size.width());
+    model.m_columnSpline.resize(size_t(size.width()) * 4);
+    for (int x = 0; x < size.width(); x++) {
+        model.locate(x, model.m_columns, model.m_columnCell[x], model.m_columnWeight[x]);
+        float weights[4];
+        catmullRom(model.m_columnWeight[x], weights);
+        for (int i = 0; i < 4; i++) {
+            model.m_columnSpline[size_t(i) * size.width() + x] = weights[i];
+        }
+    }
+    return model;
+}
+
+void BackgroundModel::locate(int pixel, int cells, int& index, float& weight) const {
+    const float position = (pixel + 0.5f) / m_cellSize - 0.5f;
+    index = std::clamp(int(std::floor(position)), 0, std::max(0, cells - 2));
+    weight = cells > 1 ? std::clamp(position - index, 0.0f, 1.0f) : 0.0f;
+}
+
+void BackgroundModel::backgroundRow(int y, int x, int count, float* out) const {
+    if (m_interpolation == BackgroundInterpolation::Bicubic) {
+        interpolateRowBicubic(m_level, y, x, count, out);
+    } else {
+        interpolateRow(m_level, y, x, count, out);
+    }
+}
+
+void BackgroundModel::noiseRow(int y, int x, int count, float* out) const {
+    interpolateRow(m_noise, y, x, count, out);
+}
+
+void BackgroundModel::interpolateRow(const std::vector<float>& mesh, int y, int x, int count, float* out) const {
+    if (isNull()) {
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+
+    int row;
+    float rowWeight;
+    locate(y, m_rows, row, rowWeight);
+    const int nextRow = std::min(row + 1, m_rows - 1);
+
+    // Down the columns once per row; a column past the last cell repeats it, so the
+    // interpolation along the row needs no clamp
+    std::vector<float> columnValues(m_columns + 1);
+    for (int column = 0; column < m_columns; column++) {
+        const float above = mesh[size_t(row) * m_columns + column];
+        const float below = mesh[size_t(nextRow) * m_columns + column];
+        columnValues[column] = above + (below - above) * rowWeight;
+    }
+    columnValues[m_columns] = columnValues[m_columns - 1];
+
+    const int* cell = m_columnCell.data() + x;
+    const float* weight = m_columnWeight.data() + x;
+    for (int i = 0; i < count; i++) {
+        const float left = columnValues[cell[i]];
+        out[i] = left + (columnValues[cell[i] + 1] - left) * weight[i];
+    }
+}
+
+void BackgroundModel::interpolateRowBicubic(const std::vector<float>& mesh, int y, int x, int count, float* out) const {
+    if (isNull()) {
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+
+    int row;
+    float rowWeight;
+    locate(y, m_rows, row, rowWeight);
+    float rowSpline[4];
+    catmullRom(rowWeight, rowSpline);
+    const float* meshRows[4];
+    for (int i = 0; i < 4; i++) {
+        meshRows[i] = mesh.data() + size_t(std::clamp(row - 1 + i, 0, m_rows - 1)) * m_columns;
+    }
+
+    // Down the columns once per row, padded by repeating the edge cells so that cells
+    // index-1 .. index+2 of any column are columnValues[index .. index+3]
+    std::vector<float> columnValues(m_columns + 3);
+    for (int column = 0; column < m_columns; column++) {
+        columnValues[column + 1] = rowSpline[0] * meshRows[0][column] + rowSpline[1] * meshRows[1][column]
+                                 + rowSpline[2] * meshRows[2][column] + rowSpline[3] * meshRows[3][column];
+    }
+    columnValues[0] = columnValues[1];
+    columnValues[m_columns + 1] = columnValues[m_columns];
+    columnValues[m_columns + 2] = columnValues[m_columns];
+
+    // Pixels between the same two centres share their four cell values, so each run is a
+    // plain loop over the weight planes that the compiler vectorizes
+    const size_t plane = m_columnCell.size();
+    const float* w0 = m_columnSpline.data() + x;
+    const float* w1 = w0 + plane;
+    const float* w2 = w1 + plane;
+    const float* w3 = w2 + plane;
+    for (int start = 0; start < count;) {
+        const int cell = m_columnCell[x + start];
+        int end = start + 1;
+        while (end < count && m_columnCell[x + end] == cell) {
+            end++;
+        }
+        const float v0 = columnValues[cell], v1 = columnValues[cell + 1];
+        const float v2 = columnValues[cell + 2], v3 = columnValues[cell + 3];
+        for (int i = start; i < end; i++) {
+            out[i] = v0 * w0[i] + v1 * w1[i] + v2 * w2[i] + v3 * w3[i];
+        }
+        start = end;
+    }
+}
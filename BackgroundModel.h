@@ -0,0 +1,84 @@
+// BackgroundModel.h - Sky background and noise on a coarse mesh of a mosaic
+#ifndef BACKGROUNDMODEL_H
+#define BACKGROUNDMODEL_H
+
+#include <QImage>
+#include <QSize>
+#include <functional>
+#include <vector>
+
+enum class BackgroundChannel {
+    Luminance,          // qGray weights
+    Red,
+    Green,
+    Blue
+};
+
+enum class BackgroundInterpolation {
+    Bilinear,
+    Bicubic             // Catmull-Rom spline through the cell centres: smooth, no kinks at the centres
+};
+
+// The mosaic's luminance (or one colour channel) is cut into cellSize x cellSize cells. Each cell
+// gets a 256-level histogram, and its background is the sigma-clipped median of that
+// histogram (interpolated within the level), its noise the clipped standard deviation.
+// Stars and galaxies are clipped away in a few passes over 256 counts rather than
+// over the pixels. Rows of cells run on the render pool.
+//
+// Between cell centres the values are interpolated one image row at a time, so callers
+// never hold a full-size background image. Each column's cell and weights are tabulated
+// once: bilinear rows are a multiply-add per pixel, bicubic rows four. Noise is always
+// interpolated bilinearly, since a spline can overshoot below the smallest cell noise.
+class BackgroundModel {
+public:
+    static const int DEFAULT_CELL_SIZE = 64;
+
+    BackgroundModel() = default;
+
+    static BackgroundModel estimate(const QImage& image, int cellSize = DEFAULT_CELL_SIZE,
+                                    double clipSigma = 3.0, bool multithreaded = true,
+                                    BackgroundChannel channel = BackgroundChannel::Luminance);
+    // From a luminance plane (levels 0-255, width floats per row, rows packed)
+    static BackgroundModel estimate(const float* luminance, const QSize& size, int cellSize = DEFAULT_CELL_SIZE,
+                                    double clipSigma = 3.0, bool multithreaded = true);
+
+    bool isNull() const { return m_columns == 0; }
+    QSize imageSize() const { return m_imageSize; }
+    int cellSize() const { return m_cellSize; }
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+
+    BackgroundInterpolation interpolation() const { return m_interpolation; }
+    void setInterpolation(BackgroundInterpolation interpolation) { m_interpolation = interpolation; }
+
+    float level(int column, int row) const { return m_level[size_t(row) * m_columns + column]; }
+    float noise(int column, int row) const { return m_noise[size_t(row) * m_columns + column]; }
+    // For cells the caller knows better, e.g. empty canvas where a tile is missing
+    void setLevel(int column, int row, float level) { m_level[size_t(row) * m_columns + column] = level; }
+
+    // Background and noise of pixels [x, x + count) of row y
+    void backgroundRow(int y, int x, int count, float* out) const;
+    void noiseRow(int y, int x, int count, float* out) const;
+
+private:
+    // levelRow(y, levels) fills one row's integer levels
+    static BackgroundModel estimateMesh(const QSize& size, int cellSize, double clipSigma, bool multithreaded,
+                                        const std::function<void(int, quint8*)>& levelRow);
+    // Cell whose centre is at or before pixel, and the weight of the next one
+    void locate(int pixel, int cells, int& index, float& weight) const;
+    void interpolateRow(const std::vector<float>& mesh, int y, int x, int count, float* out) const;
+    void interpolateRowBicubic(const std::vector<float>& mesh, int y, int x, int count, float* out) const;
+
+    QSize m_imageSize;
+    int m_cellSize = DEFAULT_CELL_SIZE;
+    int m_columns = 0;
+    int m_rows = 0;
+    std::vector<float> m_level;     // Row-major, one value per cell
+    std::vector<float> m_noise;
+    std::vector<int> m_columnCell;          // Per image column: left cell centre and weight of the right one
+    std::vector<float> m_columnWeight;
+    std::vector<float> m_columnSpline;      // Four planes of per-column Catmull-Rom weights, cells index-1 .. index+2
+    BackgroundInterpolation m_interpolation = BackgroundInterpolation::Bilinear;
+};
+
+#endif // BACKGROUNDMODEL_H
@@ -0,0 +1,261 @@
+// BrightnessCentroid.cpp - Single-pass blurred-luminance centroid of the brightest region
+#include "BrightnessCentroid.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include <QList>
+#include <QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#include <emmintrin.h>
+#define BRIGHTNESS_CENTROID_SSE2 1
+#endif
+
+namespace {
+    const int BAND_ROWS = 64;
+    const int MAX_RADIUS = 32;      // Keeps the float mean exact after truncation (see processBand)
+
+    // Pixel count, x sum and y sum for every blurred luminance level of one band
+    struct LevelHistogram {
+        std::array<qint64, 256> count{};
+        std::array<qint64, 256> sumX{};
+        std::array<qint64, 256> sumY{};
+    };
+
+    // qGray(): (11 R + 16 G + 5 B) / 32
+    void luminanceRow(const quint32* in, int width, int* out) {
+        int x = 0;
+#ifdef BRIGHTNESS_CENTROID_SSE2
+        const __m128i mask = _mm_set1_epi32(0xFF);
+        for (; x + 4 <= width; x += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            __m128i blue = _mm_and_si128(pixels, mask);
+            __m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 8), mask);
+            __m128i red = _mm_and_si128(_mm_srli_epi32(pixels, 16), mask);
+            // Products stay below 2^12, so the 16-bit multiply is exact in each 32-bit lane
+            __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(red, _mm_set1_epi32(11)),
+                                                      _mm_slli_epi32(green, 4)),
+                                        _mm_mullo_epi16(blue, _mm_set1_epi32(5)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_srli_epi32(sum, 5));
+        }
+#endif
+        for (; x < width; x++) {
+            out[x] = qGray(in[x]);
+        }
+    }
+
+    // Running sum of [x - radius, x + radius], clipped to the row
+    void horizontalSums(const int* luminance, int width, int radius, int* out) {
+        int sum = 0;
+        for (int x = 0; x < std::min(radius, width); x++) {
+            sum += luminance[x];
+        }
+        int x = 0;
+        for (; x < std::min(radius, width); x++) {      // Window start clipped
+            if (x + radius < width) sum += luminance[x + radius];
+            out[x] = sum;
+        }
+        for (; x + radius < width; x++) {               // Interior, no bounds checks
+            sum += luminance[x + radius];
+            out[x] = sum;
+            sum -= luminance[x - radius];
+        }
+        for (; x < width; x++) {                        // Window end clipped
+            out[x] = sum;
+            sum -= luminance[x - radius];
+        }
+    }
+
+    // Slides the column box down one row and turns each column sum into its truncated mean
+    void slideColumns(int* columnSums, const int* added, const int* removed, const float* inverse,
+                      int width, int* levels) {
+        int x = 0;
+#ifdef BRIGHTNESS_CENTROID_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (; x + 4 <= width; x += 4) {
+            __m128i sums = _mm_loadu_si128(reinterpret_cast<const __m128i*>(columnSums + x));
+            __m128i in = added ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(added + x)) : zero;
+            __m128i out = removed ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(removed + x)) : zero;
+            sums = _mm_sub_epi32(_mm_add_epi32(sums, in), out);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(columnSums + x), sums);
+            __m128 mean = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(sums), half), _mm_loadu_ps(inverse + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + x), _mm_cvttps_epi32(mean));
+        }
+#endif
+        for (; x < width; x++) {
+            columnSums[x] += (added ? added[x] : 0) - (removed ? removed[x] : 0);
+            levels[x] = int((float(columnSums[x]) + 0.5f) * inverse[x]);
+        }
+    }
+
+    inline int windowCount(int i, int radius, int length) {
+        return std::min(i + radius, length - 1) - std::max(i - radius, 0) + 1;
+    }
+}
+
+BrightnessCentroid BrightnessCentroid::find(const QImage& image, int blurRadius,
+                                            double thresholdFraction, bool multithreaded) {
+    return find(image, QRect(), blurRadius, thresholdFraction, multithreaded);
+}
+
+BrightnessCentroid BrightnessCentroid::find(const QImage& image, const QRect& region, int blurRadius,
+                                            double thresholdFraction, bool multithreaded) {
+    const QRect area = region.isEmpty() ? image.rect() : region.intersected(image.rect());
+    BrightnessCentroid result;
+    result.center = area.isEmpty() ? QPoint(image.width() / 2, image.height() / 2) : area.center();
+    if (image.isNull() || area.isEmpty()) {
+        return result;
+    }
+
+    const QImage source = PixelFormat::toInternal(image, "centroid");
+    const int width = area.width();
+    const int height = area.height();
+    const int radius = std::clamp(blurRadius, 0, MAX_RADIUS);
+    const int window = 2 * radius + 1;
+
+    // Window widths per column; interior columns all see the full window
+    std::vector<int> columnCount(width);
+    for (int x = 0; x < width; x++) {
+        columnCount[x] = windowCount(x, radius, width);
+    }
+
+    QList<int> bands;
+    for (int y = 0; y < height; y += BAND_ROWS) {
+        bands.append(y);
+    }
+    std::vector<LevelHistogram> histograms(bands.size());
+
+    auto processBand = [&](int firstRow) {
+        const int lastRow = std::min(height, firstRow + BAND_ROWS);
+        LevelHistogram& histogram = histograms[firstRow / BAND_ROWS];
+
+        // Horizontal sums of the rows in the box plus the one leaving it, by row modulo ringRows
+        const int ringRows = window + 1;
+        std::vector<int> ring(size_t(ringRows) * width);
+        std::vector<int> luminance(width);
+        std::vector<int> columnSums(width, 0);
+        std::vector<float> inverse(width);
+        std::vector<int> levels(width);
+        std::array<int, 256> rowCounts{};
+        int inverseRowCount = -1;
+
+        auto ringRow = [&](int y) { return ring.data() + size_t(y % ringRows) * width; };
+        auto loadRow = [&](int y) {
+            const quint32* in = reinterpret_cast<const quint32*>(source.constScanLine(area.y() + y)) + area.x();
+            luminanceRow(in, width, luminance.data());
+            horizontalSums(luminance.data(), width, radius, ringRow(y));
+            return ringRow(y);
+        };
+
+        const int firstLoaded = std::max(0, firstRow - radius);
+        for (int y = firstLoaded; y < std::min(height, firstRow + radius); y++) {
+            const int* sums = loadRow(y);
+            for (int x = 0; x < width; x++) columnSums[x] += sums[x];
+        }
+
+        for (int y = firstRow; y < lastRow; y++) {
+            // Truncated like integer division: the 0.5 bias keeps exact multiples clear of
+            // the reciprocal's rounding for boxes this small
+            const int rowCount = windowCount(y, radius, height);
+            if (rowCount != inverseRowCount) {
+                for (int x = 0; x < width; x++) inverse[x] = 1.0f / float(rowCount * columnCount[x]);
+                inverseRowCount = rowCount;
+            }
+
+            const int* added = y + radius < height ? loadRow(y + radius) : nullptr;
+            const int* removed = y - radius - 1 >= firstLoaded ? ringRow(y - radius - 1) : nullptr;
+            slideColumns(columnSums.data(), added, removed, inverse.data(), width, levels.data());
+
+            // y is the same along the row, so it is folded in once per level at the row's end
+            for (int x = 0; x < width; x++) {
+                rowCounts[levels[x]]++;
+                histogram.sumX[levels[x]] += x;
+            }
+            for (int level = 0; level < 256; level++) {
+                histogram.count[level] += rowCounts[level];
+                histogram.sumY[level] += qint64(y) * rowCounts[level];
+                rowCounts[level] = 0;
+            }
+        }
+    };
+
+    if (multithreaded && bands.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, processBand);
+    } else {
+        for (int firstRow : bands) {
+            processBand(firstRow);
+        }
+    }
+
+    LevelHistogram total;
+    for (const LevelHistogram& band : histograms) {
+        for (int level = 0; level < 256; level++) {
+            total.count[level] += band.count[level];
+            total.sumX[level] += band.sumX[level];
+            total.sumY[level] += band.sumY[level];
+        }
+    }
+
+    for (int level = 255; level > 0; level--) {
+        if (total.count[level] > 0) {
+            result.maxBrightness = level;
+            break;
+        }
+    }
+    if (result.maxBrightness == 0) {
+        return result;
+    }
+
+    // Only the brightest levels count, each weighted by brightness squared; all integer
+    // sums, so the result does not depend on how the bands were split
+    result.threshold = int(result.maxBrightness * thresholdFraction);
+    qint64 weight = 0, weightedX = 0, weightedY = 0;
+    for (int level = result.threshold + 1; level <= result.maxBrightness; level++) {
+        qint64 levelWeight = qint64(level) * level;
+        weight += levelWeight * total.count[level];
+        weightedX += levelWeight * total.sumX[level];
+        weightedY += levelWeight * total.sumY[level];
+    }
+
+    result.totalWeight = double(weight);
+    if (weight > 0) {
+        result.center = QPoint(int(double(weightedX) / weight), int(double(weightedY) / weight));
+        result.center.setX(std::clamp(result.center.x(), 0, width - 1));
+        result.center.setY(std::clamp(result.center.y(), 0, height - 1));
+        result.center += area.topLeft();
+        result.found = true;
+    }
+    return result;
+}
+
+BrightnessCentroid BrightnessCentroid::coarseToFine(const QImage& image, const QImage& coarse, int blurRadius,
+                                                    double thresholdFraction, int refineRadius) {
+    if (image.isNull() || coarse.isNull() || coarse.width() > image.width()) {
+        return find(image, blurRadius, thresholdFraction);
+    }
+
+    // The coarse pixels already average scale^2 full-resolution ones, so a small blur will do
+    const double scaleX = double(image.width()) / coarse.width();
+    const double scaleY = double(image.height()) / coarse.height();
+    int coarseRadius = std::max(1, int(std::lround(blurRadius / scaleX)));
+    BrightnessCentroid estimate = find(coarse, coarseRadius, thresholdFraction, false);
+    if (!estimate.found) {
+        estimate.center = QPoint(image.width() / 2, image.height() / 2);
+        return estimate;
+    }
+
+    // Refine in a full-resolution window around the estimate; the window keeps a margin
+    // of coarse pixels on every side so the bright region it found fits inside
+    QPoint guess(int((estimate.center.x() + 0.5) * scaleX), int((estimate.center.y() + 0.5) * scaleY));
+    int radius = std::max(refineRadius, int(std::ceil(4 * std::max(scaleX, scaleY))));
+    QRect window(guess.x() - radius, guess.y() - radius, 2 * radius + 1, 2 * radius + 1);
+    BrightnessCentroid refined = find(image, window, blurRadius, thresholdFraction, false);
+    if (!refined.found) {
+        refined.center = guess;
+    }
+    return refined;
+}
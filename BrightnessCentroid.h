@@ -0,0 +1,38 @@
+// BrightnessCentroid.h - Single-pass blurred-luminance centroid of the brightest region
+#ifndef BRIGHTNESSCENTROID_H
+#define BRIGHTNESSCENTROID_H
+
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+
+// Where a mosaic's object sits: the centroid of the pixels whose box-blurred luminance
+// (qGray weights) is above a fraction of the maximum, weighted by luminance squared.
+//
+// Each row band reads its source rows once: luminance is computed four pixels at a time
+// with integer SSE2, box-summed along the row and down the columns, and binned into a
+// 256-level histogram that also carries the x and y sums per level. The maximum, the
+// threshold and the weighted centroid all come out of the merged histograms afterwards,
+// so neither the blurred image nor a second pass over it is needed.
+struct BrightnessCentroid {
+    QPoint center;              // Geometric centre when nothing is above the threshold
+    int maxBrightness = 0;
+    int threshold = 0;
+    double totalWeight = 0.0;
+    bool found = false;
+
+    static BrightnessCentroid find(const QImage& image, int blurRadius = 3,
+                                   double thresholdFraction = 0.7, bool multithreaded = true);
+
+    // Only region is read; the box is clipped at its edges and the centre is in image coordinates
+    static BrightnessCentroid find(const QImage& image, const QRect& region, int blurRadius,
+                                   double thresholdFraction, bool multithreaded = true);
+
+    // Locates the region on coarse (a box-downsampled copy, e.g. 1/8 scale), then finds the
+    // centroid at full resolution only within refineRadius pixels of that estimate.
+    // The maximum and threshold are those of the refinement window.
+    static BrightnessCentroid coarseToFine(const QImage& image, const QImage& coarse, int blurRadius = 3,
+                                           double thresholdFraction = 0.7, int refineRadius = 128);
+};
+
+#endif // BRIGHTNESSCENTROID_H
@@ -0,0 +1,274 @@
+// DeepZoomWriter.cpp - Streams an image into a Deep Zoom (DZI) multi-resolution tile pyramid
+#include "DeepZoomWriter.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRect>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Rounded mean of four RGB32 pixels, two channels per 32-bit lane pair
+    inline quint32 average4(quint32 a, quint32 b, quint32 c, quint32 d) {
+        quint32 rb = (a & 0x00FF00FF) + (b & 0x00FF00FF) + (c & 0x00FF00FF) + (d & 0x00FF00FF) + 0x00020002;
+        quint32 ag = ((a >> 8) & 0x00FF00FF) + ((b >> 8) & 0x00FF00FF)
+                   + ((c >> 8) & 0x00FF00FF) + ((d >> 8) & 0x00FF00FF) + 0x00020002;
+        return ((rb >> 2) & 0x00FF00FF) | (((ag >> 2) & 0x00FF00FF) << 8);
+    }
+
+    // Output rows per pooled band of the 2x2 box filter
+    const int HALVE_BAND_ROWS = 64;
+
+    // 2x2 box filter over the first `rows` rows; an odd last row or column pairs with itself.
+    // Row bands run on the shared render pool, each writing through the one buffer taken up front.
+    QImage boxHalve(const QImage& source, int rows) {
+        const int width = source.width();
+        QImage half((width + 1) / 2, (rows + 1) / 2, QImage::Format_RGB32);
+        uchar* base = half.bits();
+        const qsizetype stride = half.bytesPerLine();
+        const int height = half.height();
+
+        auto halveBand = [&](int firstRow) {
+            const int lastRow = std::min(height, firstRow + HALVE_BAND_ROWS);
+            for (int oy = firstRow; oy < lastRow; ++oy) {
+                const quint32* top = reinterpret_cast<const quint32*>(source.constScanLine(2 * oy));
+                const quint32* bottom = 2 * oy + 1 < rows
+                    ? reinterpret_cast<const quint32*>(source.constScanLine(2 * oy + 1)) : top;
+                quint32* out = reinterpret_cast<quint32*>(base + oy * stride);
+
+                const int pairs = width / 2;
+                for (int ox = 0; ox < pairs; ++ox) {
+                    out[ox] = average4(top[2 * ox], top[2 * ox + 1], bottom[2 * ox], bottom[2 * ox + 1]);
+                }
+                if (width & 1) {
+                    out[pairs] = average4(top[width - 1], top[width - 1], bottom[width - 1], bottom[width - 1]);
+                }
+            }
+        };
+
+        QList<int> bands;
+        for (int y = 0; y < height; y += HALVE_BAND_ROWS) {
+            bands.append(y);
+        }
+        if (bands.size() > 1) {
+            QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, halveBand);
+        } else if (!bands.isEmpty()) {
+            halveBand(0);
+        }
+        return half;
+    }
+
+    // `band` followed by the first `count` rows of `rows`
+    QImage appendRows(const QImage& band, const QImage& rows, int count) {
+        if (band.isNull() && count == rows.height()) {
+            return rows;
+        }
+        const int bandRows = band.isNull() ? 0 : band.height();
+        const qsizetype rowBytes = qsizetype(rows.width()) * 4;
+        QImage joined(rows.width(), bandRows + count, QImage::Format_RGB32);
+        for (int y = 0; y < bandRows; ++y) {
+            memcpy(joined.scanLine(y), band.constScanLine(y), rowBytes);
+        }
+        for (int y = 0; y < count; ++y) {
+            memcpy(joined.scanLine(bandRows + y), rows.constScanLine(y), rowBytes);
+        }
+        return joined;
+    }
+}
+
+DeepZoomWriter::DeepZoomWriter(const QString& dziFile, const QSize& size, const DeepZoomOptions& options)
+    : m_dziFile(dziFile)
+    , m_size(size)
+    , m_options(options)
+    , m_tilesWritten(0)
+    , m_failed(false) {
+
+    m_options.tileSize = std::max(1, m_options.tileSize);
+    m_options.overlap = std::max(0, m_options.overlap);
+
+    QFileInfo info(dziFile);
+    m_tileDir = QString("%1/%2_files").arg(info.path(), info.completeBaseName());
+
+    // Halve (rounding up) until 1x1
+    QList<QSize> sizes;
+    QSize levelSize = size;
+    while (!levelSize.isEmpty()) {
+        sizes.append(levelSize);
+        if (levelSize == QSize(1, 1)) break;
+        levelSize = QSize((levelSize.width() + 1) / 2, (levelSize.height() + 1) / 2);
+    }
+    for (int i = 0; i < sizes.size(); ++i) {
+        m_levels.append({int(sizes.size() - 1 - i), sizes[i], QImage(), 0, 0, 0, QImage()});
+    }
+}
+
+DeepZoomWriter::~DeepZoomWriter() {
+    collectFinished(true);
+}
+
+bool DeepZoomWriter::fail(const QString& message) {
+    if (!m_failed) {
+        m_error = message;
+        qDebug() << QString("❌ DeepZoomWriter: %1").arg(message);
+    }
+    m_failed = true;
+    return false;
+}
+
+bool DeepZoomWriter::open() {
+    if (m_levels.isEmpty()) {
+        return fail("image size is empty");
+    }
+    for (const Level& level : m_levels) {
+        if (!QDir().mkpath(QString("%1/%2").arg(m_tileDir).arg(level.index))) {
+            return fail(QString("cannot create %1/%2").arg(m_tileDir).arg(level.index));
+        }
+    }
+
+    QFile file(m_dziFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return fail(QString("cannot write %1").arg(m_dziFile));
+    }
+    QTextStream out(&file);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out << QString("<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"%1\" Overlap=\"%2\" TileSize=\"%3\">\n")
+           .arg(QString::fromLatin1(m_options.format)).arg(m_options.overlap).arg(m_options.tileSize);
+    out << QString("  <Size Width=\"%1\" Height=\"%2\"/>\n").arg(m_size.width()).arg(m_size.height());
+    out << "</Image>\n";
+    return true;
+}
+
+bool DeepZoomWriter::writeRows(const QImage& rows) {
+    if (m_failed) {
+        return false;
+    }
+    if (rows.width() != m_size.width()) {
+        return fail(QString("rows are %1 px wide, expected %2").arg(rows.width()).arg(m_size.width()));
+    }
+    push(0, PixelFormat::convert(rows, PixelFormat::INTERNAL, "deep zoom"));
+    collectFinished(false);
+    return !m_failed;
+}
+
+void DeepZoomWriter::push(int levelIndex, const QImage& rows) {
+    Level& level = m_levels[levelIndex];
+    const int count = std::min(rows.height(), level.size.height() - level.rowsReceived);
+    if (count <= 0) {
+        return;
+    }
+
+    level.band = appendRows(level.band, rows, count);
+    level.rowsReceived += count;
+    emitTileRows(level);
+
+    if (levelIndex + 1 >= m_levels.size()) {
+        return;
+    }
+
+    // Fused downsample: the rows just cut into tiles are halved straight into the next level
+    QImage pending = appendRows(level.carry, rows, count);
+    const bool complete = level.rowsReceived == level.size.height();
+    const int paired = complete ? pending.height() : pending.height() & ~1;
+    level.carry = paired < pending.height() ? pending.copy(0, paired, pending.width(), 1) : QImage();
+    if (paired > 0) {
+        push(levelIndex + 1, boxHalve(pending, paired));
+    }
+}
+
+void DeepZoomWriter::emitTileRows(Level& level) {
+    const int tileSize = m_options.tileSize;
+    const int overlap = m_options.overlap;
+    const int height = level.size.height();
+    const int tileRows = (height + tileSize - 1) / tileSize;
+    const int tileCols = (level.size.width() + tileSize - 1) / tileSize;
+
+    while (level.nextTileRow < tileRows) {
+        int row = level.nextTileRow;
+        int y0 = std::max(0, row * tileSize - overlap);
+        int y1 = std::min(height, (row + 1) * tileSize + overlap);
+        if (level.rowsReceived < y1) break;
+
+        for (int col = 0; col < tileCols; ++col) {
+            queueTile(level, col, row, y0, y1);
+        }
+        level.nextTileRow++;
+    }
+
+    // Drop rows no remaining tile row overlaps
+    int keepFrom = std::min(level.rowsReceived, std::max(0, level.nextTileRow * tileSize - overlap));
+    if (keepFrom > level.bandTop) {
+        int keep = level.rowsReceived - keepFrom;
+        level.band = keep > 0 ? level.band.copy(0, keepFrom - level.bandTop, level.size.width(), keep) : QImage();
+        level.bandTop = keepFrom;
+    }
+}
+
+void DeepZoomWriter::queueTile(const Level& level, int col, int row, int y0, int y1) {
+    const int tileSize = m_options.tileSize;
+    const int overlap = m_options.overlap;
+    int x0 = std::max(0, col * tileSize - overlap);
+    int x1 = std::min(level.size.width(), (col + 1) * tileSize + overlap);
+
+    QImage band = level.band;   // Shared; later appends and trims build new images
+    QRect rect(x0, y0 - level.bandTop, x1 - x0, y1 - y0);
+    QString path = QString("%1/%2/%3_%4.%5").arg(m_tileDir).arg(level.index).arg(col).arg(row)
+                   .arg(QString::fromLatin1(m_options.format));
+    QByteArray format = m_options.format;
+    int quality = m_options.quality;
+
+    // Bound the queue so bands held by queued tiles cannot pile up behind slow encoders
+    const int maxPending = MosaicRenderer::pool()->maxThreadCount() * 8;
+    while (m_pending.size() >= maxPending) {
+        m_pending.first().waitForFinished();
+        collectFinished(false);
+    }
+
+    m_pending.append(QtConcurrent::run(MosaicRenderer::pool(), [band, rect, path, format, quality]() {
+        return band.copy(rect).save(path, format.constData(), quality);
+    }));
+}
+
+void DeepZoomWriter::collectFinished(bool waitAll) {
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (waitAll) {
+            it->waitForFinished();
+        } else if (!it->isFinished()) {
+            ++it;
+            continue;
+        }
+        if (it->result()) {
+            m_tilesWritten++;
+        } else {
+            fail(QString("cannot write tiles under %1").arg(m_tileDir));
+        }
+        it = m_pending.erase(it);
+    }
+}
+
+bool DeepZoomWriter::finish() {
+    if (!m_levels.isEmpty() && m_levels.first().rowsReceived != m_size.height()) {
+        fail(QString("only %1 of %2 rows were written").arg(m_levels.first().rowsReceived).arg(m_size.height()));
+    }
+    collectFinished(true);
+    return !m_failed;
+}
+
+bool DeepZoomWriter::exportImage(const QImage& image, const QString& dziFile,
+                                 const DeepZoomOptions& options, QString* error) {
+    DeepZoomWriter writer(dziFile, image.size(), options);
+    bool ok = writer.open() && writer.writeRows(image) && writer.finish();
+    if (error) {
+        *error = writer.errorString();
+    }
+    return ok;
+}
+
+QImage DeepZoomWriter::halve(const QImage& image) {
+    QImage source = PixelFormat::convert(image, PixelFormat::INTERNAL, "deep zoom");
+    return boxHalve(source, source.height());
+}
@@ -0,0 +1,74 @@
+// DeepZoomWriter.h - Streams an image into a Deep Zoom (DZI) multi-resolution tile pyramid
+#ifndef DEEPZOOMWRITER_H
+#define DEEPZOOMWRITER_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QImage>
+#include <QList>
+#include <QSize>
+#include <QString>
+
+struct DeepZoomOptions {
+    int tileSize = 254;         // 254 + 2 * overlap gives 256px tiles inside the pyramid
+    int overlap = 1;
+    QByteArray format = "jpg";  // "jpg" or "png"
+    int quality = 90;
+};
+
+// Writes <name>.dzi and <name>_files/<level>/<col>_<row>.<format>, level 0 being 1x1.
+// Rows arrive top to bottom in bands of any height. Each band is cut into tiles for its
+// level and box-filtered 2x2 straight into the next level's band in the same pass, so
+// every level fills in concurrently and only a tile row or so per level is held in memory.
+// Tile encoding runs on the render pool.
+class DeepZoomWriter {
+public:
+    DeepZoomWriter(const QString& dziFile, const QSize& size, const DeepZoomOptions& options = DeepZoomOptions());
+    ~DeepZoomWriter();
+
+    // Creates the level directories and writes the .dzi descriptor
+    bool open();
+    bool writeRows(const QImage& rows);
+    // Flushes the partial rows of every level and waits for the encoders
+    bool finish();
+
+    int levelCount() const { return m_levels.size(); }
+    int tilesWritten() const { return m_tilesWritten; }
+    QString errorString() const { return m_error; }
+
+    // Whole image in one call; the pyramid for a finished mosaic
+    static bool exportImage(const QImage& image, const QString& dziFile,
+                            const DeepZoomOptions& options = DeepZoomOptions(), QString* error = nullptr);
+
+    // Half size, rounded up: each pixel is the mean of a 2x2 block, edge pixels repeated
+    static QImage halve(const QImage& image);
+
+private:
+    struct Level {
+        int index;              // DZI level number, 0 = 1x1
+        QSize size;
+        QImage band;            // Rows [bandTop, rowsReceived) still needed for tiles
+        int bandTop;
+        int rowsReceived;
+        int nextTileRow;
+        QImage carry;           // Unpaired last row, halved once its partner arrives
+    };
+
+    QString m_dziFile;
+    QString m_tileDir;
+    QSize m_size;
+    DeepZoomOptions m_options;
+    QList<Level> m_levels;      // Full resolution first
+    QList<QFuture<bool>> m_pending;
+    int m_tilesWritten;
+    bool m_failed;
+    QString m_error;
+
+    bool fail(const QString& message);
+    void push(int levelIndex, const QImage& rows);
+    void emitTileRows(Level& level);
+    void queueTile(const Level& level, int col, int row, int y0, int y1);
+    void collectFinished(bool waitAll);
+};
+
+#endif // DEEPZOOMWRITER_H
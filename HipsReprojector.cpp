@@ -0,0 +1,703 @@
+// HipsReprojector.cpp - Resamples HiPS tiles into a gnomonic (TAN) view of the sky
+#include "HipsReprojector.h"
+#include "MosaicCompositor.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include "ReprojectionMap.h"
+#include <QDebug>
+#include <QSet>
+#include <QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#include <emmintrin.h>
+#define HIPS_REPROJECTOR_SSE2 1
+#endif
+
+namespace {
+    const double DEG_TO_RAD = M_PI / 180.0;
+    const int BAND_ROWS = 16;           // Rows per work item handed to the render pool
+    const int LANCZOS_PHASES = 256;     // Sub-pixel phases in the Lanczos weight table
+    const int FIXED_ONE = 1 << ReprojectionMap::FRACTION_BITS;
+    const int PHASE_SHIFT = 8 - ReprojectionMap::FRACTION_BITS;   // Map fraction -> 8-bit phase
+
+    // Interleaves the low 32 bits of v with zeros (x -> even bits of a NEST index)
+    quint64 spreadBits(quint64 v) {
+        v &= 0xFFFFFFFFull;
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8))  & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4))  & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2))  & 0x3333333333333333ull;
+        v = (v | (v << 1))  & 0x5555555555555555ull;
+        return v;
+    }
+
+    long long nestIndex(int face, qint64 ix, qint64 iy, int order) {
+        return (qint64(face) << (2 * order)) | qint64(spreadBits(quint64(ix)) | (spreadBits(quint64(iy)) << 1));
+    }
+
+    // Tangent point and the per-pixel steps of the tangent plane, so a pixel's direction
+    // is centre + dx * right + dy * up
+    struct TanBasis {
+        double center[3];
+        double right[3];
+        double up[3];
+        double halfWidth;
+        double halfHeight;
+        double originX;     // Window offset inside the frame
+        double originY;
+
+        explicit TanBasis(const TanProjection& projection) {
+            double ra = projection.centerRaDeg * DEG_TO_RAD;
+            double dec = projection.centerDecDeg * DEG_TO_RAD;
+            double rot = projection.rotationDeg * DEG_TO_RAD;
+            double scale = projection.pixelScaleDeg * DEG_TO_RAD;
+
+            double east[3] = {-std::sin(ra), std::cos(ra), 0.0};
+            double north[3] = {-std::sin(dec) * std::cos(ra), -std::sin(dec) * std::sin(ra), std::cos(dec)};
+            center[0] = std::cos(dec) * std::cos(ra);
+            center[1] = std::cos(dec) * std::sin(ra);
+            center[2] = std::sin(dec);
+
+            // With no rotation, image right is west and image up is north
+            for (int i = 0; i < 3; i++) {
+                right[i] = scale * (-std::cos(rot) * east[i] + std::sin(rot) * north[i]);
+                up[i] = scale * (std::sin(rot) * east[i] + std::cos(rot) * north[i]);
+            }
+            halfWidth = projection.size.width() / 2.0;
+            halfHeight = projection.size.height() / 2.0;
+            originX = projection.window.isEmpty() ? 0.0 : projection.window.x();
+            originY = projection.window.isEmpty() ? 0.0 : projection.window.y();
+        }
+
+        void direction(double x, double y, double& vx, double& vy, double& vz) const {
+            double dx = originX + x + 0.5 - halfWidth;
+            double dy = halfHeight - (originY + y + 0.5);
+            vx = center[0] + dx * right[0] + dy * up[0];
+            vy = center[1] + dx * right[1] + dy * up[1];
+            vz = center[2] + dx * right[2] + dy * up[2];
+            double norm = 1.0 / std::sqrt(vx * vx + vy * vy + vz * vz);
+            vx *= norm;
+            vy *= norm;
+            vz *= norm;
+        }
+    };
+
+    // Lanczos-3 weights of the six taps floor(p) - 2 ... floor(p) + 3, normalized to 1
+    struct LanczosTable {
+        float weights[LANCZOS_PHASES + 1][6];
+
+        LanczosTable() {
+            for (int phase = 0; phase <= LANCZOS_PHASES; phase++) {
+                double t = double(phase) / LANCZOS_PHASES;
+                double w[6];
+                double sum = 0.0;
+                for (int k = 0; k < 6; k++) {
+                    w[k] = lanczos3(t - (k - 2));
+                    sum += w[k];
+                }
+                for (int k = 0; k < 6; k++) {
+                    weights[phase][k] = float(w[k] / sum);
+                }
+            }
+        }
+
+        static double lanczos3(double d) {
+            if (std::abs(d) < 1e-9) return 1.0;
+            if (std::abs(d) >= 3.0) return 0.0;
+            double pd = M_PI * d;
+            return 3.0 * std::sin(pd) * std::sin(pd / 3.0) / (pd * pd);
+        }
+    };
+
+    const LanczosTable& lanczosTable() {
+        static const LanczosTable table;
+        return table;
+    }
+
+    // Reads pixels by face coordinate. Neighbouring output pixels nearly always land in
+    // the same tile, so the last tile looked up is remembered. Each band owns one.
+    class FaceSampler {
+    public:
+        explicit FaceSampler(const HipsTileSet& tiles)
+            : m_tiles(tiles)
+            , m_width(tiles.tileWidth)
+            , m_faceSize(qint64(tiles.tileWidth) << tiles.order) {
+        }
+
+        qint64 faceSize() const { return m_faceSize; }
+
+        quint32 pixel(int face, qint64 gx, qint64 gy) {
+            // Kernel taps past a face edge are clamped to it rather than followed onto the neighbour
+            gx = std::clamp<qint64>(gx, 0, m_faceSize - 1);
+            gy = std::clamp<qint64>(gy, 0, m_faceSize - 1);
+            qint64 tx = gx / m_width;
+            qint64 ty = gy / m_width;
+
+            long long nest = nestIndex(face, tx, ty, m_tiles.order);
+            if (nest != m_nest) {
+                m_nest = nest;
+                auto it = m_tiles.tiles.constFind(nest);
+                m_bits = (it == m_tiles.tiles.constEnd()) ? nullptr : it->constBits();
+                m_stride = (it == m_tiles.tiles.constEnd()) ? 0 : it->bytesPerLine();
+            }
+            if (!m_bits) {
+                return 0xFF000000u;   // Tile not loaded: black
+            }
+
+            // HiPS tile layout: the face's north corner is the top-left image pixel,
+            // east top-right, south bottom-right and west bottom-left
+            int lx = int(gx - tx * m_width);
+            int ly = int(gy - ty * m_width);
+            int row = m_width - 1 - lx;
+            int col = m_width - 1 - ly;
+            return reinterpret_cast<const quint32*>(m_bits + row * m_stride)[col];
+        }
+
+    private:
+        const HipsTileSet& m_tiles;
+        int m_width;
+        qint64 m_faceSize;
+        long long m_nest = -1;
+        const uchar* m_bits = nullptr;
+        qsizetype m_stride = 0;
+    };
+
+    // wx, wy are the 8-bit fractional positions of the sample between the four pixels
+    quint32 blendBilinear(quint32 p00, quint32 p10, quint32 p01, quint32 p11, int wx, int wy) {
+        int w00 = ((256 - wx) * (256 - wy)) >> 8;
+        int w10 = (wx * (256 - wy)) >> 8;
+        int w01 = ((256 - wx) * wy) >> 8;
+        int w11 = 256 - w00 - w10 - w01;
+
+#ifdef HIPS_REPROJECTOR_SSE2
+        // All four pixels widened to 16 bits per channel in one register pair. The
+        // weights sum to 256, so no channel total can overflow 16 bits.
+        const __m128i zero = _mm_setzero_si128();
+        __m128i pixels = _mm_set_epi32(int(p11), int(p01), int(p10), int(p00));
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);   // p00 | p10
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);   // p01 | p11
+        __m128i wlo = _mm_set_epi16(w10, w10, w10, w10, w00, w00, w00, w00);
+        __m128i whi = _mm_set_epi16(w11, w11, w11, w11, w01, w01, w01, w01);
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(lo, wlo), _mm_mullo_epi16(hi, whi));
+        sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+        sum = _mm_srli_epi16(sum, 8);
+        return quint32(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum))) | 0xFF000000u;
+#else
+        quint32 result = 0xFF000000u;
+        for (int shift = 0; shift < 24; shift += 8) {
+            int c = int((p00 >> shift) & 0xFF) * w00 + int((p10 >> shift) & 0xFF) * w10
+                  + int((p01 >> shift) & 0xFF) * w01 + int((p11 >> shift) & 0xFF) * w11;
+            result |= quint32(c >> 8) << shift;
+        }
+        return result;
+#endif
+    }
+
+    // x0, y0 is the face pixel at or left of/above the sample; phases are its 8-bit offsets
+    quint32 sampleLanczos3(FaceSampler& sampler, int face, qint64 x0, qint64 y0, int phaseX, int phaseY) {
+        const float* wx = lanczosTable().weights[phaseX];
+        const float* wy = lanczosTable().weights[phaseY];
+
+#ifdef HIPS_REPROJECTOR_SSE2
+        // One pixel per register as four float channels; rows are summed, then weighted
+        const __m128i zero = _mm_setzero_si128();
+        __m128 acc = _mm_setzero_ps();
+        for (int j = 0; j < 6; j++) {
+            __m128 row = _mm_setzero_ps();
+            for (int i = 0; i < 6; i++) {
+                __m128i p = _mm_cvtsi32_si128(int(sampler.pixel(face, x0 - 2 + i, y0 - 2 + j)));
+                p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero);
+                row = _mm_add_ps(row, _mm_mul_ps(_mm_cvtepi32_ps(p), _mm_set1_ps(wx[i])));
+            }
+            acc = _mm_add_ps(acc, _mm_mul_ps(row, _mm_set1_ps(wy[j])));
+        }
+        // Lanczos lobes overshoot; the saturating packs clamp to 0..255
+        __m128i rounded = _mm_cvtps_epi32(acc);
+        rounded = _mm_packs_epi32(rounded, rounded);
+        return quint32(_mm_cvtsi128_si32(_mm_packus_epi16(rounded, rounded))) | 0xFF000000u;
+#else
+        float acc[3] = {0.0f, 0.0f, 0.0f};
+        for (int j = 0; j < 6; j++) {
+            float row[3] = {0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < 6; i++) {
+                quint32 p = sampler.pixel(face, x0 - 2 + i, y0 - 2 + j);
+                for (int c = 0; c < 3; c++) {
+                    row[c] += float((p >> (8 * c)) & 0xFF) * wx[i];
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                acc[c] += row[c] * wy[j];
+            }
+        }
+        quint32 result = 0xFF000000u;
+        for (int c = 0; c < 3; c++) {
+            long v = std::clamp(std::lrint(acc[c]), 0L, 255L);
+            result |= quint32(v) << (8 * c);
+        }
+        return result;
+#endif
+    }
+
+    // gx, gy: sample position in face pixels, fixed point with pixel centres on whole numbers
+    quint32 sample(FaceSampler& sampler, int face, qint64 gx, qint64 gy, ResampleKernel kernel) {
+        const int fraction = ReprojectionMap::FRACTION_BITS;
+        qint64 x0 = gx >> fraction;
+        qint64 y0 = gy >> fraction;
+        int phaseX = int(gx & (FIXED_ONE - 1)) << PHASE_SHIFT;
+        int phaseY = int(gy & (FIXED_ONE - 1)) << PHASE_SHIFT;
+
+        switch (kernel) {
+            case ResampleKernel::Nearest:
+                return sampler.pixel(face, (gx + FIXED_ONE / 2) >> fraction, (gy + FIXED_ONE / 2) >> fraction);
+
+            case ResampleKernel::Bilinear:
+                return blendBilinear(sampler.pixel(face, x0, y0), sampler.pixel(face, x0 + 1, y0),
+                                     sampler.pixel(face, x0, y0 + 1), sampler.pixel(face, x0 + 1, y0 + 1),
+                                     phaseX, phaseY);
+
+            case ResampleKernel::Lanczos3:
+                return sampleLanczos3(sampler, face, x0, y0, phaseX, phaseY);
+        }
+        return 0xFF000000u;
+    }
+
+    int kernelRadius(ResampleKernel kernel) {
+        switch (kernel) {
+            case ResampleKernel::Nearest:  return 0;
+            case ResampleKernel::Bilinear: return 1;
+            case ResampleKernel::Lanczos3: return 3;
+        }
+        return 3;
+    }
+
+    // 8-bit level of the part of a pixel a channel band reads
+    inline int bandLevel(quint32 pixel, BandSource source) {
+        switch (source) {
+            case BandSource::Red:   return int((pixel >> 16) & 0xFF);
+            case BandSource::Green: return int((pixel >> 8) & 0xFF);
+            case BandSource::Blue:  return int(pixel & 0xFF);
+            case BandSource::Luminance:
+                break;
+        }
+        // Rec. 601 weights in 8-bit fixed point; they sum to 256
+        return int((((pixel >> 16) & 0xFF) * 77 + ((pixel >> 8) & 0xFF) * 150 + (pixel & 0xFF) * 29) >> 8);
+    }
+
+    // acc[i] += intensity[i] * weight; both buffers 16-byte aligned and padded to 4 floats
+    void accumulateRow(float* acc, const float* intensity, float weight, int width) {
+#ifdef HIPS_REPROJECTOR_SSE2
+        const __m128 w = _mm_set1_ps(weight);
+        for (int x = 0; x < width; x += 4) {
+            _mm_store_ps(acc + x, _mm_add_ps(_mm_load_ps(acc + x), _mm_mul_ps(_mm_load_ps(intensity + x), w)));
+        }
+#else
+        for (int x = 0; x < width; x++) {
+            acc[x] += intensity[x] * weight;
+        }
+#endif
+    }
+
+    // Clamps the three channel accumulators to 0..255 and packs them as opaque RGB32
+    void packRow(const float* red, const float* green, const float* blue, quint32* out, int width) {
+        int x = 0;
+#ifdef HIPS_REPROJECTOR_SSE2
+        const __m128 lo = _mm_setzero_ps();
+        const __m128 hi = _mm_set1_ps(255.0f);
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+        for (; x + 4 <= width; x += 4) {
+            __m128i r = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_load_ps(red + x), lo), hi));
+            __m128i g = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_load_ps(green + x), lo), hi));
+            __m128i b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_load_ps(blue + x), lo), hi));
+            __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)),
+                                          _mm_or_si128(b, alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), pixels);
+        }
+#endif
+        for (; x < width; x++) {
+            long r = std::clamp(std::lrint(red[x]), 0L, 255L);
+            long g = std::clamp(std::lrint(green[x]), 0L, 255L);
+            long b = std::clamp(std::lrint(blue[x]), 0L, 255L);
+            out[x] = 0xFF000000u | quint32(r << 16) | quint32(g << 8) | quint32(b);
+        }
+    }
+}
+
+TanProjection TanProjection::strip(int firstRow, int rows) const {
+    TanProjection part = *this;
+    part.window = QRect(0, firstRow, size.width(), rows).intersected(QRect(QPoint(0, 0), size));
+    return part;
+}
+
+void TanProjection::pixelDirection(double x, double y, double& vx, double& vy, double& vz) const {
+    TanBasis(*this).direction(x, y, vx, vy, vz);
+}
+
+bool HipsTileSet::insert(long long tileIndex, const QImage& image) {
+    if (image.isNull() || image.width() != tileWidth || image.height() != tileWidth) {
+        qDebug() << QString("HipsTileSet: rejecting tile %1 (%2x%3, expected %4x%4)")
+                    .arg(tileIndex).arg(image.width()).arg(image.height()).arg(tileWidth);
+        return false;
+    }
+    tiles.insert(tileIndex, PixelFormat::convert(image, PixelFormat::INTERNAL, "reprojection"));
+    return true;
+}
+
+HealpixFacePoint HipsReprojector::skyToFace(double vx, double vy, double vz) {
+    // The continuous form of HEALPix ang2pix (Gorski et al. 2005) at nside = 1
+    HealpixFacePoint point;
+    double z = vz;
+    double za = std::abs(z);
+    double tt = std::fmod(std::atan2(vy, vx) * (2.0 / M_PI), 4.0);
+    if (tt < 0.0) tt += 4.0;
+    if (tt >= 4.0) tt -= 4.0;
+
+    if (za <= 2.0 / 3.0) {
+        // Equatorial belt: faces bounded by ascending and descending edge lines
+        double temp1 = 0.5 + tt;
+        double temp2 = 0.75 * z;
+        double jp = temp1 - temp2;
+        double jm = temp1 + temp2;
+        int ifp = int(jp);
+        int ifm = int(jm);
+        point.face = (ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : ifm + 8);
+        point.x = jm - ifm;
+        point.y = 1.0 - (jp - ifp);
+    } else {
+        // Polar caps
+        int ntt = std::min(3, int(tt));
+        double tp = tt - ntt;
+        double tmp = std::sqrt(3.0 * (1.0 - za));
+        double jp = tp * tmp;
+        double jm = (1.0 - tp) * tmp;
+        if (z >= 0.0) {
+            point.face = ntt;
+            point.x = 1.0 - jm;
+            point.y = 1.0 - jp;
+        } else {
+            point.face = ntt + 8;
+            point.x = jp;
+            point.y = jm;
+        }
+    }
+
+    const double below1 = std::nextafter(1.0, 0.0);
+    point.x = std::clamp(point.x, 0.0, below1);
+    point.y = std::clamp(point.y, 0.0, below1);
+    return point;
+}
+
+HealpixFacePoint HipsReprojector::skyToFace(double raDeg, double decDeg) {
+    double ra = raDeg * DEG_TO_RAD;
+    double dec = decDeg * DEG_TO_RAD;
+    return skyToFace(std::cos(dec) * std::cos(ra), std::cos(dec) * std::sin(ra), std::sin(dec));
+}
+
+long long HipsReprojector::faceToNest(const HealpixFacePoint& point, int order, double* subX, double* subY) {
+    qint64 nside = qint64(1) << order;
+    double fx = point.x * nside;
+    double fy = point.y * nside;
+    qint64 ix = std::min(nside - 1, qint64(fx));
+    qint64 iy = std::min(nside - 1, qint64(fy));
+    if (subX) *subX = fx - ix;
+    if (subY) *subY = fy - iy;
+    return nestIndex(point.face, ix, iy, order);
+}
+
+int HipsReprojector::orderForScale(double pixelScaleDeg, int tileWidth, int maxOrder) {
+    for (int order = 0; order < maxOrder; order++) {
+        // Side of an equal-area HEALPix pixel: sqrt(4 pi / 12) / nside
+        double pixelDeg = std::sqrt(M_PI / 3.0) / (double(tileWidth) * double(qint64(1) << order)) / DEG_TO_RAD;
+        if (pixelDeg <= pixelScaleDeg) {
+            return order;
+        }
+    }
+    return maxOrder;
+}
+
+QList<long long> HipsReprojector::requiredTiles(const TanProjection& projection, int order, int tileWidth,
+                                                ResampleKernel kernel) {
+    const int step = 8;   // Output pixels between probes; far below a tile at sensible scales
+    const double reach = kernelRadius(kernel) + 1.0;
+    const qint64 faceSize = qint64(tileWidth) << order;
+    const int width = projection.outputSize().width();
+    const int height = projection.outputSize().height();
+    TanBasis basis(projection);
+    QSet<long long> found;
+
+    auto probe = [&](int x, int y) {
+        double vx, vy, vz;
+        basis.direction(x, y, vx, vy, vz);
+        HealpixFacePoint point = skyToFace(vx, vy, vz);
+        double px = point.x * faceSize - 0.5;
+        double py = point.y * faceSize - 0.5;
+        for (double ox : {-reach, reach}) {
+            for (double oy : {-reach, reach}) {
+                qint64 gx = std::clamp<qint64>(qint64(std::floor(px + ox)), 0, faceSize - 1);
+                qint64 gy = std::clamp<qint64>(qint64(std::floor(py + oy)), 0, faceSize - 1);
+                found.insert(nestIndex(point.face, gx / tileWidth, gy / tileWidth, order));
+            }
+        }
+    };
+
+    for (int y = 0; y < height + step - 1; y += step) {
+        for (int x = 0; x < width + step - 1; x += step) {
+            probe(std::min(x, width - 1), std::min(y, height - 1));
+        }
+    }
+
+    QList<long long> tiles(found.begin(), found.end());
+    std::sort(tiles.begin(), tiles.end());
+    return tiles;
+}
+
+QSharedPointer<const ReprojectionMap> HipsReprojector::buildMap(const TanProjection& projection, int order,
+                                                                 int tileWidth, bool multithreaded) {
+    QSharedPointer<ReprojectionMap> map(new ReprojectionMap(projection.outputSize(), order, tileWidth));
+    const int width = projection.outputSize().width();
+    const int height = projection.outputSize().height();
+    if (width <= 0 || height <= 0) {
+        return map;
+    }
+    if (tileWidth * FIXED_ONE > 32768) {
+        qDebug() << QString("HipsReprojector: %1px tiles exceed the 16-bit map range, positions will clamp")
+                    .arg(tileWidth);
+    }
+    map->m_samples.resize(qsizetype(width) * height);
+
+    const qint64 faceSize = qint64(tileWidth) << order;
+    const TanBasis basis(projection);
+
+    // Bands number their tiles locally; slots are made global once all bands are done
+    struct BandTiles {
+        QList<ReprojectionTile> tiles;
+        QHash<long long, quint32> slots;
+    };
+    QList<int> bands;
+    for (int y = 0; y < height; y += BAND_ROWS) {
+        bands.append(y);
+    }
+    QList<BandTiles> bandTiles(bands.size());
+
+    auto mapBand = [&](int firstRow) {
+        BandTiles& local = bandTiles[firstRow / BAND_ROWS];
+        int lastRow = std::min(height, firstRow + BAND_ROWS);
+        for (int y = firstRow; y < lastRow; y++) {
+            ReprojectionSample* out = map->m_samples.data() + qsizetype(y) * width;
+            for (int x = 0; x < width; x++) {
+                double vx, vy, vz;
+                basis.direction(x, y, vx, vy, vz);
+                HealpixFacePoint point = skyToFace(vx, vy, vz);
+
+                // Face pixel coordinates with pixel centres on integers
+                double px = point.x * faceSize - 0.5;
+                double py = point.y * faceSize - 0.5;
+                qint64 tx = std::clamp<qint64>(qint64(std::floor(px + 0.5)), 0, faceSize - 1) / tileWidth;
+                qint64 ty = std::clamp<qint64>(qint64(std::floor(py + 0.5)), 0, faceSize - 1) / tileWidth;
+
+                long long nest = nestIndex(point.face, tx, ty, order);
+                auto it = local.slots.constFind(nest);
+                if (it == local.slots.constEnd()) {
+                    it = local.slots.insert(nest, quint32(local.tiles.size()));
+                    local.tiles.append({point.face, tx, ty, nest});
+                }
+
+                out[x].slot = *it;
+                out[x].u = qint16(std::clamp(std::lround((px - double(tx * tileWidth)) * FIXED_ONE), -32768L, 32767L));
+                out[x].v = qint16(std::clamp(std::lround((py - double(ty * tileWidth)) * FIXED_ONE), -32768L, 32767L));
+            }
+        }
+    };
+
+    if (multithreaded && bands.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, mapBand);
+    } else {
+        for (int firstRow : bands) {
+            mapBand(firstRow);
+        }
+    }
+
+    QHash<long long, quint32> globalSlots;
+    for (int b = 0; b < bands.size(); b++) {
+        QList<quint32> remap;
+        for (const ReprojectionTile& tile : bandTiles[b].tiles) {
+            auto it = globalSlots.constFind(tile.nest);
+            if (it == globalSlots.constEnd()) {
+                it = globalSlots.insert(tile.nest, quint32(map->m_tiles.size()));
+                map->m_tiles.append(tile);
+            }
+            remap.append(*it);
+        }
+        int lastRow = std::min(height, bands[b] + BAND_ROWS);
+        ReprojectionSample* first = map->m_samples.data() + qsizetype(bands[b]) * width;
+        ReprojectionSample* last = map->m_samples.data() + qsizetype(lastRow) * width;
+        for (ReprojectionSample* sample = first; sample != last; ++sample) {
+            sample->slot = remap[sample->slot];
+        }
+    }
+
+    return map;
+}
+
+QImage HipsReprojector::render(const ReprojectionMap& map, const HipsTileSet& tiles,
+                               ResampleKernel kernel, bool multithreaded) {
+    if (map.order() != tiles.order || map.tileWidth() != tiles.tileWidth) {
+        qDebug() << QString("HipsReprojector: map is for order %1/%2px tiles, tile set is order %3/%4px")
+                    .arg(map.order()).arg(map.tileWidth()).arg(tiles.order).arg(tiles.tileWidth);
+        return QImage();
+    }
+
+    const int width = map.size().width();
+    const int height = map.size().height();
+    QImage output = MosaicCompositor::createAlignedImage(width, height);
+    if (output.isNull()) {
+        return output;
+    }
+
+    // Rows are written through a raw pointer so the worker threads never touch the QImage
+    uchar* bits = output.bits();
+    const qsizetype stride = output.bytesPerLine();
+    const QList<ReprojectionTile>& mapTiles = map.tiles();
+    const qint64 tileFixed = qint64(tiles.tileWidth) * FIXED_ONE;
+
+    auto renderBand = [&](int firstRow) {
+        FaceSampler sampler(tiles);
+        int lastRow = std::min(height, firstRow + BAND_ROWS);
+        for (int y = firstRow; y < lastRow; y++) {
+            const ReprojectionSample* in = map.row(y);
+            quint32* line = reinterpret_cast<quint32*>(bits + y * stride);
+            for (int x = 0; x < width; x++) {
+                const ReprojectionTile& tile = mapTiles[in[x].slot];
+                line[x] = sample(sampler, tile.face, tile.tx * tileFixed + in[x].u, tile.ty * tileFixed + in[x].v, kernel);
+            }
+        }
+    };
+
+    QList<int> bands;
+    for (int y = 0; y < height; y += BAND_ROWS) {
+        bands.append(y);
+    }
+
+    if (multithreaded && bands.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, renderBand);
+    } else {
+        for (int firstRow : bands) {
+            renderBand(firstRow);
+        }
+    }
+
+    return output;
+}
+
+QImage HipsReprojector::render(const TanProjection& projection, const HipsTileSet& tiles,
+                               ResampleKernel kernel, bool multithreaded) {
+    QSharedPointer<const ReprojectionMap> map =
+        ReprojectionMapCache::instance()->map(projection, tiles.order, tiles.tileWidth);
+    return render(*map, tiles, kernel, multithreaded);
+}
+
+QImage HipsReprojector::renderChannels(const ReprojectionMap& map, const QList<ChannelBand>& bands,
+                                       ResampleKernel kernel, bool multithreaded) {
+    for (const ChannelBand& band : bands) {
+        if (map.order() != band.tiles.order || map.tileWidth() != band.tiles.tileWidth) {
+            qDebug() << QString("HipsReprojector: map is for order %1/%2px tiles, a band is order %3/%4px")
+                        .arg(map.order()).arg(map.tileWidth()).arg(band.tiles.order).arg(band.tiles.tileWidth);
+            return QImage();
+        }
+    }
+
+    const int width = map.size().width();
+    const int height = map.size().height();
+    QImage output = MosaicCompositor::createAlignedImage(width, height);
+    if (output.isNull()) {
+        return output;
+    }
+    output.fill(0xFF000000u);
+    if (bands.isEmpty()) {
+        return output;
+    }
+
+    // Stretch curves, applied by table lookup as each sample is taken
+    std::vector<std::array<float, 256>> stretch(bands.size());
+    for (int b = 0; b < bands.size(); b++) {
+        const ChannelBand& band = bands[b];
+        double range = std::max(1e-6, band.white - band.black);
+        double exponent = 1.0 / std::max(1e-3, band.gamma);
+        for (int level = 0; level < 256; level++) {
+            double t = std::clamp((level - band.black) / range, 0.0, 1.0);
+            stretch[b][level] = float(255.0 * std::pow(t, exponent));
+        }
+    }
+
+    uchar* bits = output.bits();
+    const qsizetype stride = output.bytesPerLine();
+    const QList<ReprojectionTile>& mapTiles = map.tiles();
+    const qint64 tileFixed = qint64(map.tileWidth()) * FIXED_ONE;
+    const int padded = (width + 3) & ~3;
+
+    auto renderBand = [&](int firstRow) {
+        std::vector<FaceSampler> samplers;
+        samplers.reserve(bands.size());
+        for (const ChannelBand& band : bands) {
+            samplers.emplace_back(band.tiles);
+        }
+
+        // Intensity row and three channel accumulators, 16-byte aligned
+        std::vector<float> storage(size_t(padded) * 4 + 4, 0.0f);
+        float* intensity = reinterpret_cast<float*>((quintptr(storage.data()) + 15) & ~quintptr(15));
+        float* accRed = intensity + padded;
+        float* accGreen = accRed + padded;
+        float* accBlue = accGreen + padded;
+
+        int lastRow = std::min(height, firstRow + BAND_ROWS);
+        for (int y = firstRow; y < lastRow; y++) {
+            const ReprojectionSample* in = map.row(y);
+            std::fill(accRed, accRed + padded * 3, 0.0f);
+
+            for (int b = 0; b < bands.size(); b++) {
+                const ChannelBand& band = bands[b];
+                const float* curve = stretch[b].data();
+                for (int x = 0; x < width; x++) {
+                    const ReprojectionTile& tile = mapTiles[in[x].slot];
+                    quint32 pixel = sample(samplers[b], tile.face, tile.tx * tileFixed + in[x].u,
+                                           tile.ty * tileFixed + in[x].v, kernel);
+                    intensity[x] = curve[bandLevel(pixel, band.source)];
+                }
+                if (band.red != 0.0) accumulateRow(accRed, intensity, float(band.red), width);
+                if (band.green != 0.0) accumulateRow(accGreen, intensity, float(band.green), width);
+                if (band.blue != 0.0) accumulateRow(accBlue, intensity, float(band.blue), width);
+            }
+
+            packRow(accRed, accGreen, accBlue, reinterpret_cast<quint32*>(bits + y * stride), width);
+        }
+    };
+
+    QList<int> rowBands;
+    for (int y = 0; y < height; y += BAND_ROWS) {
+        rowBands.append(y);
+    }
+
+    if (multithreaded && rowBands.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), rowBands, renderBand);
+    } else {
+        for (int firstRow : rowBands) {
+            renderBand(firstRow);
+        }
+    }
+
+    return output;
+}
+
+QImage HipsReprojector::renderChannels(const TanProjection& projection, const QList<ChannelBand>& bands,
+                                       ResampleKernel kernel, bool multithreaded) {
+    if (bands.isEmpty()) {
+        return QImage();
+    }
+    const HipsTileSet& first = bands.first().tiles;
+    QSharedPointer<const ReprojectionMap> map =
+        ReprojectionMapCache::instance()->map(projection, first.order, first.tileWidth);
+    return renderChannels(*map, bands, kernel, multithreaded);
+}
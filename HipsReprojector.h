@@ -0,0 +1,116 @@
+// HipsReprojector.h - Resamples HiPS tiles into a gnomonic (TAN) view of the sky
+#ifndef HIPSREPROJECTOR_H
+#define HIPSREPROJECTOR_H
+
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QSharedPointer>
+#include <QSize>
+
+class ReprojectionMap;
+
+enum class ResampleKernel {
+    Nearest,
+    Bilinear,
+    Lanczos3
+};
+
+// Output geometry: tangent point, pixel scale and orientation. Row 0 is the top of the
+// image; with rotationDeg = 0 north is up and east is left, as on the sky.
+struct TanProjection {
+    double centerRaDeg = 0.0;
+    double centerDecDeg = 0.0;
+    double pixelScaleDeg = 1.0 / 3600.0;
+    QSize size = QSize(1024, 1024);
+    double rotationDeg = 0.0;     // Position angle of image "up", measured from north through east
+    QRect window;                 // Part of the frame to render; empty renders the whole frame
+
+    QSize outputSize() const { return window.isEmpty() ? size : window.size(); }
+
+    // Same frame, restricted to rows [firstRow, firstRow + rows) - for rendering in strips
+    TanProjection strip(int firstRow, int rows) const;
+
+    // Unit vector (ICRS cartesian) through the centre of output pixel (x, y)
+    void pixelDirection(double x, double y, double& vx, double& vy, double& vz) const;
+};
+
+// Continuous position on one of the 12 HEALPix base faces; x runs along the face's
+// south->east edge and y along south->west, both in [0, 1)
+struct HealpixFacePoint {
+    int face = 0;
+    double x = 0.0;
+    double y = 0.0;
+};
+
+// Decoded tiles of one survey at one order, keyed by NEST tile index
+struct HipsTileSet {
+    int order = 8;
+    int tileWidth = 512;
+    QHash<long long, QImage> tiles;
+
+    // Stores the tile as Format_RGB32; tiles of the wrong size are rejected
+    bool insert(long long tileIndex, const QImage& image);
+};
+
+// Which part of a survey's tile pixels feeds a channel band
+enum class BandSource {
+    Luminance,
+    Red,
+    Green,
+    Blue
+};
+
+// One survey's share of a false-colour composite: its pixels are stretched to an
+// intensity, which is added to each output channel with that channel's weight
+struct ChannelBand {
+    HipsTileSet tiles;
+    BandSource source = BandSource::Luminance;
+    double black = 0.0;         // Input level shown as black
+    double white = 255.0;       // Input level shown at full intensity
+    double gamma = 1.0;         // Above 1 lifts faint structure
+    double red = 0.0;           // Weights into the output channels
+    double green = 0.0;
+    double blue = 0.0;
+};
+
+// Each output pixel is projected back onto the sphere, located on its HEALPix face and
+// sampled from the tile pixels around that position, so tile seams are resampled like any
+// other pixel boundary. Rows are split into bands that run on the render pool.
+class HipsReprojector {
+public:
+    // Looks the geometry up in ReprojectionMapCache, so repeated frames and further
+    // surveys of the same field skip straight to sampling
+    static QImage render(const TanProjection& projection, const HipsTileSet& tiles,
+                         ResampleKernel kernel = ResampleKernel::Bilinear, bool multithreaded = true);
+    static QImage render(const ReprojectionMap& map, const HipsTileSet& tiles,
+                         ResampleKernel kernel = ResampleKernel::Bilinear, bool multithreaded = true);
+
+    // False colour from several surveys sharing one map. Every band is sampled, stretched
+    // and accumulated row by row in aligned float buffers, so no per-band image is built.
+    static QImage renderChannels(const TanProjection& projection, const QList<ChannelBand>& bands,
+                                 ResampleKernel kernel = ResampleKernel::Bilinear, bool multithreaded = true);
+    static QImage renderChannels(const ReprojectionMap& map, const QList<ChannelBand>& bands,
+                                 ResampleKernel kernel = ResampleKernel::Bilinear, bool multithreaded = true);
+
+    // The spherical pass on its own: every output pixel's tile and position within it
+    static QSharedPointer<const ReprojectionMap> buildMap(const TanProjection& projection, int order,
+                                                          int tileWidth, bool multithreaded = true);
+
+    // Tiles (NEST indices at `order`) the render will touch, including kernel support
+    static QList<long long> requiredTiles(const TanProjection& projection, int order, int tileWidth,
+                                          ResampleKernel kernel = ResampleKernel::Bilinear);
+
+    // Lowest order whose tile pixels are at least as fine as the output pixels
+    static int orderForScale(double pixelScaleDeg, int tileWidth = 512, int maxOrder = 11);
+
+    static HealpixFacePoint skyToFace(double vx, double vy, double vz);
+    static HealpixFacePoint skyToFace(double raDeg, double decDeg);
+
+    // NEST index at `order` containing the point; sub-pixel offsets inside it in [0, 1)
+    static long long faceToNest(const HealpixFacePoint& point, int order,
+                                double* subX = nullptr, double* subY = nullptr);
+};
+
+#endif // HIPSREPROJECTOR_H
@@ -0,0 +1,289 @@
+// ImageFilters.cpp - Separable running-sum blurs on RGB32 scanlines
+#include "ImageFilters.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#include <emmintrin.h>
+#define IMAGE_FILTERS_SSE2 1
+#endif
+
+namespace {
+    const int BAND_ROWS = 64;
+    const int COLUMN_BLOCK = 128;
+
+    // Keeps the float mean's error well inside the 0.5 / count margin packMean relies on
+    const int MAX_RADIUS = 1024;
+
+    // 1 / count for every window size the pass can see
+    std::vector<float> reciprocals(int radius) {
+        std::vector<float> table(2 * radius + 2, 0.0f);
+        for (size_t count = 1; count < table.size(); count++) {
+            table[count] = 1.0f / float(count);
+        }
+        return table;
+    }
+
+    // Number of pixels of [i - radius, i + radius] inside [0, length)
+    inline int windowCount(int i, int radius, int length) {
+        return std::min(i + radius, length - 1) - std::max(i - radius, 0) + 1;
+    }
+
+    // Callers take the target's bits() before mapping; the non-const scanLine() may detach mid-pass
+    void forEachBlock(int count, int blockSize, bool multithreaded, const std::function<void(int)>& fn) {
+        QList<int> blocks;
+        for (int start = 0; start < count; start += blockSize) {
+            blocks.append(start);
+        }
+        if (multithreaded && blocks.size() > 1) {
+            QtConcurrent::blockingMap(MosaicRenderer::pool(), blocks, fn);
+        } else {
+            for (int start : blocks) {
+                fn(start);
+            }
+        }
+    }
+
+#ifdef IMAGE_FILTERS_SSE2
+    // B, G, R, A of one pixel in four 32-bit lanes
+    inline __m128i unpackPixel(quint32 pixel) {
+        const __m128i zero = _mm_setzero_si128();
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(pixel)), zero), zero);
+    }
+
+    // Truncating mean: (sum + 0.5) / count keeps exact multiples clear of the float error;
+    // rounding mean: sum / count + 0.5
+    inline quint32 packMean(__m128i sum, float reciprocal, bool round) {
+        __m128 value = _mm_cvtepi32_ps(sum);
+        value = round ? _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(reciprocal)), _mm_set1_ps(0.5f))
+                      : _mm_mul_ps(_mm_add_ps(value, _mm_set1_ps(0.5f)), _mm_set1_ps(reciprocal));
+        __m128i mean = _mm_cvttps_epi32(value);
+        mean = _mm_packs_epi32(mean, mean);
+        mean = _mm_packus_epi16(mean, mean);
+        return quint32(_mm_cvtsi128_si32(mean)) | 0xFF000000u;
+    }
+#endif
+
+    inline quint32 packMeanScalar(const int sum[3], int count, bool round) {
+        quint32 out = 0xFF000000u;
+        for (int c = 0; c < 3; c++) {
+            out |= quint32((round ? sum[c] + count / 2 : sum[c]) / count) << (8 * c);
+        }
+        return out;
+    }
+}
+
+void ImageFilters::horizontalPass(const QImage& source, QImage& target, int radius, bool round, bool multithreaded) {
+    const int width = source.width();
+    const int height = source.height();
+    const std::vector<float> inverse = reciprocals(radius);
+    uchar* targetBits = target.bits();
+    const qsizetype targetStride = target.bytesPerLine();
+
+    forEachBlock(height, BAND_ROWS, multithreaded, [&](int firstRow) {
+        const int lastRow = std::min(height, firstRow + BAND_ROWS);
+        for (int y = firstRow; y < lastRow; y++) {
+            const quint32* in = reinterpret_cast<const quint32*>(source.constScanLine(y));
+            quint32* out = reinterpret_cast<quint32*>(targetBits + y * targetStride);
+
+#ifdef IMAGE_FILTERS_SSE2
+            __m128i sum = _mm_setzero_si128();
+            for (int x = 0; x < std::min(radius, width); x++) {
+                sum = _mm_add_epi32(sum, unpackPixel(in[x]));
+            }
+            for (int x = 0; x < width; x++) {
+                if (x + radius < width) {
+                    sum = _mm_add_epi32(sum, unpackPixel(in[x + radius]));
+                }
+                out[x] = packMean(sum, inverse[windowCount(x, radius, width)], round);
+                if (x - radius >= 0) {
+                    sum = _mm_sub_epi32(sum, unpackPixel(in[x - radius]));
+                }
+            }
+#else
+            int sum[3] = {0, 0, 0};
+            auto add = [&sum](quint32 pixel, int sign) {
+                for (int c = 0; c < 3; c++) sum[c] += sign * int((pixel >> (8 * c)) & 0xFF);
+            };
+            for (int x = 0; x < std::min(radius, width); x++) {
+                add(in[x], 1);
+            }
+            for (int x = 0; x < width; x++) {
+                if (x + radius < width) add(in[x + radius], 1);
+                out[x] = packMeanScalar(sum, windowCount(x, radius, width), round);
+                if (x - radius >= 0) add(in[x - radius], -1);
+            }
+#endif
+        }
+    });
+}
+
+void ImageFilters::verticalPass(const QImage& source, QImage& target, int radius, bool round, bool multithreaded) {
+    const int width = source.width();
+    const int height = source.height();
+    const std::vector<float> inverse = reciprocals(radius);
+    uchar* targetBits = target.bits();
+    const qsizetype targetStride = target.bytesPerLine();
+
+    // Each block walks down its columns once, reading and writing whole row segments
+    forEachBlock(width, COLUMN_BLOCK, multithreaded, [&](int firstColumn) {
+        const int columns = std::min(width - firstColumn, COLUMN_BLOCK);
+        auto row = [&](int y) {
+            return reinterpret_cast<const quint32*>(source.constScanLine(y)) + firstColumn;
+        };
+
+#ifdef IMAGE_FILTERS_SSE2
+        std::vector<__m128i> sums(columns, _mm_setzero_si128());
+        auto accumulate = [&](const quint32* in, bool add) {
+            for (int x = 0; x < columns; x++) {
+                __m128i pixel = unpackPixel(in[x]);
+                sums[x] = add ? _mm_add_epi32(sums[x], pixel) : _mm_sub_epi32(sums[x], pixel);
+            }
+        };
+#else
+        std::vector<int> sums(size_t(columns) * 3, 0);
+        auto accumulate = [&](const quint32* in, bool add) {
+            const int sign = add ? 1 : -1;
+            for (int x = 0; x < columns; x++) {
+                for (int c = 0; c < 3; c++) sums[x * 3 + c] += sign * int((in[x] >> (8 * c)) & 0xFF);
+            }
+        };
+#endif
+
+        for (int y = 0; y < std::min(radius, height); y++) {
+            accumulate(row(y), true);
+        }
+        for (int y = 0; y < height; y++) {
+            if (y + radius < height) {
+                accumulate(row(y + radius), true);
+            }
+
+            const int count = windowCount(y, radius, height);
+            quint32* out = reinterpret_cast<quint32*>(targetBits + y * targetStride) + firstColumn;
+            for (int x = 0; x < columns; x++) {
+#ifdef IMAGE_FILTERS_SSE2
+                out[x] = packMean(sums[x], inverse[count], round);
+#else
+                out[x] = packMeanScalar(&sums[x * 3], count, round);
+#endif
+            }
+
+            if (y - radius >= 0) {
+                accumulate(row(y - radius), false);
+            }
+        }
+    });
+}
+
+QImage ImageFilters::boxBlur(const QImage& image, int radius, bool multithreaded) {
+    if (image.isNull() || radius <= 0) {
+        return image;
+    }
+    radius = std::min(radius, MAX_RADIUS);
+
+    // ARGB32 shares the RGB32 layout; the alpha lane is ignored
+    QImage source = PixelFormat::toInternal(image, "box blur");
+
+    QImage horizontal(source.size(), QImage::Format_RGB32);
+    QImage result(source.size(), QImage::Format_RGB32);
+    horizontalPass(source, horizontal, radius, false, multithreaded);
+    verticalPass(horizontal, result, radius, false, multithreaded);
+    return result;
+}
+
+QImage ImageFilters::boxDownsample(const QImage& image, int factor, const QRect& region, bool multithreaded) {
+    QRect area = region.isEmpty() ? image.rect() : region.intersected(image.rect());
+    if (image.isNull() || area.isEmpty()) {
+        return QImage();
+    }
+    factor = std::clamp(factor, 1, 16);
+
+    QImage source = PixelFormat::toInternal(image, "box downsample");
+    const int outWidth = (area.width() + factor - 1) / factor;
+    const int outHeight = (area.height() + factor - 1) / factor;
+    QImage result(outWidth, outHeight, QImage::Format_RGB32);
+    uchar* resultBits = result.bits();
+    const qsizetype resultStride = result.bytesPerLine();
+
+    forEachBlock(outHeight, BAND_ROWS, multithreaded, [&](int firstRow) {
+        // Blue and red share one word, green and alpha another, each in a 16-bit half
+        std::vector<quint32> blueRed(outWidth);
+        std::vector<quint32> greenAlpha(outWidth);
+        const int lastRow = std::min(outHeight, firstRow + BAND_ROWS);
+
+        for (int oy = firstRow; oy < lastRow; oy++) {
+            std::fill(blueRed.begin(), blueRed.end(), 0u);
+            std::fill(greenAlpha.begin(), greenAlpha.end(), 0u);
+            const int rows = std::min(factor, area.height() - oy * factor);
+
+            for (int r = 0; r < rows; r++) {
+                const quint32* in = reinterpret_cast<const quint32*>(source.constScanLine(area.y() + oy * factor + r)) + area.x();
+                for (int ox = 0; ox < outWidth; ox++) {
+                    const int columns = std::min(factor, area.width() - ox * factor);
+                    quint32 br = 0, ga = 0;
+                    for (int c = 0; c < columns; c++) {
+                        quint32 pixel = in[ox * factor + c];
+                        br += pixel & 0x00FF00FF;
+                        ga += (pixel >> 8) & 0x00FF00FF;
+                    }
+                    blueRed[ox] += br;
+                    greenAlpha[ox] += ga;
+                }
+            }
+
+            quint32* out = reinterpret_cast<quint32*>(resultBits + oy * resultStride);
+            for (int ox = 0; ox < outWidth; ox++) {
+                const quint32 count = quint32(rows * std::min(factor, area.width() - ox * factor));
+                quint32 blue = ((blueRed[ox] & 0xFFFF) + count / 2) / count;
+                quint32 red = ((blueRed[ox] >> 16) + count / 2) / count;
+                quint32 green = ((greenAlpha[ox] & 0xFFFF) + count / 2) / count;
+                out[ox] = 0xFF000000u | (red << 16) | (green << 8) | blue;
+            }
+        }
+    });
+    return result;
+}
+
+QList<int> ImageFilters::gaussianBoxRadii(double sigma, int passes) {
+    // Widths wl and wl + 2 (both odd), m passes of the smaller, so the summed variance
+    // (w^2 - 1) / 12 per pass matches sigma^2
+    double idealWidth = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+    int lower = int(std::floor(idealWidth));
+    if (lower % 2 == 0) lower--;
+    lower = std::max(1, lower);
+    int upper = lower + 2;
+
+    double idealLowerPasses = (12.0 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes)
+                            / (-4.0 * lower - 4.0);
+    int lowerPasses = int(std::lround(idealLowerPasses));
+
+    QList<int> radii;
+    for (int i = 0; i < passes; i++) {
+        radii.append(((i < lowerPasses ? lower : upper) - 1) / 2);
+    }
+    return radii;
+}
+
+QImage ImageFilters::gaussianBlur(const QImage& image, double sigma, bool multithreaded) {
+    if (image.isNull() || sigma <= 0.0) {
+        return image;
+    }
+
+    QImage current = PixelFormat::toInternal(image, "gaussian blur");
+    QImage scratch(current.size(), QImage::Format_RGB32);
+
+    for (int radius : gaussianBoxRadii(sigma)) {
+        radius = std::min(radius, MAX_RADIUS);
+        if (radius <= 0) continue;
+        QImage next(current.size(), QImage::Format_RGB32);
+        horizontalPass(current, scratch, radius, true, multithreaded);
+        verticalPass(scratch, next, radius, true, multithreaded);
+        current = next;
+    }
+    return PixelFormat::convert(current, PixelFormat::INTERNAL, "gaussian blur");
+}
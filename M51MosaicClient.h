@@ -3,6 +3,7 @@
 #define M51MOSAICCLIENT_H
 
 #include "ProperHipsClient.h"
+#include "PixelFormat.h"
 #include <QPixmap>
 #include <QImage>
 #include <QPainter>
@@ -310,7 +311,7 @@ void M51MosaicClient::assembleMosaic() {
     painter.end();
     
     // Update preview
-    QPixmap preview = QPixmap::fromImage(m_finalMosaic.scaled(400, 300, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    QPixmap preview = PixelFormat::toPixmap(m_finalMosaic.scaled(400, 300, Qt::KeepAspectRatio, Qt::SmoothTransformation), "preview");
     m_previewLabel->setPixmap(preview);
     
     m_statusLabel->setText(QString("Mosaic complete! %1x%2 pixels covering M51").arg(m_config.outputWidth).arg(m_config.outputHeight));
@@ -0,0 +1,59 @@
+// MipPyramid.cpp - Halving levels of a finished mosaic for instant preview scaling and crops
+#include "MipPyramid.h"
+#include "ImageFilters.h"
+#include <QRectF>
+#include <algorithm>
+
+MipPyramid::MipPyramid(const QImage& image, int minSize, bool multithreaded) {
+    if (image.isNull()) {
+        return;
+    }
+    m_levels.append(image);
+
+    minSize = std::max(1, minSize);
+    while (std::max(m_levels.last().width(), m_levels.last().height()) > minSize) {
+        m_levels.append(ImageFilters::boxDownsample(m_levels.last(), 2, QRect(), multithreaded));
+    }
+}
+
+int MipPyramid::levelFor(const QSize& target, const QRect& crop) const {
+    if (isNull()) {
+        return -1;
+    }
+    const QRect area = crop.isEmpty() ? m_levels.first().rect() : crop.intersected(m_levels.first().rect());
+
+    int best = 0;
+    for (int index = 1; index < m_levels.size(); index++) {
+        double scale = double(m_levels[index].width()) / m_levels.first().width();
+        if (area.width() * scale < target.width() || area.height() * scale < target.height()) {
+            break;
+        }
+        best = index;
+    }
+    return best;
+}
+
+QImage MipPyramid::scaled(const QSize& bounds, Qt::AspectRatioMode mode, const QRect& crop) const {
+    if (isNull() || bounds.isEmpty()) {
+        return QImage();
+    }
+    const QImage& full = m_levels.first();
+    const QRect area = crop.isEmpty() ? full.rect() : crop.intersected(full.rect());
+    if (area.isEmpty()) {
+        return QImage();
+    }
+
+    QSize target = area.size().scaled(bounds, mode);
+    const QImage& source = m_levels[levelFor(target, area)];
+    double sx = double(source.width()) / full.width();
+    double sy = double(source.height()) / full.height();
+    QRect sourceArea = QRectF(area.x() * sx, area.y() * sy, area.width() * sx, area.height() * sy)
+                           .toAlignedRect().intersected(source.rect());
+
+    // Only the crop of the chosen level is copied
+    QImage region = sourceArea == source.rect() ? source : source.copy(sourceArea);
+    if (region.size() == target) {
+        return region;
+    }
+    return region.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
@@ -0,0 +1,37 @@
+// MipPyramid.h - Halving levels of a finished mosaic for instant preview scaling and crops
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QSize>
+
+// Level 0 is the image itself (shared, not copied); each further level is a 2x2 box
+// average of the one before, sizes rounded up, down to minSize on the longer side.
+// Building costs about a third of one pass over the image, split across the render pool.
+// scaled() reads from the smallest level still at least as large as the requested
+// output, so every preview, crop or resize smooth-scales by less than 2x and never
+// touches the full-resolution buffer unless the output is that large.
+class MipPyramid {
+public:
+    MipPyramid() = default;
+    explicit MipPyramid(const QImage& image, int minSize = 64, bool multithreaded = true);
+
+    bool isNull() const { return m_levels.isEmpty(); }
+    QSize size() const { return isNull() ? QSize() : m_levels.first().size(); }
+    int levelCount() const { return m_levels.size(); }
+    QImage level(int index) const { return m_levels.value(index); }
+
+    // Smallest level whose copy of crop (level-0 coordinates) still covers target
+    int levelFor(const QSize& target, const QRect& crop = QRect()) const;
+
+    // crop (level-0 coordinates, whole image when empty) fitted into bounds
+    QImage scaled(const QSize& bounds, Qt::AspectRatioMode mode = Qt::KeepAspectRatio,
+                  const QRect& crop = QRect()) const;
+
+private:
+    QList<QImage> m_levels;
+};
+
+#endif // MIPPYRAMID_H
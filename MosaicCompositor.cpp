@@ -0,0 +1,370 @@
+// MosaicCompositor.cpp - Scanline blitter assembling tiles into an aligned RGB32 canvas
+#include "MosaicCompositor.h"
+#include "PixelFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__SSSE3__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#include <tmmintrin.h>
+#define MOSAIC_COMPOSITOR_SSSE3 1
+#endif
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#include <emmintrin.h>
+#define MOSAIC_COMPOSITOR_SSE2 1
+#endif
+
+namespace {
+    void freeAlignedBuffer(void* buffer) {
+        ::operator delete(buffer, std::align_val_t(MosaicCompositor::CANVAS_ALIGNMENT));
+    }
+
+    int histogramMedian(const int* histogram, int count) {
+        int seen = 0;
+        for (int level = 0; level < 256; level++) {
+            seen += histogram[level];
+            if (2 * seen >= count) return level;
+        }
+        return 255;
+    }
+
+    // Share of an edge's brightness correction left d pixels in from that edge
+    float seamRamp(int d, int seamWidth) {
+        return d < seamWidth ? float(seamWidth - d) / seamWidth : 0.0f;
+    }
+
+    // Cross-fade weight (0..128) d pixels in from the nearest edge
+    qint16 seamAlpha(int d, int seamWidth) {
+        return qint16(std::min(128, (d + 1) * 128 / (seamWidth + 1)));
+    }
+
+#ifdef MOSAIC_COMPOSITOR_SSE2
+    // Two pixels in 16-bit lanes: offset, clamp, then cross-fade from the canvas where covered
+    inline __m128i featherPixels(__m128i tile, __m128i canvas, __m128i offset, __m128i alpha, __m128i covered) {
+        const __m128i full = _mm_set1_epi16(128);
+        __m128i shifted = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(tile, offset), _mm_setzero_si128()),
+                                        _mm_set1_epi16(255));
+        __m128i weight = _mm_or_si128(_mm_and_si128(covered, alpha), _mm_andnot_si128(covered, full));
+        return _mm_add_epi16(canvas, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(shifted, canvas), weight), 7));
+    }
+#endif
+}
+
+QImage MosaicCompositor::createAlignedImage(int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return QImage();
+    }
+
+    qsizetype bytesPerLine = (qsizetype(width) * 4 + CANVAS_ALIGNMENT - 1) & ~qsizetype(CANVAS_ALIGNMENT - 1);
+    void* buffer = ::operator new(bytesPerLine * height, std::align_val_t(CANVAS_ALIGNMENT));
+
+    return QImage(static_cast<uchar*>(buffer), width, height, bytesPerLine,
+                  PixelFormat::INTERNAL, freeAlignedBuffer, buffer);
+}
+
+MosaicCompositor::MosaicCompositor(int width, int height)
+    : m_canvas(createAlignedImage(width, height))
+    , m_seamWidth(0) {
+}
+
+void MosaicCompositor::setSeamWidth(int pixels) {
+    m_seamWidth = std::max(0, pixels);
+    if (m_seamWidth > 0 && m_coverage.isEmpty() && !m_canvas.isNull()) {
+        m_coverage = QByteArray(qsizetype(m_canvas.width()) * m_canvas.height(), '\0');
+    }
+}
+
+void MosaicCompositor::clear(QRgb color) {
+    if (m_canvas.isNull()) return;
+
+    quint32 value = 0xFF000000u | color;
+    uchar* bits = m_canvas.bits();
+    for (int y = 0; y < m_canvas.height(); y++) {
+        quint32* row = reinterpret_cast<quint32*>(bits + y * m_canvas.bytesPerLine());
+        std::fill(row, row + m_canvas.width(), value);
+    }
+    m_coverage.fill('\0');
+}
+
+void MosaicCompositor::copyRowRGB32(quint32* dst, const uchar* src, int count) {
+    std::memcpy(dst, src, size_t(count) * 4);
+}
+
+void MosaicCompositor::copyRowPremultiplied(quint32* dst, const uchar* src, int count) {
+    // Source-over onto an opaque black canvas leaves the premultiplied colour as is
+    const quint32* in = reinterpret_cast<const quint32*>(src);
+    for (int i = 0; i < count; i++) {
+        dst[i] = in[i] | 0xFF000000u;
+    }
+}
+
+void MosaicCompositor::copyRowARGB32(quint32* dst, const uchar* src, int count) {
+    const quint32* in = reinterpret_cast<const quint32*>(src);
+    for (int i = 0; i < count; i++) {
+        dst[i] = qPremultiply(in[i]) | 0xFF000000u;
+    }
+}
+
+void MosaicCompositor::copyRowRGB888(quint32* dst, const uchar* src, int count) {
+    int i = 0;
+
+#ifdef MOSAIC_COMPOSITOR_SSSE3
+    // Four pixels per step: 12 source bytes shuffled into B,G,R,_ order, alpha OR'd in.
+    // The 16-byte load reads 4 bytes past the 12 used, so stop 6 pixels short of the end.
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+    for (; i + 6 <= count; i += 4) {
+        __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        __m128i bgra = _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bgra);
+    }
+#endif
+
+    for (; i < count; i++) {
+        const uchar* p = src + i * 3;
+        dst[i] = qRgb(p[0], p[1], p[2]);
+    }
+}
+
+void MosaicCompositor::copyRowGray8(quint32* dst, const uchar* src, int count) {
+    int i = 0;
+
+#ifdef MOSAIC_COMPOSITOR_SSE2
+    // Sixteen pixels per step: g -> (g, g, g, 0xFF) by two rounds of byte/word interleaving
+    const __m128i opaque = _mm_set1_epi8(char(0xFF));
+    for (; i + 16 <= count; i += 16) {
+        __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i gg_lo = _mm_unpacklo_epi8(g, g);
+        __m128i gg_hi = _mm_unpackhi_epi8(g, g);
+        __m128i ga_lo = _mm_unpacklo_epi8(g, opaque);
+        __m128i ga_hi = _mm_unpackhi_epi8(g, opaque);
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(gg_lo, ga_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(gg_lo, ga_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(gg_hi, ga_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(gg_hi, ga_hi));
+    }
+#endif
+
+    for (; i < count; i++) {
+        dst[i] = qRgb(src[i], src[i], src[i]);
+    }
+}
+
+QRect MosaicCompositor::blit(const QImage& tile, int x, int y) {
+    return blit(tile, tile.rect(), x, y);
+}
+
+QRect MosaicCompositor::blit(const QImage& tile, const QRect& sourceRect, int x, int y) {
+    if (tile.isNull() || m_canvas.isNull()) {
+        return QRect();
+    }
+
+    // Clip the source to the tile, then the destination to the canvas, keeping them in step
+    QRect source = sourceRect.intersected(tile.rect());
+    QRect target(x + (source.x() - sourceRect.x()), y + (source.y() - sourceRect.y()),
+                 source.width(), source.height());
+    QRect clipped = target.intersected(m_canvas.rect());
+    if (clipped.isEmpty()) {
+        return QRect();
+    }
+    source.translate(clipped.x() - target.x(), clipped.y() - target.y());
+    source.setSize(clipped.size());
+
+    if (m_seamWidth > 0) {
+        return blend(tile, source, clipped);
+    }
+
+    // Formats without a fused path are converted once; decoded JPEGs never hit this
+    QImage converted;
+    const QImage* input = &tile;
+    void (*copyRow)(quint32*, const uchar*, int) = nullptr;
+    int bytesPerPixel = 4;
+
+    switch (tile.format()) {
+        case QImage::Format_RGB32:
+            copyRow = copyRowRGB32;
+            break;
+        case QImage::Format_ARGB32_Premultiplied:
+            copyRow = copyRowPremultiplied;
+            break;
+        case QImage::Format_ARGB32:
+            copyRow = copyRowARGB32;
+            break;
+        case QImage::Format_RGB888:
+            copyRow = copyRowRGB888;
+            bytesPerPixel = 3;
+            break;
+        case QImage::Format_Grayscale8:
+            copyRow = copyRowGray8;
+            bytesPerPixel = 1;
+            break;
+        default:
+            converted = PixelFormat::convert(tile, QImage::Format_ARGB32_Premultiplied, "compose");
+            input = &converted;
+            copyRow = copyRowPremultiplied;
+            break;
+    }
+
+    uchar* canvasBits = m_canvas.bits();
+    qsizetype canvasStride = m_canvas.bytesPerLine();
+
+    for (int row = 0; row < clipped.height(); row++) {
+        const uchar* src = input->constScanLine(source.y() + row) + source.x() * bytesPerPixel;
+        quint32* dst = reinterpret_cast<quint32*>(canvasBits + (clipped.y() + row) * canvasStride) + clipped.x();
+        copyRow(dst, src, clipped.width());
+    }
+
+    if (!m_coverage.isEmpty()) {
+        for (int row = 0; row < clipped.height(); row++) {
+            std::memset(m_coverage.data() + qsizetype(clipped.y() + row) * m_canvas.width() + clipped.x(),
+                        0xFF, clipped.width());
+        }
+    }
+
+    return clipped;
+}
+
+void MosaicCompositor::edgeOffset(const QImage& tile, const QPoint& tileOrigin, QPoint start, QPoint along,
+                                  QPoint inward, int length, int depth, int offset[3]) const {
+    // Pairs a tile pixel with the canvas pixel under it where tiles overlap, otherwise with
+    // its mirror image across the edge; medians keep stars on either side from skewing the match
+    int oldHistogram[3][256] = {};
+    int newHistogram[3][256] = {};
+    int samples = 0;
+    const uchar* coverage = reinterpret_cast<const uchar*>(m_coverage.constData());
+    const QRect bounds = m_canvas.rect();
+
+    for (int i = 0; i < length; i++) {
+        for (int k = 0; k < depth; k++) {
+            QPoint inside = start + along * i + inward * k;
+            QPoint reference = inside;
+            if (!coverage[qsizetype(inside.y()) * bounds.width() + inside.x()]) {
+                reference = start + along * i - inward * (k + 1);
+                if (!bounds.contains(reference) || !coverage[qsizetype(reference.y()) * bounds.width() + reference.x()]) {
+                    continue;
+                }
+            }
+
+            QPoint tilePos = inside + tileOrigin;
+            quint32 oldPixel = reinterpret_cast<const quint32*>(m_canvas.constScanLine(reference.y()))[reference.x()];
+            quint32 newPixel = reinterpret_cast<const quint32*>(tile.constScanLine(tilePos.y()))[tilePos.x()];
+            for (int c = 0; c < 3; c++) {
+                oldHistogram[c][(oldPixel >> (8 * c)) & 0xFF]++;
+                newHistogram[c][(newPixel >> (8 * c)) & 0xFF]++;
+            }
+            samples++;
+        }
+    }
+
+    // A corner touching a neighbour is too little contact to judge brightness by
+    bool enough = samples >= std::max(16, depth * 4);
+    for (int c = 0; c < 3; c++) {
+        offset[c] = enough ? histogramMedian(oldHistogram[c], samples) - histogramMedian(newHistogram[c], samples) : 0;
+    }
+}
+
+QRect MosaicCompositor::blend(const QImage& tile, const QRect& source, const QRect& target) {
+    QImage converted;
+    const QImage* input = &tile;
+    if (tile.format() != PixelFormat::INTERNAL) {
+        converted = PixelFormat::convert(tile, PixelFormat::INTERNAL, "blend");
+        input = &converted;
+    }
+
+    const int w = target.width();
+    const int h = target.height();
+    const int seam = m_seamWidth;
+    const QPoint tileOrigin = source.topLeft() - target.topLeft();
+    const int depthX = std::min(seam, w);
+    const int depthY = std::min(seam, h);
+
+    int left[3], right[3], top[3], bottom[3];
+    edgeOffset(*input, tileOrigin, target.topLeft(), QPoint(0, 1), QPoint(1, 0), h, depthX, left);
+    edgeOffset(*input, tileOrigin, target.topRight(), QPoint(0, 1), QPoint(-1, 0), h, depthX, right);
+    edgeOffset(*input, tileOrigin, target.topLeft(), QPoint(1, 0), QPoint(0, 1), w, depthY, top);
+    edgeOffset(*input, tileOrigin, target.bottomLeft(), QPoint(1, 0), QPoint(0, -1), w, depthY, bottom);
+
+    // Corrections and cross-fade weights are separable: a column term plus a row term,
+    // four 16-bit lanes (B, G, R, A) per pixel to match the unpacked pixels
+    std::vector<qint16> columnOffset(size_t(w) * 4, 0);
+    std::vector<qint16> columnAlpha(size_t(w) * 4);
+    for (int x = 0; x < w; x++) {
+        float fromLeft = seamRamp(x, seam);
+        float fromRight = seamRamp(w - 1 - x, seam);
+        for (int c = 0; c < 3; c++) {
+            columnOffset[x * 4 + c] = qint16(std::lround(left[c] * fromLeft + right[c] * fromRight));
+        }
+        std::fill_n(columnAlpha.begin() + x * 4, 4, seamAlpha(std::min(x, w - 1 - x), seam));
+    }
+    std::vector<qint16> rowOffset(size_t(h) * 4, 0);
+    std::vector<qint16> rowAlpha(h);
+    for (int y = 0; y < h; y++) {
+        float fromTop = seamRamp(y, seam);
+        float fromBottom = seamRamp(h - 1 - y, seam);
+        for (int c = 0; c < 3; c++) {
+            rowOffset[y * 4 + c] = qint16(std::lround(top[c] * fromTop + bottom[c] * fromBottom));
+        }
+        rowAlpha[y] = seamAlpha(std::min(y, h - 1 - y), seam);
+    }
+
+    uchar* canvasBits = m_canvas.bits();
+    const qsizetype canvasStride = m_canvas.bytesPerLine();
+    uchar* coverage = reinterpret_cast<uchar*>(m_coverage.data());
+
+    for (int row = 0; row < h; row++) {
+        const quint32* src = reinterpret_cast<const quint32*>(input->constScanLine(source.y() + row)) + source.x();
+        quint32* dst = reinterpret_cast<quint32*>(canvasBits + (target.y() + row) * canvasStride) + target.x();
+        uchar* covered = coverage + qsizetype(target.y() + row) * m_canvas.width() + target.x();
+        const qint16* rowTerm = rowOffset.data() + row * 4;
+        int x = 0;
+
+#ifdef MOSAIC_COMPOSITOR_SSE2
+        // Four pixels per step, unpacked to two registers of 16-bit lanes
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rowOffsets = _mm_set_epi16(rowTerm[3], rowTerm[2], rowTerm[1], rowTerm[0],
+                                                 rowTerm[3], rowTerm[2], rowTerm[1], rowTerm[0]);
+        const __m128i rowWeight = _mm_set1_epi16(rowAlpha[row]);
+        for (; x + 4 <= w; x += 4) {
+            __m128i tilePixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            __m128i canvasPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + x));
+            const __m128i* offsets = reinterpret_cast<const __m128i*>(columnOffset.data() + x * 4);
+            const __m128i* alphas = reinterpret_cast<const __m128i*>(columnAlpha.data() + x * 4);
+
+            // Coverage bytes (0 or 0xFF) widened to a full 4-lane mask per pixel
+            int mask;
+            std::memcpy(&mask, covered + x, 4);
+            __m128i m = _mm_cvtsi32_si128(mask);
+            m = _mm_unpacklo_epi8(m, m);
+            m = _mm_unpacklo_epi16(m, m);
+
+            __m128i lo = featherPixels(_mm_unpacklo_epi8(tilePixels, zero), _mm_unpacklo_epi8(canvasPixels, zero),
+                                       _mm_add_epi16(_mm_loadu_si128(offsets), rowOffsets),
+                                       _mm_min_epi16(_mm_loadu_si128(alphas), rowWeight), _mm_unpacklo_epi32(m, m));
+            __m128i hi = featherPixels(_mm_unpackhi_epi8(tilePixels, zero), _mm_unpackhi_epi8(canvasPixels, zero),
+                                       _mm_add_epi16(_mm_loadu_si128(offsets + 1), rowOffsets),
+                                       _mm_min_epi16(_mm_loadu_si128(alphas + 1), rowWeight), _mm_unpackhi_epi32(m, m));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+        }
+#endif
+
+        for (; x < w; x++) {
+            int weight = covered[x] ? std::min<int>(columnAlpha[x * 4], rowAlpha[row]) : 128;
+            quint32 out = 0xFF000000u;
+            for (int c = 0; c < 3; c++) {
+                int shift = 8 * c;
+                int shifted = std::clamp(int((src[x] >> shift) & 0xFF) + columnOffset[x * 4 + c] + rowTerm[c], 0, 255);
+                int old = int((dst[x] >> shift) & 0xFF);
+                out |= quint32(old + (((shifted - old) * weight) >> 7)) << shift;
+            }
+            dst[x] = out;
+        }
+
+        std::memset(covered, 0xFF, w);
+    }
+
+    return target;
+}
@@ -0,0 +1,60 @@
+// MosaicCompositor.h - Scanline blitter assembling tiles into an aligned RGB32 canvas
+#ifndef MOSAICCOMPOSITOR_H
+#define MOSAICCOMPOSITOR_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QRgb>
+#include <utility>
+
+// Replaces QPainter::drawImage for opaque tile placement. Every tile row is a single
+// memcpy into the canvas, or one pass that converts and stores at the same time
+// for RGB888 and Grayscale8 tiles, so no intermediate converted tile is allocated.
+class MosaicCompositor {
+public:
+    static const int CANVAS_ALIGNMENT = 64;   // Cache line; rows start on a 64-byte boundary
+
+    MosaicCompositor(int width, int height);
+
+    void clear(QRgb color = qRgb(0, 0, 0));
+
+    // Seam feathering, in canvas pixels; 0 (the default) places tiles as plain copies.
+    // Along every edge where a tile meets or overlaps tiles already placed, it is shifted to
+    // the neighbour's median brightness, the shift fading out over seamWidth pixels, and
+    // where it overlaps them it cross-fades in over the same distance. Set before placing.
+    void setSeamWidth(int pixels);
+    int seamWidth() const { return m_seamWidth; }
+
+    // Places the tile's top-left corner at (x, y); anything outside the canvas is clipped.
+    // Returns the canvas area actually written (empty if the tile missed the canvas).
+    QRect blit(const QImage& tile, int x, int y);
+    QRect blit(const QImage& tile, const QRect& sourceRect, int x, int y);
+
+    // takeCanvas() hands over the aligned buffer without a copy and leaves the compositor
+    // empty; painting on a canvas() copy while the compositor still holds it detaches it
+    QImage canvas() const { return m_canvas; }
+    QImage takeCanvas() { return std::move(m_canvas); }
+    int width() const { return m_canvas.width(); }
+    int height() const { return m_canvas.height(); }
+
+    // PixelFormat::INTERNAL image whose rows are CANVAS_ALIGNMENT-aligned and padded to a multiple of it
+    static QImage createAlignedImage(int width, int height);
+
+private:
+    QImage m_canvas;
+    int m_seamWidth;
+    QByteArray m_coverage;      // 0xFF where a tile has been placed; only kept while feathering
+
+    QRect blend(const QImage& tile, const QRect& source, const QRect& target);
+    void edgeOffset(const QImage& tile, const QPoint& tileOrigin, QPoint start, QPoint along, QPoint inward,
+                    int length, int depth, int offset[3]) const;
+
+    static void copyRowRGB32(quint32* dst, const uchar* src, int count);
+    static void copyRowPremultiplied(quint32* dst, const uchar* src, int count);
+    static void copyRowARGB32(quint32* dst, const uchar* src, int count);
+    static void copyRowRGB888(quint32* dst, const uchar* src, int count);
+    static void copyRowGray8(quint32* dst, const uchar* src, int count);
+};
+
+#endif // MOSAICCOMPOSITOR_H
@@ -0,0 +1,463 @@
+// MosaicEngine.cpp - Headless plan, fetch, decode, compose and render of a HiPS tile mosaic
+#include "MosaicEngine.h"
+#include "TileFetcher.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+#include <QUrl>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Pause before the next tile; the survey servers are shared
+    const int NETWORK_PACING_MS = 500;
+    const int CACHE_PACING_MS = 100;
+    const int REQUEST_TIMEOUT_MS = 15000;
+}
+
+MosaicEngine::MosaicEngine(TileCache* cache, ProperHipsClient* hipsClient, QObject* parent)
+    : QObject(parent), m_cache(cache), m_hipsClient(hipsClient),
+      m_userAgent("ProperHipsClient/1.0"), m_previewBounds(400, 400), m_centerPixel(-1),
+      m_order(8), m_currentTileIndex(0), m_generation(0), m_fetching(false) {
+    m_surveyPriority = {"DSS2_Color", "2MASS_Color", "2MASS_J"};
+    m_networkManager = new QNetworkAccessManager(this);
+    m_progressive = new ProgressiveMosaic(this);
+    connect(m_progressive, &ProgressiveMosaic::previewUpdated, this, &MosaicEngine::previewUpdated);
+}
+
+void MosaicEngine::plan(const SkyPosition& position) {
+    m_tiles.clear();
+    m_composed = QImage();
+    m_linear = QImage();
+    m_overlay = nullptr;
+    m_stretch = StretchEngine();
+    m_centerPixel = m_hipsClient->calculateHealPixel(position, m_order);
+    QList<QList<long long>> grid = m_hipsClient->createProper3x3Grid(m_centerPixel, m_order);
+
+    qDebug() << QString("Creating 3×3 tile grid around %1:").arg(position.name);
+    for (int y = 0; y < GRID_SIZE; y++) {
+        for (int x = 0; x < GRID_SIZE; x++) {
+            EngineTile tile;
+            tile.gridX = x;
+            tile.gridY = y;
+            tile.healpixPixel = grid[y][x];
+            tile.center = tileCenter(tile.healpixPixel, m_order);
+
+            // Known coverage holes go straight to a fallback survey
+            QString survey = m_cache->selectSurvey(m_surveyPriority, m_order, tile.healpixPixel);
+            assignSurvey(tile, survey.isEmpty() ? m_surveyPriority.first() : survey);
+
+            qDebug() << QString("  Grid(%1,%2): HEALPix %3%4")
+                        .arg(x).arg(y).arg(tile.healpixPixel)
+                        .arg(tile.healpixPixel == m_centerPixel ? " ★ TARGET TILE ★" : "");
+            m_tiles.append(tile);
+        }
+    }
+
+    setWindow(QRect(QPoint(0, 0), gridPixels()));
+}
+
+void MosaicEngine::setWindow(const QRect& window) {
+    // Anything still in flight belongs to the previous plan
+    m_generation++;
+    m_fetching = false;
+    m_currentTileIndex = 0;
+
+    m_window = window.intersected(QRect(QPoint(0, 0), gridPixels()));
+    int tilesInWindow = 0;
+    for (EngineTile& tile : m_tiles) {
+        QRect tileRect(tile.gridX * TILE_SIZE, tile.gridY * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+        tile.inWindow = tileRect.intersects(m_window);
+        tile.image = QImage();
+        tile.downloaded = false;
+        if (tile.inWindow) tilesInWindow++;
+    }
+
+    qDebug() << QString("Output window (%1,%2) %3x%4 needs %5 of %6 tiles")
+                .arg(m_window.x()).arg(m_window.y())
+                .arg(m_window.width()).arg(m_window.height())
+                .arg(tilesInWindow).arg(m_tiles.size());
+
+    // Fetch outward from the window centre so the target tile is the first one on screen
+    const QPoint windowCenter = m_window.center();
+    std::stable_sort(m_tiles.begin(), m_tiles.end(), [windowCenter](const EngineTile& a, const EngineTile& b) {
+        QPoint da = QPoint(a.gridX * TILE_SIZE + TILE_SIZE / 2, a.gridY * TILE_SIZE + TILE_SIZE / 2) - windowCenter;
+        QPoint db = QPoint(b.gridX * TILE_SIZE + TILE_SIZE / 2, b.gridY * TILE_SIZE + TILE_SIZE / 2) - windowCenter;
+        return da.manhattanLength() < db.manhattanLength();
+    });
+
+    m_progressive->reset(m_window.size(), m_previewBounds);
+}
+
+int MosaicEngine::tilesPlaced() const {
+    int placed = 0;
+    for (const EngineTile& tile : m_tiles) {
+        if (tile.inWindow && tile.downloaded && !tile.image.isNull()) {
+            placed++;
+        }
+    }
+    return placed;
+}
+
+void MosaicEngine::start() {
+    m_generation++;
+    m_fetching = true;
+    m_currentTileIndex = 0;
+    qDebug() << QString("Starting download of %1 tiles...").arg(m_tiles.size());
+    processNextTile();
+}
+
+void MosaicEngine::schedule(int delayMs) {
+    const int generation = m_generation;
+    QTimer::singleShot(delayMs, this, [this, generation]() {
+        if (generation == m_generation) {
+            processNextTile();
+        }
+    });
+}
+
+void MosaicEngine::advance(int delayMs) {
+    m_currentTileIndex++;
+    schedule(delayMs);
+}
+
+bool MosaicEngine::isCurrent(int generation, int tileIndex) const {
+    return generation == m_generation && m_fetching && tileIndex < m_tiles.size();
+}
+
+void MosaicEngine::processNextTile() {
+    if (!m_fetching) {
+        return;
+    }
+    if (m_currentTileIndex >= m_tiles.size()) {
+        m_fetching = false;
+        m_progressive->flush();
+        emit fetchFinished(tilesPlaced());
+        return;
+    }
+
+    const EngineTile& tile = m_tiles[m_currentTileIndex];
+
+    // Tiles entirely outside the output window are neither fetched nor decoded
+    if (!tile.inWindow) {
+        qDebug() << QString("⏭️ Skipping tile %1/%2: Grid(%3,%4) lies outside the output window")
+                    .arg(m_currentTileIndex + 1).arg(m_tiles.size()).arg(tile.gridX).arg(tile.gridY);
+        advance(0);
+        return;
+    }
+
+    // Size and JPEG signature checks are done by the cache
+    if (m_cache->hasValidTile(tile.key)) {
+        if (m_cache->isFresh(tile.key)) {
+            loadExistingTile(m_currentTileIndex);
+            return;
+        }
+        qDebug() << QString("Existing tile %1 is past its revalidation time, will send conditional GET")
+                    .arg(tile.key.toString());
+    }
+
+    // No survey in the priority list covers this tile - leave a gap without a round trip
+    if (m_cache->isKnownMissing(tile.key)) {
+        qDebug() << QString("⏭️ Skipping tile %1/%2: HEALPix %3 is a known coverage hole")
+                    .arg(m_currentTileIndex + 1).arg(m_tiles.size()).arg(tile.healpixPixel);
+        advance(0);
+        return;
+    }
+
+    downloadTile(m_currentTileIndex);
+}
+
+void MosaicEngine::downloadTile(int tileIndex) {
+    const EngineTile& tile = m_tiles[tileIndex];
+
+    qDebug() << QString("Downloading tile %1/%2: Grid(%3,%4) HEALPix %5")
+                .arg(tileIndex + 1).arg(m_tiles.size())
+                .arg(tile.gridX).arg(tile.gridY)
+                .arg(tile.healpixPixel);
+    emit tileStarted(tileIndex, false);
+
+    QNetworkRequest request{QUrl(tile.url)};
+    request.setHeader(QNetworkRequest::UserAgentHeader, m_userAgent);
+    request.setRawHeader("Accept", "image/*");
+    m_cache->prepareRequest(tile.key, request);
+
+    m_downloadStartTime = QDateTime::currentDateTime();
+    QNetworkReply* reply = m_networkManager->get(request);
+    reply->setProperty("tileIndex", tileIndex);
+    reply->setProperty("generation", m_generation);
+    connect(reply, &QNetworkReply::finished, this, &MosaicEngine::onTileDownloaded);
+
+    TileFetcher::abortAfterSend(reply, REQUEST_TIMEOUT_MS);
+}
+
+void MosaicEngine::onTileDownloaded() {
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply) return;
+    reply->deleteLater();
+
+    int tileIndex = reply->property("tileIndex").toInt();
+    if (!isCurrent(reply->property("generation").toInt(), tileIndex)) {
+        return;
+    }
+
+    QByteArray imageData;
+    TileCache::FetchOutcome outcome = m_cache->storeReply(m_tiles[tileIndex].key, reply, &imageData);
+    qint64 downloadTime = m_downloadStartTime.msecsTo(QDateTime::currentDateTime());
+
+    if (outcome == TileCache::FetchOutcome::Stored || outcome == TileCache::FetchOutcome::NotModified) {
+        decodeDownloadedTile(tileIndex, imageData, outcome, downloadTime);
+        return;
+    }
+
+    if (outcome == TileCache::FetchOutcome::Missing) {
+        handleMissingTile(tileIndex);
+        return;
+    }
+
+    qDebug() << QString("❌ Tile %1/%2 download failed: %3")
+                .arg(tileIndex + 1).arg(m_tiles.size())
+                .arg(reply->errorString());
+    advance(NETWORK_PACING_MS);
+}
+
+void MosaicEngine::decodeDownloadedTile(int tileIndex, const QByteArray& imageData,
+                                        TileCache::FetchOutcome outcome, qint64 downloadTime) {
+    // JPEG decode and tile statistics run on the render pool; the watcher delivers them back here
+    QFutureWatcher<DecodedTile>* watcher = new QFutureWatcher<DecodedTile>(this);
+    const qsizetype bytes = imageData.size();
+    const int generation = m_generation;
+
+    connect(watcher, &QFutureWatcher<DecodedTile>::finished, this,
+            [this, watcher, generation, tileIndex, outcome, downloadTime, bytes]() {
+        DecodedTile decoded = watcher->result();
+        watcher->deleteLater();
+        if (!isCurrent(generation, tileIndex)) return;
+
+        if (decoded.image.isNull()) {
+            // Decodes to nothing - treat like a 404 so the next survey is tried
+            qDebug() << QString("❌ Tile %1/%2 - invalid image data")
+                        .arg(tileIndex + 1).arg(m_tiles.size());
+            m_cache->markMissing(m_tiles[tileIndex].key);
+            handleMissingTile(tileIndex);
+            return;
+        }
+        if (!acceptDecoded(tileIndex, decoded)) {
+            return;
+        }
+
+        if (outcome == TileCache::FetchOutcome::NotModified) {
+            qDebug() << QString("✅ Tile %1/%2 revalidated: %3ms, HTTP 304, cached copy still current")
+                        .arg(tileIndex + 1).arg(m_tiles.size()).arg(downloadTime);
+        } else {
+            qDebug() << QString("✅ Tile %1/%2 downloaded: %3ms, %4 bytes, %5x%6 pixels, cached")
+                        .arg(tileIndex + 1).arg(m_tiles.size())
+                        .arg(downloadTime).arg(bytes)
+                        .arg(decoded.image.width()).arg(decoded.image.height());
+        }
+        advance(NETWORK_PACING_MS);
+    });
+
+    watcher->setFuture(MosaicRenderer::decodeAsync(imageData));
+}
+
+void MosaicEngine::loadExistingTile(int tileIndex) {
+    emit tileStarted(tileIndex, true);
+
+    // Repeat visits are served from the cache's memory tiers; a cold tile is read and
+    // decoded on the render pool so the event loop keeps running meanwhile
+    QFutureWatcher<DecodedTile>* watcher = new QFutureWatcher<DecodedTile>(this);
+    const int generation = m_generation;
+
+    connect(watcher, &QFutureWatcher<DecodedTile>::finished, this, [this, watcher, generation, tileIndex]() {
+        DecodedTile decoded = watcher->result();
+        watcher->deleteLater();
+        if (!isCurrent(generation, tileIndex)) return;
+
+        if (decoded.image.isNull()) {
+            qDebug() << QString("Existing tile %1 failed to load as image, will re-download")
+                        .arg(m_tiles[tileIndex].key.toString());
+            downloadTile(tileIndex);
+            return;
+        }
+        if (!acceptDecoded(tileIndex, decoded)) {
+            return;
+        }
+
+        qDebug() << QString("✓ Using existing tile %1/%2: %3 (%4x%5 pixels)")
+                    .arg(tileIndex + 1).arg(m_tiles.size())
+                    .arg(QFileInfo(m_tiles[tileIndex].filename).fileName())
+                    .arg(decoded.image.width()).arg(decoded.image.height());
+        advance(CACHE_PACING_MS);
+    });
+
+    watcher->setFuture(MosaicRenderer::loadCachedAsync(m_cache, m_tiles[tileIndex].key));
+}
+
+bool MosaicEngine::acceptDecoded(int tileIndex, const DecodedTile& decoded) {
+    EngineTile& tile = m_tiles[tileIndex];
+
+    // A valid JPEG with nothing in it (survey edge) is a miss for this survey too
+    if (m_cache->recordStats(tile.key, decoded.stats)) {
+        const TileStats& stats = decoded.stats;
+        qDebug() << QString("⬛ Tile %1/%2 is blank in %3: levels %4-%5, mean %6, %7% empty, %8% saturated")
+                    .arg(tileIndex + 1).arg(m_tiles.size()).arg(tile.key.survey)
+                    .arg(int(stats.minLevel)).arg(int(stats.maxLevel)).arg(stats.mean, 0, 'f', 1)
+                    .arg(stats.emptyFraction * 100.0, 0, 'f', 1).arg(stats.saturatedFraction * 100.0, 0, 'f', 1);
+        handleMissingTile(tileIndex);
+        return false;
+    }
+
+    // Composited straight away at its offset in the window; the preview refresh is rate-limited
+    tile.image = decoded.image;
+    tile.downloaded = true;
+    m_progressive->addTile(tile.image, QPoint(tile.gridX * TILE_SIZE - m_window.x(),
+                                              tile.gridY * TILE_SIZE - m_window.y()));
+    emit tilePlaced(tileIndex);
+    return true;
+}
+
+void MosaicEngine::handleMissingTile(int tileIndex) {
+    EngineTile& tile = m_tiles[tileIndex];
+
+    QString missingSurvey = tile.key.survey;
+    if (fallBackToNextSurvey(tile)) {
+        qDebug() << QString("↪️ Tile %1/%2 not in %3, retrying from %4")
+                    .arg(tileIndex + 1).arg(m_tiles.size()).arg(missingSurvey).arg(tile.key.survey);
+        schedule(0);
+        return;
+    }
+
+    qDebug() << QString("❌ Tile %1/%2 not available in any survey")
+                .arg(tileIndex + 1).arg(m_tiles.size());
+    advance(NETWORK_PACING_MS);
+}
+
+void MosaicEngine::assignSurvey(EngineTile& tile, const QString& survey) {
+    tile.key = {survey, m_order, tile.healpixPixel, m_hipsClient->getSurveyFormat(survey)};
+    tile.filename = m_cache->tilePath(tile.key);
+    tile.url = m_hipsClient->buildTileUrlForPixel(survey, tile.healpixPixel, m_order);
+}
+
+bool MosaicEngine::fallBackToNextSurvey(EngineTile& tile) {
+    int current = m_surveyPriority.indexOf(tile.key.survey);
+    QString next = m_cache->selectSurvey(m_surveyPriority.mid(current + 1), tile.key.order, tile.healpixPixel);
+    if (next.isEmpty()) {
+        return false;
+    }
+    assignSurvey(tile, next);
+    return true;
+}
+
+MosaicRenderRequest MosaicEngine::renderRequest() {
+    // Tiles were composited as they decoded; only the window's canvas and placements are handed on
+    m_progressive->flush();
+    MosaicRenderRequest request;
+    request.canvasSize = m_window.size();
+    request.baseCanvas = m_progressive->canvas();
+
+    for (const EngineTile& tile : m_tiles) {
+        if (!tile.inWindow) continue;
+        if (!tile.downloaded || tile.image.isNull()) {
+            qDebug() << QString("  Skipping tile %1,%2 - not downloaded").arg(tile.gridX).arg(tile.gridY);
+            continue;
+        }
+
+        QPoint position(tile.gridX * TILE_SIZE - m_window.x(), tile.gridY * TILE_SIZE - m_window.y());
+        request.tiles.append({tile.image, position});
+
+        QRect placed = QRect(position, tile.image.size()).intersected(QRect(QPoint(0, 0), m_window.size()));
+        qDebug() << QString("  ✅ Placed tile (%1,%2): %3x%4 pixels at (%5,%6)")
+                    .arg(tile.gridX).arg(tile.gridY)
+                    .arg(placed.width()).arg(placed.height())
+                    .arg(placed.x()).arg(placed.y());
+    }
+    return request;
+}
+
+void MosaicEngine::render(const MosaicRenderRequest& request) {
+    // Compose, overlay and encoding run on the render pool; the frame comes back as a signal
+    QFutureWatcher<MosaicFrame>* watcher = new QFutureWatcher<MosaicFrame>(this);
+    const QImage composed = request.baseCanvas;
+    const std::function<void(QImage&)> overlay = request.overlay;
+    connect(watcher, &QFutureWatcher<MosaicFrame>::finished, this, [this, watcher, composed, overlay]() {
+        MosaicFrame frame = watcher->result();
+        watcher->deleteLater();
+        m_composed = composed;
+        m_linear = frame.linear;
+        m_overlay = overlay;
+        m_stretch = StretchEngine();
+        emit rendered(frame);
+    });
+    watcher->setFuture(MosaicRenderer::renderAsync(request));
+}
+
+bool MosaicEngine::reflatten(const FlattenParams& params) {
+    if (m_composed.isNull() || m_linear.isNull()) {
+        return false;
+    }
+
+    // Background mesh and one streaming pass over the composed tiles
+    QElapsedTimer timer;
+    timer.start();
+    m_linear = BackgroundFlattener::apply(m_composed, params);
+    m_stretch = StretchEngine();
+    qDebug() << QString("🌌 Background flatten (%1) in %2ms")
+                .arg(BackgroundFlattener::modeName(params.mode)).arg(timer.elapsed());
+    return true;
+}
+
+QImage MosaicEngine::restretch(const StretchParams& params) {
+    if (m_linear.isNull()) {
+        return QImage();
+    }
+
+    // One table lookup per channel over the linear mosaic, then the overlay on top
+    QElapsedTimer timer;
+    timer.start();
+    QImage stretched = stretchEngine().apply(params);
+    if (m_overlay) {
+        m_overlay(stretched);
+    }
+    qDebug() << QString("🎚️ %1 stretch (black %2, white %3, gamma %4) in %5ms")
+                .arg(StretchEngine::modeName(params.mode)).arg(params.black).arg(params.white)
+                .arg(params.gamma, 0, 'f', 2).arg(timer.elapsed());
+    return stretched;
+}
+
+StretchParams MosaicEngine::autoLevels(StretchMode mode) {
+    if (m_linear.isNull()) {
+        StretchParams params;
+        params.mode = mode;
+        return params;
+    }
+    return stretchEngine().autoLevels(mode);
+}
+
+StretchEngine& MosaicEngine::stretchEngine() {
+    if (m_stretch.isNull()) {
+        m_stretch = StretchEngine(m_linear);
+    }
+    return m_stretch;
+}
+
+SkyPosition MosaicEngine::tileCenter(long long pixel, int order) {
+    SkyPosition pos;
+    try {
+        Healpix_Base healpix(1LL << order, NEST, SET_NSIDE);
+        pointing pt = healpix.pix2ang(pixel);
+        pos.ra_deg = pt.phi * 180.0 / M_PI;
+        pos.dec_deg = 90.0 - pt.theta * 180.0 / M_PI;
+        pos.name = QString("HEALPix_%1").arg(pixel);
+        pos.description = QString("Order %1 pixel %2").arg(order).arg(pixel);
+    } catch (...) {
+        pos.ra_deg = 0.0;
+        pos.dec_deg = 0.0;
+        pos.name = "Error";
+        pos.description = "HEALPix conversion failed";
+    }
+    return pos;
+}
@@ -0,0 +1,142 @@
+// MosaicEngine.h - Headless plan, fetch, decode, compose and render of a HiPS tile mosaic
+#ifndef MOSAICENGINE_H
+#define MOSAICENGINE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QImage>
+#include <QList>
+#include <QNetworkAccessManager>
+#include <QObject>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include "MosaicRenderer.h"
+#include "ProgressiveMosaic.h"
+#include "ProperHipsClient.h"
+#include "StretchEngine.h"
+#include "TileCache.h"
+
+// One tile of the planned grid
+struct EngineTile {
+    int gridX = 0;
+    int gridY = 0;
+    long long healpixPixel = 0;
+    SkyPosition center;         // Sky position of the tile centre
+    TileKey key;                // Survey currently tried; changes when falling back
+    QString filename;           // Where the cache keeps it
+    QString url;
+    QImage image;
+    bool downloaded = false;
+    bool inWindow = true;       // Intersects the output window; others are never fetched
+};
+
+// The pipeline every mosaic tool shares, without any widgets:
+//   plan()/setWindow()  3x3 HEALPix grid around a position and the output window in grid pixels
+//   start()             tiles one at a time, outward from the window centre: fresh cache hits from
+//                       the memory tiers or disk, the rest over HTTP (conditional GETs for stale
+//                       copies); coverage holes and blank tiles fall back through the survey list
+//   decode/compose      on the render pool; each tile lands in a ProgressiveMosaic window canvas
+//   render()            MosaicRenderer over the composed canvas (flatten, stretch, overlay, files)
+//   restretch()         the last frame again under new flatten/stretch settings, from kept canvases
+// Results come back as signals on the engine's thread, so a GUI, a CLI and batch tools drive
+// the same code and any optimization here serves all of them.
+class MosaicEngine : public QObject {
+    Q_OBJECT
+
+public:
+    static const int TILE_SIZE = 512;
+    static const int GRID_SIZE = 3;
+
+    MosaicEngine(TileCache* cache, ProperHipsClient* hipsClient, QObject* parent = nullptr);
+
+    void setSurveyPriority(const QStringList& surveys) { m_surveyPriority = surveys; }
+    QStringList surveyPriority() const { return m_surveyPriority; }
+    void setOrder(int order) { m_order = order; }
+    int order() const { return m_order; }
+    void setUserAgent(const QByteArray& userAgent) { m_userAgent = userAgent; }
+    // Feathers tile boundaries; fallback surveys differ in brightness tile to tile
+    void setSeamWidth(int pixels) { m_progressive->setSeamWidth(pixels); }
+    void setPreviewBounds(const QSize& bounds) { m_previewBounds = bounds; }
+
+    // Replaces the grid and cancels a running fetch; the whole grid is the output window
+    void plan(const SkyPosition& position);
+    // Tiles outside window (grid pixels) are skipped; fetch order and canvas follow it
+    void setWindow(const QRect& window);
+
+    const QList<EngineTile>& tiles() const { return m_tiles; }
+    QRect window() const { return m_window; }
+    QSize gridPixels() const { return QSize(GRID_SIZE * TILE_SIZE, GRID_SIZE * TILE_SIZE); }
+    long long centerPixel() const { return m_centerPixel; }
+    int tilesPlaced() const;
+    bool isFetching() const { return m_fetching; }
+    ProgressiveMosaic* progressive() const { return m_progressive; }
+
+    void start();
+
+    // Composed window and its tiles; callers add overlay, flatten, stretch and files
+    MosaicRenderRequest renderRequest();
+    void render(const MosaicRenderRequest& request);
+
+    // The last rendered frame's composed canvas, overlay and linear mosaic are kept until the
+    // next plan(), so display settings can change without fetching or composing again.
+    // reflatten() replaces the linear mosaic; restretch() returns it stretched with the overlay
+    // drawn on top. Both do nothing (false / null image) before the first frame.
+    bool hasRendered() const { return !m_linear.isNull(); }
+    bool reflatten(const FlattenParams& params);
+    QImage restretch(const StretchParams& params);
+    StretchParams autoLevels(StretchMode mode);
+
+    static SkyPosition tileCenter(long long pixel, int order);
+
+signals:
+    void tileStarted(int index, bool fromCache);
+    void tilePlaced(int index);
+    void previewUpdated(const QImage& preview);
+    void fetchFinished(int tilesPlaced);
+    void rendered(const MosaicFrame& frame);
+
+private slots:
+    void onTileDownloaded();
+
+private:
+    TileCache* m_cache;
+    ProperHipsClient* m_hipsClient;
+    QNetworkAccessManager* m_networkManager;
+    ProgressiveMosaic* m_progressive;
+
+    QList<EngineTile> m_tiles;
+    QStringList m_surveyPriority;
+    QByteArray m_userAgent;
+    QSize m_previewBounds;
+    QRect m_window;
+    long long m_centerPixel;
+    int m_order;
+    int m_currentTileIndex;
+    int m_generation;           // Bumped by setWindow() and start(); older results and timers are dropped
+    bool m_fetching;
+    QDateTime m_downloadStartTime;
+
+    QImage m_composed;          // Before flattening
+    QImage m_linear;            // Flattened, before stretch and overlay
+    std::function<void(QImage&)> m_overlay;
+    StretchEngine m_stretch;    // Over m_linear; its histogram is counted on first use
+
+    void processNextTile();
+    void schedule(int delayMs);                 // processNextTile for the current tile, unless superseded
+    void advance(int delayMs);
+    bool isCurrent(int generation, int tileIndex) const;
+    void downloadTile(int tileIndex);
+    void loadExistingTile(int tileIndex);
+    void decodeDownloadedTile(int tileIndex, const QByteArray& imageData,
+                              TileCache::FetchOutcome outcome, qint64 downloadTime);
+    bool acceptDecoded(int tileIndex, const DecodedTile& decoded);
+    void handleMissingTile(int tileIndex);
+    StretchEngine& stretchEngine();
+    void assignSurvey(EngineTile& tile, const QString& survey);
+    bool fallBackToNextSurvey(EngineTile& tile);
+};
+
+#endif // MOSAICENGINE_H
@@ -0,0 +1,115 @@
+// MosaicRenderer.cpp - Tile decode and mosaic compose/encode jobs that run off the GUI thread
+#include "MosaicRenderer.h"
+#include "DeepZoomWriter.h"
+#include "MosaicCompositor.h"
+#include "PixelFormat.h"
+#include "TileCache.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+
+QThreadPool* MosaicRenderer::pool() {
+    // Separate from QThreadPool::globalInstance() so long encodes never starve other users
+    static QThreadPool* renderPool = []() {
+        QThreadPool* p = new QThreadPool();
+        p->setMaxThreadCount(std::max(2, QThread::idealThreadCount() - 1));
+        return p;
+    }();
+    return renderPool;
+}
+
+QImage MosaicRenderer::decodeTile(const QByteArray& data) {
+    return PixelFormat::decode(data);
+}
+
+DecodedTile MosaicRenderer::decodeAndMeasure(const QByteArray& data) {
+    DecodedTile tile;
+    tile.image = decodeTile(data);
+    tile.stats = TileStats::measure(tile.image);
+    return tile;
+}
+
+MosaicFrame MosaicRenderer::render(const MosaicRenderRequest& request) {
+    MosaicFrame frame;
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!request.baseCanvas.isNull()) {
+        // Tiles were composited as they arrived; painting the overlay detaches a private copy
+        frame.mosaic = request.baseCanvas;
+        for (const PlacedTile& tile : request.tiles) {
+            if (QRect(tile.position, tile.image.size()).intersects(frame.mosaic.rect())) {
+                frame.tilesPlaced++;
+            }
+        }
+    } else {
+        MosaicCompositor compositor(request.canvasSize.width(), request.canvasSize.height());
+        compositor.setSeamWidth(request.seamWidth);
+        compositor.clear();
+        for (const PlacedTile& tile : request.tiles) {
+            if (!compositor.blit(tile.image, tile.position.x(), tile.position.y()).isEmpty()) {
+                frame.tilesPlaced++;
+            }
+        }
+        frame.mosaic = compositor.takeCanvas();
+    }
+
+    if (!request.flatten.isIdentity()) {
+        QElapsedTimer flattenTimer;
+        flattenTimer.start();
+        frame.mosaic = BackgroundFlattener::apply(frame.mosaic, request.flatten);
+        frame.flattenMs = flattenTimer.elapsed();
+    }
+    frame.linear = frame.mosaic;
+    if (!request.stretch.isIdentity()) {
+        frame.mosaic = StretchEngine(frame.linear).apply(request.stretch);
+    }
+    if (request.overlay) {
+        request.overlay(frame.mosaic);
+    }
+    frame.composeMs = timer.restart();
+
+    if (!request.outputFile.isEmpty()) {
+        frame.saved = frame.mosaic.save(request.outputFile);
+    }
+    // Built once; the preview JPEG, the display image and later GUI rescales all read a level
+    frame.pyramid = MipPyramid(frame.mosaic);
+    if (!request.previewFile.isEmpty()) {
+        frame.pyramid.scaled(QSize(request.previewSize, request.previewSize)).save(request.previewFile);
+    }
+    if (!request.deepZoomFile.isEmpty()) {
+        DeepZoomWriter::exportImage(frame.mosaic, request.deepZoomFile);
+    }
+    if (request.displaySize > 0) {
+        frame.display = frame.pyramid.scaled(QSize(request.displaySize, request.displaySize));
+    }
+    frame.encodeMs = timer.restart();
+
+    if (request.extractSources) {
+        // The unstretched tiles: the overlay's crosshairs and labels would be detected too
+        frame.sources = SourceExtractor::extract(frame.linear);
+        frame.extractMs = timer.elapsed();
+    }
+
+    return frame;
+}
+
+QFuture<DecodedTile> MosaicRenderer::decodeAsync(const QByteArray& data) {
+    return QtConcurrent::run(pool(), &MosaicRenderer::decodeAndMeasure, data);
+}
+
+QFuture<DecodedTile> MosaicRenderer::loadCachedAsync(TileCache* cache, const TileKey& key) {
+    // TileCache::loadTile only touches the locked memory tiers and the tile file; the
+    // statistics are recorded back on the caller's thread, which owns the index
+    return QtConcurrent::run(pool(), [cache, key]() {
+        DecodedTile tile;
+        tile.image = cache->loadTile(key);
+        tile.stats = TileStats::measure(tile.image);
+        return tile;
+    });
+}
+
+QFuture<MosaicFrame> MosaicRenderer::renderAsync(const MosaicRenderRequest& request) {
+    return QtConcurrent::run(pool(), &MosaicRenderer::render, request);
+}
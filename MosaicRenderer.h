@@ -0,0 +1,83 @@
+// MosaicRenderer.h - Tile decode and mosaic compose/encode jobs that run off the GUI thread
+#ifndef MOSAICRENDERER_H
+#define MOSAICRENDERER_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QImage>
+#include <QList>
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <functional>
+#include "BackgroundFlattener.h"
+#include "MipPyramid.h"
+#include "SourceExtractor.h"
+#include "StretchEngine.h"
+#include "TileStats.h"
+
+class TileCache;
+struct TileKey;
+
+// One decoded tile and where its top-left corner lands on the canvas
+struct PlacedTile {
+    QImage image;
+    QPoint position;
+};
+
+// A decoded tile and its statistics, measured on the worker straight after the decode
+struct DecodedTile {
+    QImage image;
+    TileStats stats;
+};
+
+// Everything a render job needs, captured by value so the GUI can keep mutating its state
+struct MosaicRenderRequest {
+    QSize canvasSize;
+    QList<PlacedTile> tiles;
+    QImage baseCanvas;                      // Already holds the tiles (progressive assembly); only counted
+    FlattenParams flatten;                  // Plate background removal, before anything else sees the canvas
+    StretchParams stretch;                  // Display stretch, applied before the overlay
+    std::function<void(QImage&)> overlay;   // Crosshairs/labels, drawn on the worker
+    QString outputFile;                     // Full-size PNG, skipped when empty
+    QString previewFile;                    // Downscaled JPEG, skipped when empty
+    QString deepZoomFile;                   // DZI tile pyramid for the web viewer, skipped when empty
+    int seamWidth = 0;                      // Tile boundary feathering when composing tiles
+    bool extractSources = false;            // Stars for guiding/alignment checks, from the linear canvas
+    int previewSize = 512;
+    int displaySize = 400;                  // Pre-scaled image for the GUI preview label
+};
+
+// A finished frame handed back to the GUI thread
+struct MosaicFrame {
+    QImage mosaic;
+    QImage linear;              // Composed (and flattened) tiles before stretch and overlay, for re-stretching
+    MipPyramid pyramid;         // Levels of mosaic; later previews and crops scale from these
+    QImage display;
+    QList<ExtractedSource> sources;     // Brightest first; empty unless requested
+    int tilesPlaced = 0;
+    bool saved = false;
+    qint64 composeMs = 0;       // Includes flattening
+    qint64 flattenMs = 0;
+    qint64 encodeMs = 0;
+    qint64 extractMs = 0;
+};
+
+// Decoding, composing, PNG/JPEG encoding and preview scaling run on a dedicated pool;
+// callers attach a QFutureWatcher so results arrive on the GUI thread as queued signals
+class MosaicRenderer {
+public:
+    static QThreadPool* pool();
+
+    static QImage decodeTile(const QByteArray& data);
+    static DecodedTile decodeAndMeasure(const QByteArray& data);
+    static MosaicFrame render(const MosaicRenderRequest& request);
+
+    // Results carry TileStats so blank tiles are caught without another pass over the pixels
+    static QFuture<DecodedTile> decodeAsync(const QByteArray& data);
+    static QFuture<DecodedTile> loadCachedAsync(TileCache* cache, const TileKey& key);
+    static QFuture<MosaicFrame> renderAsync(const MosaicRenderRequest& request);
+};
+
+#endif // MOSAICRENDERER_H
@@ -0,0 +1,85 @@
+// PixelFormat.cpp - The pipeline's internal pixel formats and a count of conversions into them
+#include "PixelFormat.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <algorithm>
+
+namespace {
+    QMutex statsMutex;
+    PixelConversionStats conversionStats;
+
+    void record(const char* site, const QImage& converted, qint64 nanoseconds) {
+        QMutexLocker locker(&statsMutex);
+        conversionStats.conversions++;
+        conversionStats.bytes += converted.sizeInBytes();
+        conversionStats.nanoseconds += nanoseconds;
+        conversionStats.bySite[QString::fromLatin1(site)]++;
+    }
+}
+
+QImage PixelFormat::toInternal(const QImage& image, const char* site) {
+    if (image.isNull() || isInternal(image)) {
+        return image;
+    }
+    return convert(image, INTERNAL, site);
+}
+
+QImage PixelFormat::convert(const QImage& image, QImage::Format format, const char* site) {
+    if (image.isNull() || image.format() == format) {
+        return image;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    QImage converted = image.convertToFormat(format);
+    record(site, converted, timer.nsecsElapsed());
+    return converted;
+}
+
+QImage PixelFormat::decode(const QByteArray& data) {
+    // Qt's JPEG plugin already writes RGB32 for colour scans; only grayscale plates and
+    // palette PNGs pay the conversion, on the decoding worker
+    return toInternal(QImage::fromData(data), "decode");
+}
+
+QPixmap PixelFormat::toPixmap(const QImage& image, const char* site) {
+    if (image.isNull() || isInternal(image)) {
+        return QPixmap::fromImage(image, Qt::NoFormatConversion);
+    }
+    return QPixmap::fromImage(convert(image, INTERNAL, site), Qt::NoFormatConversion);
+}
+
+PixelConversionStats PixelFormat::stats() {
+    QMutexLocker locker(&statsMutex);
+    return conversionStats;
+}
+
+void PixelFormat::resetStats() {
+    QMutexLocker locker(&statsMutex);
+    conversionStats = PixelConversionStats();
+}
+
+void PixelFormat::logStats(const QString& label) {
+    const PixelConversionStats snapshot = stats();
+    if (snapshot.conversions == 0) {
+        qDebug() << QString("🎨 %1: no format conversions outside the internal format").arg(label);
+        return;
+    }
+
+    QStringList sites = snapshot.bySite.keys();
+    std::sort(sites.begin(), sites.end(), [&snapshot](const QString& a, const QString& b) {
+        return snapshot.bySite.value(a) > snapshot.bySite.value(b);
+    });
+    QStringList parts;
+    for (const QString& site : sites) {
+        parts.append(QString("%1 %2").arg(site).arg(snapshot.bySite.value(site)));
+    }
+    qDebug() << QString("🎨 %1: %2 format conversions (%3 MB, %4 ms) - %5")
+                .arg(label)
+                .arg(snapshot.conversions)
+                .arg(snapshot.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                .arg(snapshot.nanoseconds / 1e6, 0, 'f', 1)
+                .arg(parts.join(", "));
+}
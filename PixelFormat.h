@@ -0,0 +1,50 @@
+// PixelFormat.h - The pipeline's internal pixel formats and a count of conversions into them
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QPixmap>
+#include <QString>
+
+// Conversions since the last PixelFormat::resetStats(), per call site
+struct PixelConversionStats {
+    qint64 conversions = 0;
+    qint64 bytes = 0;               // Size of the converted images
+    qint64 nanoseconds = 0;
+    QHash<QString, qint64> bySite;
+};
+
+// Every stage reads and writes INTERNAL (0xffRRGGBB, 32 bits per pixel): decoded tiles,
+// canvases, stretched and flattened mosaics, pyramid levels and previews. ARGB32 has the
+// same layout and is accepted as is; the alpha byte is ignored.
+//
+// Tiles are converted once, on the decoding worker, when the image plugin delivers another
+// format (grayscale JPEGs, palette PNGs). Any later conversion goes through convert(), which
+// counts it under a site name, so logStats() shows where a full copy still happens.
+class PixelFormat {
+public:
+    static constexpr QImage::Format INTERNAL = QImage::Format_RGB32;
+
+    static bool isInternal(const QImage& image) {
+        return image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32;
+    }
+
+    // Shares image when it is already internal
+    static QImage toInternal(const QImage& image, const char* site);
+    // Shares image when it already has format; a null image is never counted
+    static QImage convert(const QImage& image, QImage::Format format, const char* site);
+
+    // Decodes tile bytes to INTERNAL; a plugin that picks another format is counted as "decode"
+    static QImage decode(const QByteArray& data);
+
+    // Internal images are handed over without a format conversion
+    static QPixmap toPixmap(const QImage& image, const char* site);
+
+    static PixelConversionStats stats();
+    static void resetStats();
+    static void logStats(const QString& label);
+};
+
+#endif // PIXELFORMAT_H
@@ -0,0 +1,118 @@
+// ProgressiveMosaic.cpp - Live mosaic canvas filled tile by tile with a rate-limited preview
+#include "ProgressiveMosaic.h"
+#include "ImageFilters.h"
+#include "PixelFormat.h"
+#include <QPainter>
+#include <QRectF>
+#include <algorithm>
+#include <cstring>
+
+ProgressiveMosaic::ProgressiveMosaic(QObject* parent)
+    : QObject(parent)
+    , m_compositor(0, 0)
+    , m_tilesAdded(0)
+    , m_seamWidth(0) {
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setSingleShot(true);
+    setMaxFps(15);
+
+    // Trailing refresh for tiles that arrived while the previous one was still "on screen"
+    connect(m_refreshTimer, &QTimer::timeout, this, [this]() {
+        if (!m_dirty.isEmpty()) {
+            refreshPreview();
+            m_refreshTimer->start();
+        }
+    });
+}
+
+void ProgressiveMosaic::reset(const QSize& canvasSize, const QSize& previewBounds) {
+    m_refreshTimer->stop();
+    m_compositor = MosaicCompositor(canvasSize.width(), canvasSize.height());
+    m_compositor.setSeamWidth(m_seamWidth);
+    m_compositor.clear();
+    m_dirty = QRect();
+    m_tilesAdded = 0;
+
+    m_coarse = QImage((canvasSize.width() + COARSE_FACTOR - 1) / COARSE_FACTOR,
+                      (canvasSize.height() + COARSE_FACTOR - 1) / COARSE_FACTOR, PixelFormat::INTERNAL);
+    m_coarse.fill(Qt::black);
+
+    m_preview = QImage(canvasSize.scaled(previewBounds, Qt::KeepAspectRatio), PixelFormat::INTERNAL);
+    m_preview.fill(Qt::black);
+    emit previewUpdated(m_preview);
+}
+
+void ProgressiveMosaic::setMaxFps(int maxFps) {
+    m_refreshTimer->setInterval(1000 / std::max(1, maxFps));
+}
+
+void ProgressiveMosaic::setSeamWidth(int pixels) {
+    m_seamWidth = std::max(0, pixels);
+    m_compositor.setSeamWidth(m_seamWidth);
+}
+
+QRect ProgressiveMosaic::addTile(const QImage& tile, const QPoint& position) {
+    QRect placed = m_compositor.blit(tile, position.x(), position.y());
+    if (placed.isEmpty()) {
+        return placed;
+    }
+
+    m_tilesAdded++;
+    m_dirty = m_dirty.united(placed);
+    updateCoarse(placed);
+
+    // Leading edge: the first tile after a quiet period is shown at once
+    if (!m_refreshTimer->isActive()) {
+        refreshPreview();
+        m_refreshTimer->start();
+    }
+    return placed;
+}
+
+void ProgressiveMosaic::updateCoarse(const QRect& placed) {
+    // Whole blocks around the tile, recomputed from the canvas so partly covered blocks stay exact
+    const int f = COARSE_FACTOR;
+    QRect blocks(placed.x() / f, placed.y() / f,
+                 (placed.right() / f) - (placed.x() / f) + 1, (placed.bottom() / f) - (placed.y() / f) + 1);
+    QRect source = QRect(blocks.x() * f, blocks.y() * f, blocks.width() * f, blocks.height() * f)
+                       .intersected(QRect(0, 0, m_compositor.width(), m_compositor.height()));
+    QImage patch = ImageFilters::boxDownsample(m_compositor.canvas(), f, source);
+
+    const qsizetype rowBytes = qsizetype(patch.width()) * 4;
+    for (int y = 0; y < patch.height(); y++) {
+        memcpy(m_coarse.scanLine(blocks.y() + y) + blocks.x() * 4, patch.constScanLine(y), rowBytes);
+    }
+}
+
+void ProgressiveMosaic::flush() {
+    m_refreshTimer->stop();
+    refreshPreview();
+}
+
+void ProgressiveMosaic::refreshPreview() {
+    if (m_dirty.isEmpty() || m_preview.isNull()) {
+        return;
+    }
+
+    double sx = double(m_preview.width()) / m_compositor.width();
+    double sy = double(m_preview.height()) / m_compositor.height();
+
+    // Preview pixels touched by the dirty area, widened by one for the smoothing filter,
+    // and the canvas area that maps onto exactly those pixels
+    QRect target = QRectF(m_dirty.x() * sx, m_dirty.y() * sy, m_dirty.width() * sx, m_dirty.height() * sy)
+                       .toAlignedRect().adjusted(-1, -1, 1, 1).intersected(m_preview.rect());
+    QRect source = QRectF(target.x() / sx, target.y() / sy, target.width() / sx, target.height() / sy)
+                       .toAlignedRect().intersected(QRect(0, 0, m_compositor.width(), m_compositor.height()));
+    m_dirty = QRect();
+    if (target.isEmpty() || source.isEmpty()) {
+        return;
+    }
+
+    QImage patch = m_compositor.canvas().copy(source)
+                       .scaled(target.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    QPainter painter(&m_preview);
+    painter.drawImage(target.topLeft(), patch);
+    painter.end();
+
+    emit previewUpdated(m_preview);
+}
@@ -0,0 +1,56 @@
+// ProgressiveMosaic.h - Live mosaic canvas filled tile by tile with a rate-limited preview
+#ifndef PROGRESSIVEMOSAIC_H
+#define PROGRESSIVEMOSAIC_H
+
+#include <QObject>
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QTimer>
+#include "MosaicCompositor.h"
+
+// Tiles are blitted into the canvas as soon as they decode. The preview is a downscaled
+// copy of the canvas that is patched only where tiles landed since the last refresh,
+// and refreshes are coalesced so previewUpdated fires at most maxFps times a second.
+// A 1/COARSE_FACTOR box-filtered copy is kept up to date alongside, for analysis that
+// only needs a rough look at the whole field (auto-centering).
+class ProgressiveMosaic : public QObject {
+    Q_OBJECT
+
+public:
+    static const int COARSE_FACTOR = 8;
+
+    explicit ProgressiveMosaic(QObject* parent = nullptr);
+
+    // Starts a new canvas; the preview keeps the canvas aspect ratio within previewBounds
+    void reset(const QSize& canvasSize, const QSize& previewBounds);
+    QRect addTile(const QImage& tile, const QPoint& position);
+
+    void setMaxFps(int maxFps);
+    // Feathers tile boundaries (see MosaicCompositor::setSeamWidth); kept across reset()
+    void setSeamWidth(int pixels);
+    void flush();   // Publishes any pending dirty area immediately
+
+    QImage canvas() const { return m_compositor.canvas(); }
+    QImage preview() const { return m_preview; }
+    QImage coarseCanvas() const { return m_coarse; }
+    int tilesAdded() const { return m_tilesAdded; }
+
+signals:
+    void previewUpdated(const QImage& preview);
+
+private:
+    MosaicCompositor m_compositor;
+    QImage m_preview;
+    QImage m_coarse;        // Canvas box-averaged over COARSE_FACTOR x COARSE_FACTOR blocks
+    QRect m_dirty;          // Canvas coordinates not yet reflected in m_preview
+    QTimer* m_refreshTimer;
+    int m_tilesAdded;
+    int m_seamWidth;
+
+    void refreshPreview();
+    void updateCoarse(const QRect& placed);
+};
+
+#endif // PROGRESSIVEMOSAIC_H
@@ -135,6 +135,23 @@ void ProperHipsClient::setupSurveys() {
         true, 9, {"full_sky"}
     };
     
+    // H and K complete the 2MASS J/H/K set for false-colour channel composites
+    m_surveys["2MASS_H"] = {
+        "2MASS H-band",
+        "http://alasky.u-strasbg.fr/2MASS/H",
+        "jpg",
+        "2MASS H-band (1.65 micron)",
+        true, 9, {"full_sky"}
+    };
+    
+    m_surveys["2MASS_K"] = {
+        "2MASS K-band",
+        "http://alasky.u-strasbg.fr/2MASS/K",
+        "jpg",
+        "2MASS Ks-band (2.17 micron)",
+        true, 9, {"full_sky"}
+    };
+    
     // Test additional surveys with proper HEALPix
     m_surveys["DSS2_Red"] = {
         "DSS2 Red",
@@ -318,6 +335,21 @@ QString ProperHipsClient::buildTileUrl(const QString& surveyName, const SkyPosit
     }
 }
 
+QString ProperHipsClient::buildTileUrlForPixel(const QString& surveyName, long long pixel, int order) const {
+    if (!m_surveys.contains(surveyName) || pixel < 0) {
+        return QString();
+    }
+    
+    const HipsSurveyInfo& survey = m_surveys[surveyName];
+    long long dir = (pixel / 10000) * 10000;
+    return QString("%1/Norder%2/Dir%3/Npix%4.%5")
+           .arg(survey.baseUrl)
+           .arg(order)
+           .arg(dir)
+           .arg(pixel)
+           .arg(survey.format);
+}
+
 void ProperHipsClient::testAllSurveys() {
     qDebug() << "=== Testing All Surveys with Real HEALPix ===";
     qDebug() << "Surveys:" << m_surveys.keys();
@@ -68,6 +68,8 @@ public:
     QStringList getWorkingSurveys() const;
     QString getBestSurveyForPosition(const SkyPosition& position) const;
     QString buildTileUrl(const QString& surveyName, const SkyPosition& position, int order = 6) const;
+    QString buildTileUrlForPixel(const QString& surveyName, long long pixel, int order) const;
+    QString getSurveyFormat(const QString& surveyName) const { return m_surveys.value(surveyName).format; }
     
     // Results access
     QList<TileResult> getResults() const { return m_results; }
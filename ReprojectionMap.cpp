@@ -0,0 +1,72 @@
+// ReprojectionMap.cpp - Precomputed output-pixel -> tile position maps and their bounded cache
+#include "ReprojectionMap.h"
+#include "HipsReprojector.h"
+#include <QDebug>
+#include <QMutexLocker>
+
+ReprojectionMap::ReprojectionMap(const QSize& size, int order, int tileWidth)
+    : m_size(size)
+    , m_order(order)
+    , m_tileWidth(tileWidth) {
+}
+
+qsizetype ReprojectionMap::memoryBytes() const {
+    return m_samples.size() * qsizetype(sizeof(ReprojectionSample))
+         + m_tiles.size() * qsizetype(sizeof(ReprojectionTile));
+}
+
+ReprojectionMapCache* ReprojectionMapCache::instance() {
+    static ReprojectionMapCache cache;
+    return &cache;
+}
+
+ReprojectionMapCache::ReprojectionMapCache(qint64 maxBytes)
+    : m_hits(0)
+    , m_misses(0) {
+    m_maps.setMaxCost(maxBytes);
+}
+
+QString ReprojectionMapCache::keyFor(const TanProjection& projection, int order, int tileWidth) {
+    // Full double precision: maps for almost-equal frames are not interchangeable
+    QRect window = projection.window.isEmpty() ? QRect(QPoint(0, 0), projection.size) : projection.window;
+    return QString("%1,%2,%3,%4x%5,%6[%7,%8 %9x%10]/%11/%12")
+           .arg(projection.centerRaDeg, 0, 'g', 17)
+           .arg(projection.centerDecDeg, 0, 'g', 17)
+           .arg(projection.pixelScaleDeg, 0, 'g', 17)
+           .arg(projection.size.width()).arg(projection.size.height())
+           .arg(projection.rotationDeg, 0, 'g', 17)
+           .arg(window.x()).arg(window.y()).arg(window.width()).arg(window.height())
+           .arg(order).arg(tileWidth);
+}
+
+QSharedPointer<const ReprojectionMap> ReprojectionMapCache::map(const TanProjection& projection, int order, int tileWidth) {
+    QString key = keyFor(projection, order, tileWidth);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (QSharedPointer<const ReprojectionMap>* cached = m_maps.object(key)) {
+            m_hits++;
+            return *cached;
+        }
+        m_misses++;
+    }
+
+    // Built outside the lock; two threads missing at once both build and the last insert wins
+    QSharedPointer<const ReprojectionMap> built = HipsReprojector::buildMap(projection, order, tileWidth);
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_maps.insert(key, new QSharedPointer<const ReprojectionMap>(built), built->memoryBytes())) {
+        qDebug() << QString("ReprojectionMapCache: %1 MB map exceeds the cache limit, not cached")
+                    .arg(built->memoryBytes() / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+    return built;
+}
+
+void ReprojectionMapCache::setMaxBytes(qint64 maxBytes) {
+    QMutexLocker locker(&m_mutex);
+    m_maps.setMaxCost(maxBytes);
+}
+
+void ReprojectionMapCache::clear() {
+    QMutexLocker locker(&m_mutex);
+    m_maps.clear();
+}
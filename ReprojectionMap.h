@@ -0,0 +1,80 @@
+// ReprojectionMap.h - Precomputed output-pixel -> tile position maps and their bounded cache
+#ifndef REPROJECTIONMAP_H
+#define REPROJECTIONMAP_H
+
+#include <QCache>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QSize>
+#include <QString>
+
+struct TanProjection;
+
+// A tile referenced by a map: base face and tile column/row on that face
+struct ReprojectionTile {
+    int face;
+    qint64 tx;
+    qint64 ty;
+    long long nest;
+};
+
+// One output pixel: the tile it falls in and the sample position inside that tile
+// in ReprojectionMap::FRACTION_BITS fixed point, pixel centres on whole numbers
+struct ReprojectionSample {
+    quint32 slot;   // Index into ReprojectionMap::tiles()
+    qint16 u;
+    qint16 v;
+};
+
+// The spherical part of a reprojection, which depends only on output geometry and tile
+// order. Every survey rendered into the same frame reuses it and only runs the sampling pass.
+class ReprojectionMap {
+public:
+    static const int FRACTION_BITS = 6;   // 1/64 pixel; +-512 pixels fits in 16 bits
+
+    ReprojectionMap(const QSize& size, int order, int tileWidth);
+
+    QSize size() const { return m_size; }
+    int order() const { return m_order; }
+    int tileWidth() const { return m_tileWidth; }
+    const QList<ReprojectionTile>& tiles() const { return m_tiles; }
+    const ReprojectionSample* row(int y) const { return m_samples.constData() + qsizetype(y) * m_size.width(); }
+    qsizetype memoryBytes() const;
+
+private:
+    friend class HipsReprojector;
+
+    QSize m_size;
+    int m_order;
+    int m_tileWidth;
+    QList<ReprojectionTile> m_tiles;
+    QList<ReprojectionSample> m_samples;
+};
+
+// Maps keyed by exact geometry and order, bounded by their total size. Shared pointers
+// keep a map alive for renders still using it after it has been evicted.
+class ReprojectionMapCache {
+public:
+    static ReprojectionMapCache* instance();
+
+    explicit ReprojectionMapCache(qint64 maxBytes = 256LL * 1024 * 1024);
+
+    // Returns the cached map or builds (and caches) it
+    QSharedPointer<const ReprojectionMap> map(const TanProjection& projection, int order, int tileWidth);
+
+    void setMaxBytes(qint64 maxBytes);
+    void clear();
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+
+    static QString keyFor(const TanProjection& projection, int order, int tileWidth);
+
+private:
+    QMutex m_mutex;
+    QCache<QString, QSharedPointer<const ReprojectionMap>> m_maps;
+    int m_hits;
+    int m_misses;
+};
+
+#endif // REPROJECTIONMAP_H
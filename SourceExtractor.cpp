@@ -0,0 +1,322 @@
+// SourceExtractor.cpp - Star and compact source detection with flux-weighted centroids
+#include "SourceExtractor.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include <QtConcurrent>
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <vector>
+
+namespace {
+    const int BAND_ROWS = 64;
+
+    void forEachBand(int height, bool multithreaded, const std::function<void(int)>& fn) {
+        QList<int> bands;
+        for (int y = 0; y < height; y += BAND_ROWS) {
+            bands.append(y);
+        }
+        if (multithreaded && bands.size() > 1) {
+            QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, fn);
+        } else {
+            for (int firstRow : bands) {
+                fn(firstRow);
+            }
+        }
+    }
+
+    inline int windowCount(int i, int radius, int length) {
+        return std::min(i + radius, length - 1) - std::max(i - radius, 0) + 1;
+    }
+
+    // Luminance (qGray weights) averaged over the (2 * radius + 1)^2 box, clipped at the edges.
+    // The running sums hold whole numbers well below 2^24, so the float arithmetic is exact.
+    std::vector<float> detectionPlane(const QImage& image, int radius, bool multithreaded) {
+        const QImage source = PixelFormat::toInternal(image, "source extraction");
+        const int width = source.width();
+        const int height = source.height();
+        std::vector<float> rowSums(size_t(width) * height);
+
+        forEachBand(height, multithreaded, [&](int firstRow) {
+            std::vector<float> luminance(width);
+            for (int y = firstRow; y < std::min(height, firstRow + BAND_ROWS); y++) {
+                const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+                float* out = rowSums.data() + size_t(y) * width;
+                for (int x = 0; x < width; x++) {
+                    luminance[x] = float(qGray(line[x]));
+                }
+                float sum = 0.0f;
+                for (int x = 0; x < std::min(radius, width); x++) {
+                    sum += luminance[x];
+                }
+                for (int x = 0; x < width; x++) {
+                    if (x + radius < width) sum += luminance[x + radius];
+                    out[x] = sum;
+                    if (x - radius >= 0) sum -= luminance[x - radius];
+                }
+            }
+        });
+        if (radius == 0) {
+            return rowSums;
+        }
+
+        std::vector<float> columnInverse(width);
+        for (int x = 0; x < width; x++) {
+            columnInverse[x] = 1.0f / windowCount(x, radius, width);
+        }
+
+        std::vector<float> plane(rowSums.size());
+        forEachBand(height, multithreaded, [&](int firstRow) {
+            std::vector<float> sums(width, 0.0f);
+            for (int y = std::max(0, firstRow - radius); y < std::min(height, firstRow + radius); y++) {
+                const float* in = rowSums.data() + size_t(y) * width;
+                for (int x = 0; x < width; x++) sums[x] += in[x];
+            }
+            for (int y = firstRow; y < std::min(height, firstRow + BAND_ROWS); y++) {
+                if (y + radius < height) {
+                    const float* added = rowSums.data() + size_t(y + radius) * width;
+                    for (int x = 0; x < width; x++) sums[x] += added[x];
+                }
+                const float rowInverse = 1.0f / windowCount(y, radius, height);
+                float* out = plane.data() + size_t(y) * width;
+                for (int x = 0; x < width; x++) {
+                    out[x] = sums[x] * rowInverse * columnInverse[x];
+                }
+                if (y - radius >= 0) {
+                    const float* removed = rowSums.data() + size_t(y - radius) * width;
+                    for (int x = 0; x < width; x++) sums[x] -= removed[x];
+                }
+            }
+        });
+        return plane;
+    }
+
+    struct Blob {
+        double flux = 0.0;
+        double sumX = 0.0;
+        double sumY = 0.0;
+        double peak = 0.0;
+        int area = 0;
+        int left = INT_MAX, top = INT_MAX, right = -1, bottom = -1;
+
+        void add(int x, int y, double value) {
+            flux += value;
+            sumX += value * x;
+            sumY += value * y;
+            peak = std::max(peak, value);
+            area++;
+            left = std::min(left, x);
+            top = std::min(top, y);
+            right = std::max(right, x);
+            bottom = std::max(bottom, y);
+        }
+
+        void merge(const Blob& other) {
+            flux += other.flux;
+            sumX += other.sumX;
+            sumY += other.sumY;
+            peak = std::max(peak, other.peak);
+            area += other.area;
+            left = std::min(left, other.left);
+            top = std::min(top, other.top);
+            right = std::max(right, other.right);
+            bottom = std::max(bottom, other.bottom);
+        }
+    };
+
+    // Roots are always the smallest label of their set, so a set's root is seen first when labels are scanned in order
+    int findRoot(std::vector<int>& parent, int label) {
+        while (parent[label] != label) {
+            parent[label] = parent[parent[label]];
+            label = parent[label];
+        }
+        return label;
+    }
+
+    void unite(std::vector<int>& parent, int a, int b) {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if (a != b) {
+            parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    // Local label l > 0 of a tile's pixels refers to blobs[l - 1]; firstLabel numbers them frame-wide
+    struct TileResult {
+        QRect rect;
+        std::vector<Blob> blobs;
+        int firstLabel = 0;
+    };
+}
+
+QList<ExtractedSource> SourceExtractor::extract(const QImage& image, const SourceExtractorOptions& options) {
+    QList<ExtractedSource> sources;
+    if (image.isNull()) {
+        return sources;
+    }
+
+    const bool multithreaded = options.multithreaded;
+    const int width = image.width();
+    const int height = image.height();
+    const std::vector<float> detection = detectionPlane(image, std::clamp(options.filterRadius, 0, 16), multithreaded);
+    const BackgroundModel background = BackgroundModel::estimate(detection.data(), image.size(), options.cellSize,
+                                                                 options.clipSigma, multithreaded);
+    const int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+
+    std::vector<int> labels(size_t(width) * height, 0);
+    std::vector<TileResult> tiles;
+    QList<int> tileIndices;
+    for (int y = 0; y < height; y += TILE_SIZE) {
+        for (int x = 0; x < width; x += TILE_SIZE) {
+            tileIndices.append(int(tiles.size()));
+            tiles.push_back({QRect(x, y, std::min(TILE_SIZE, width - x), std::min(TILE_SIZE, height - y)), {}, 0});
+        }
+    }
+
+    auto labelTile = [&](int index) {
+        TileResult& tile = tiles[index];
+        const QRect rect = tile.rect;
+        const int tileWidth = rect.width();
+        std::vector<float> residual(size_t(tileWidth) * rect.height());
+        std::vector<float> sky(tileWidth), noise(tileWidth);
+        std::vector<int> parent(1, 0);
+
+        // First pass: threshold and provisional labels from the left and upper neighbours
+        for (int row = 0; row < rect.height(); row++) {
+            const int y = rect.y() + row;
+            const float* line = detection.data() + size_t(y) * width + rect.x();
+            background.backgroundRow(y, rect.x(), tileWidth, sky.data());
+            background.noiseRow(y, rect.x(), tileWidth, noise.data());
+            int* labelRow = labels.data() + size_t(y) * width + rect.x();
+            const int* above = row > 0 ? labelRow - width : nullptr;
+            float* values = residual.data() + size_t(row) * tileWidth;
+
+            for (int column = 0; column < tileWidth; column++) {
+                values[column] = line[column] - sky[column];
+                if (values[column] <= options.detectSigma * noise[column]) {
+                    labelRow[column] = 0;
+                    continue;
+                }
+
+                int label = 0;
+                auto join = [&](int neighbour) {
+                    if (neighbour == 0) return;
+                    if (label == 0) label = neighbour;
+                    else unite(parent, label, neighbour);
+                };
+                if (column > 0) join(labelRow[column - 1]);
+                if (above) {
+                    if (column > 0) join(above[column - 1]);
+                    join(above[column]);
+                    if (column + 1 < tileWidth) join(above[column + 1]);
+                }
+                if (label == 0) {
+                    label = int(parent.size());
+                    parent.push_back(label);
+                }
+                labelRow[column] = label;
+            }
+        }
+
+        // Final labels numbered 1..n in order of first appearance
+        std::vector<int> compact(parent.size(), 0);
+        int count = 0;
+        for (int label = 1; label < int(parent.size()); label++) {
+            int root = findRoot(parent, label);
+            if (compact[root] == 0) {
+                compact[root] = ++count;
+            }
+            compact[label] = compact[root];
+        }
+
+        // Second pass: relabel and accumulate the flux moments
+        tile.blobs.assign(count, Blob());
+        for (int row = 0; row < rect.height(); row++) {
+            const int y = rect.y() + row;
+            int* labelRow = labels.data() + size_t(y) * width + rect.x();
+            const float* values = residual.data() + size_t(row) * tileWidth;
+            for (int column = 0; column < tileWidth; column++) {
+                if (labelRow[column] != 0) {
+                    labelRow[column] = compact[labelRow[column]];
+                    tile.blobs[labelRow[column] - 1].add(rect.x() + column, y, values[column]);
+                }
+            }
+        }
+    };
+
+    if (multithreaded && tileIndices.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), tileIndices, labelTile);
+    } else {
+        for (int index : tileIndices) {
+            labelTile(index);
+        }
+    }
+
+    int totalLabels = 0;
+    for (TileResult& tile : tiles) {
+        tile.firstLabel = totalLabels;
+        totalLabels += int(tile.blobs.size());
+    }
+    std::vector<int> parent(totalLabels);
+    for (int label = 0; label < totalLabels; label++) {
+        parent[label] = label;
+    }
+
+    auto frameLabel = [&](int x, int y) {
+        const int local = labels[size_t(y) * width + x];
+        return local == 0 ? -1 : tiles[(y / TILE_SIZE) * tilesX + x / TILE_SIZE].firstLabel + local - 1;
+    };
+
+    // Join sources cut by tile edges: only the pixel pairs straddling an edge are visited
+    for (int edge = TILE_SIZE; edge < width; edge += TILE_SIZE) {
+        for (int y = 0; y < height; y++) {
+            const int left = frameLabel(edge - 1, y);
+            if (left < 0) continue;
+            for (int dy = -1; dy <= 1; dy++) {
+                if (y + dy < 0 || y + dy >= height) continue;
+                const int right = frameLabel(edge, y + dy);
+                if (right >= 0) unite(parent, left, right);
+            }
+        }
+    }
+    for (int edge = TILE_SIZE; edge < height; edge += TILE_SIZE) {
+        for (int x = 0; x < width; x++) {
+            const int upper = frameLabel(x, edge - 1);
+            if (upper < 0) continue;
+            for (int dx = -1; dx <= 1; dx++) {
+                if (x + dx < 0 || x + dx >= width) continue;
+                const int lower = frameLabel(x + dx, edge);
+                if (lower >= 0) unite(parent, upper, lower);
+            }
+        }
+    }
+
+    std::vector<Blob> merged(totalLabels);
+    for (const TileResult& tile : tiles) {
+        for (int local = 0; local < int(tile.blobs.size()); local++) {
+            merged[findRoot(parent, tile.firstLabel + local)].merge(tile.blobs[local]);
+        }
+    }
+
+    for (int label = 0; label < totalLabels; label++) {
+        const Blob& blob = merged[label];
+        if (parent[label] != label || blob.area < options.minArea || blob.flux <= 0.0) {
+            continue;
+        }
+        ExtractedSource source;
+        source.centroid = QPointF(blob.sumX / blob.flux, blob.sumY / blob.flux);
+        source.flux = blob.flux;
+        source.peak = blob.peak;
+        source.area = blob.area;
+        source.bounds = QRect(QPoint(blob.left, blob.top), QPoint(blob.right, blob.bottom));
+        sources.append(source);
+    }
+
+    std::sort(sources.begin(), sources.end(), [](const ExtractedSource& a, const ExtractedSource& b) {
+        return a.flux > b.flux;
+    });
+    if (options.maxSources > 0 && sources.size() > options.maxSources) {
+        sources.resize(options.maxSources);
+    }
+    return sources;
+}
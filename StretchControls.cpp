@@ -0,0 +1,139 @@
+// StretchControls.cpp - Background flatten and display stretch controls shared by the mosaic creators
+#include "StretchControls.h"
+#include "MosaicEngine.h"
+#include <QComboBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QSignalBlocker>
+#include <QSlider>
+#include <algorithm>
+
+StretchControls::StretchControls(MosaicEngine* engine, Qt::Orientation orientation, QWidget* parent)
+    : QWidget(parent), m_engine(engine) {
+    // Plates with different sky levels would otherwise show as a checkerboard
+    m_flattenSelector = new QComboBox(this);
+    for (FlattenMode mode : {FlattenMode::None, FlattenMode::Subtract, FlattenMode::Divide}) {
+        m_flattenSelector->addItem(BackgroundFlattener::modeName(mode), int(mode));
+    }
+    m_flattenSelector->setCurrentIndex(m_flattenSelector->findData(int(FlattenMode::Subtract)));
+    m_flattenSelector->setToolTip("Removes the sky background differences between survey plates");
+
+    m_stretchSelector = new QComboBox(this);
+    for (StretchMode mode : {StretchMode::None, StretchMode::Linear, StretchMode::Log,
+                             StretchMode::Asinh, StretchMode::HistogramEqualize}) {
+        m_stretchSelector->addItem(StretchEngine::modeName(mode), int(mode));
+    }
+    m_stretchSelector->setToolTip("Log and asinh lift faint structure such as spiral arms");
+
+    m_blackSlider = new QSlider(Qt::Horizontal, this);
+    m_blackSlider->setRange(0, 254);
+    m_blackSlider->setValue(0);
+    m_blackSlider->setToolTip("Black point");
+
+    m_whiteSlider = new QSlider(Qt::Horizontal, this);
+    m_whiteSlider->setRange(1, 255);
+    m_whiteSlider->setValue(255);
+    m_whiteSlider->setToolTip("White point");
+
+    m_gammaSlider = new QSlider(Qt::Horizontal, this);
+    m_gammaSlider->setRange(20, 300);  // Gamma x 100
+    m_gammaSlider->setValue(100);
+    m_gammaSlider->setToolTip("Gamma");
+
+    m_autoButton = new QPushButton("Auto levels", this);
+    m_autoButton->setToolTip("Black and white points from the mosaic's histogram");
+    m_stretchLabel = new QLabel("0-255, γ 1.00", this);
+
+    connect(m_flattenSelector, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &StretchControls::applyFlatten);
+    connect(m_stretchSelector, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &StretchControls::applyStretch);
+    connect(m_blackSlider, &QSlider::valueChanged, this, &StretchControls::applyStretch);
+    connect(m_whiteSlider, &QSlider::valueChanged, this, &StretchControls::applyStretch);
+    connect(m_gammaSlider, &QSlider::valueChanged, this, &StretchControls::applyStretch);
+    connect(m_autoButton, &QPushButton::clicked, this, &StretchControls::autoLevels);
+
+    if (orientation == Qt::Horizontal) {
+        QHBoxLayout* layout = new QHBoxLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+        layout->addWidget(new QLabel("Flatten:", this));
+        layout->addWidget(m_flattenSelector);
+        layout->addWidget(new QLabel("Stretch:", this));
+        layout->addWidget(m_stretchSelector);
+        layout->addWidget(m_blackSlider);
+        layout->addWidget(m_whiteSlider);
+        layout->addWidget(m_gammaSlider);
+        layout->addWidget(m_autoButton);
+        layout->addWidget(m_stretchLabel);
+    } else {
+        QFormLayout* layout = new QFormLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+        layout->addRow("Flatten:", m_flattenSelector);
+        layout->addRow("Curve:", m_stretchSelector);
+        layout->addRow("Black:", m_blackSlider);
+        layout->addRow("White:", m_whiteSlider);
+        layout->addRow("Gamma:", m_gammaSlider);
+        layout->addRow(m_autoButton, m_stretchLabel);
+    }
+}
+
+FlattenParams StretchControls::flatten() const {
+    FlattenParams params;
+    params.mode = FlattenMode(m_flattenSelector->currentData().toInt());
+    return params;
+}
+
+StretchParams StretchControls::stretch() const {
+    StretchParams params;
+    params.mode = StretchMode(m_stretchSelector->currentData().toInt());
+    params.black = m_blackSlider->value();
+    params.white = std::max(m_whiteSlider->value(), m_blackSlider->value() + 1);
+    params.gamma = m_gammaSlider->value() / 100.0;
+    return params;
+}
+
+void StretchControls::applyFlatten() {
+    FlattenParams params = flatten();
+    emit flattenChanged(params);
+
+    // The engine re-flattens its retained canvas; before the first render the next one picks it up
+    if (m_engine->reflatten(params)) {
+        applyStretch();
+    }
+}
+
+void StretchControls::applyStretch() {
+    StretchParams params = stretch();
+    m_stretchLabel->setText(QString("%1-%2, γ %3").arg(int(params.black)).arg(int(params.white))
+                            .arg(params.gamma, 0, 'f', 2));
+    emit stretchChanged(params);
+
+    if (m_engine->hasRendered()) {
+        emit restretched(m_engine->restretch(params));
+    }
+}
+
+void StretchControls::autoLevels() {
+    if (!m_engine->hasRendered()) {
+        return;
+    }
+
+    StretchMode mode = StretchMode(m_stretchSelector->currentData().toInt());
+    if (mode == StretchMode::None) {
+        mode = StretchMode::Asinh;
+    }
+    StretchParams params = m_engine->autoLevels(mode);
+
+    // Set every control first so the stretch runs once
+    {
+        const QSignalBlocker blockMode(m_stretchSelector);
+        const QSignalBlocker blockBlack(m_blackSlider);
+        const QSignalBlocker blockWhite(m_whiteSlider);
+        m_stretchSelector->setCurrentIndex(m_stretchSelector->findData(int(mode)));
+        m_blackSlider->setValue(int(params.black));
+        m_whiteSlider->setValue(int(params.white));
+    }
+    applyStretch();
+}
@@ -0,0 +1,52 @@
+// StretchControls.h - Background flatten and display stretch controls shared by the mosaic creators
+#ifndef STRETCHCONTROLS_H
+#define STRETCHCONTROLS_H
+
+#include <QImage>
+#include <QWidget>
+#include "BackgroundFlattener.h"
+#include "StretchEngine.h"
+
+class MosaicEngine;
+class QComboBox;
+class QLabel;
+class QPushButton;
+class QSlider;
+
+// Flatten mode, stretch curve, black/white/gamma sliders and an auto-levels button. Changes
+// are re-applied through the engine to its last rendered frame, without refetching or
+// recompositing, and the result comes back as restretched(). Before the first frame only
+// the signals and the label update; the creator reads flatten()/stretch() into its render
+// request. Horizontal lays the controls out in one row, Vertical as a labelled form.
+class StretchControls : public QWidget {
+    Q_OBJECT
+
+public:
+    StretchControls(MosaicEngine* engine, Qt::Orientation orientation, QWidget* parent = nullptr);
+
+    FlattenParams flatten() const;
+    StretchParams stretch() const;
+
+signals:
+    void flattenChanged(const FlattenParams& params);
+    void stretchChanged(const StretchParams& params);
+    // Stretched mosaic with the overlay drawn on top
+    void restretched(const QImage& mosaic);
+
+private slots:
+    void applyFlatten();
+    void applyStretch();
+    void autoLevels();
+
+private:
+    MosaicEngine* m_engine;
+    QComboBox* m_flattenSelector;
+    QComboBox* m_stretchSelector;
+    QSlider* m_blackSlider;
+    QSlider* m_whiteSlider;
+    QSlider* m_gammaSlider;
+    QPushButton* m_autoButton;
+    QLabel* m_stretchLabel;
+};
+
+#endif // STRETCHCONTROLS_H
@@ -0,0 +1,225 @@
+// StretchEngine.cpp - Display stretches of a linear mosaic through 256-entry lookup tables
+#include "StretchEngine.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include <QList>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+    const int BAND_ROWS = 64;
+
+    QList<int> rowBands(int height) {
+        QList<int> bands;
+        for (int y = 0; y < height; y += BAND_ROWS) {
+            bands.append(y);
+        }
+        return bands;
+    }
+}
+
+StretchEngine::StretchEngine(const QImage& linear, bool multithreaded)
+    : m_linear(linear) {
+    if (!m_linear.isNull()) {
+        m_histogram = levelHistogram(m_linear, multithreaded);
+    }
+}
+
+QImage StretchEngine::apply(const StretchParams& params, bool multithreaded) const {
+    if (isNull() || params.isIdentity()) {
+        return m_linear;
+    }
+    return applyLut(m_linear, buildLut(params, m_histogram), multithreaded);
+}
+
+StretchParams StretchEngine::autoLevels(StretchMode mode, double lowFraction, double highFraction) const {
+    StretchParams params;
+    params.mode = mode;
+
+    qint64 total = 0;
+    for (qint64 count : m_histogram) {
+        total += count;
+    }
+    if (total == 0) {
+        return params;
+    }
+
+    // First levels whose cumulative count reaches each fraction
+    const qint64 lowCount = qint64(std::ceil(total * std::clamp(lowFraction, 0.0, 1.0)));
+    const qint64 highCount = qint64(std::ceil(total * std::clamp(highFraction, 0.0, 1.0)));
+    int black = -1, white = 255;
+    qint64 cumulative = 0;
+    for (int level = 0; level < 256; level++) {
+        cumulative += m_histogram[level];
+        if (black < 0 && cumulative >= lowCount) {
+            black = level;
+        }
+        if (cumulative >= highCount) {
+            white = level;
+            break;
+        }
+    }
+
+    params.black = std::max(0, black);
+    params.white = std::max(params.black + 1.0, double(white));
+    return params;
+}
+
+StretchHistogram StretchEngine::levelHistogram(const QImage& image, bool multithreaded) {
+    StretchHistogram total{};
+    if (image.isNull()) {
+        return total;
+    }
+
+    const QImage source = PixelFormat::toInternal(image, "stretch");
+    const int width = source.width();
+    const QList<int> bands = rowBands(source.height());
+    std::vector<StretchHistogram> histograms(bands.size(), StretchHistogram{});
+
+    auto countBand = [&](int firstRow) {
+        // Three interleaved tables so consecutive increments rarely hit the same counter
+        std::array<std::array<qint64, 256>, 3> counts{};
+        const int lastRow = std::min(source.height(), firstRow + BAND_ROWS);
+        for (int y = firstRow; y < lastRow; y++) {
+            const quint32* in = reinterpret_cast<const quint32*>(source.constScanLine(y));
+            for (int x = 0; x < width; x++) {
+                counts[0][in[x] & 0xFF]++;
+                counts[1][(in[x] >> 8) & 0xFF]++;
+                counts[2][(in[x] >> 16) & 0xFF]++;
+            }
+        }
+        StretchHistogram& histogram = histograms[firstRow / BAND_ROWS];
+        for (int level = 0; level < 256; level++) {
+            histogram[level] = counts[0][level] + counts[1][level] + counts[2][level];
+        }
+    };
+
+    if (multithreaded && bands.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, countBand);
+    } else {
+        for (int firstRow : bands) {
+            countBand(firstRow);
+        }
+    }
+
+    for (const StretchHistogram& band : histograms) {
+        for (int level = 0; level < 256; level++) {
+            total[level] += band[level];
+        }
+    }
+    return total;
+}
+
+StretchLut StretchEngine::buildLut(const StretchParams& params, const StretchHistogram& histogram) {
+    StretchLut lut;
+    if (params.isIdentity()) {
+        for (int level = 0; level < 256; level++) {
+            lut[level] = quint8(level);
+        }
+        return lut;
+    }
+
+    const double black = std::clamp(params.black, 0.0, 254.0);
+    const double range = std::max(1.0, std::min(params.white, 255.0) - black);
+    const double exponent = 1.0 / std::max(1e-3, params.gamma);
+    const double strength = std::max(1e-3, params.strength);
+
+    // Equalization spreads the levels between the black and white points by their share
+    // of the samples there; levels outside clip as in the other modes
+    std::array<double, 256> cdf{};
+    if (params.mode == StretchMode::HistogramEqualize) {
+        const int first = int(std::ceil(black));
+        const int last = int(std::floor(black + range));
+        qint64 cumulative = 0;
+        for (int level = first; level <= last; level++) {
+            cumulative += histogram[level];
+            cdf[level] = double(cumulative);
+        }
+        for (int level = first; level <= last; level++) {
+            cdf[level] = cumulative > 0 ? cdf[level] / cumulative : (level - black) / range;
+        }
+        for (int level = last + 1; level < 256; level++) {
+            cdf[level] = 1.0;
+        }
+    }
+
+    for (int level = 0; level < 256; level++) {
+        double t = std::clamp((level - black) / range, 0.0, 1.0);
+        switch (params.mode) {
+        case StretchMode::Log:
+            t = std::log1p(strength * t) / std::log1p(strength);
+            break;
+        case StretchMode::Asinh:
+            t = std::asinh(strength * t) / std::asinh(strength);
+            break;
+        case StretchMode::HistogramEqualize:
+            t = cdf[level];
+            break;
+        default:
+            break;
+        }
+        lut[level] = quint8(std::lround(255.0 * std::pow(std::clamp(t, 0.0, 1.0), exponent)));
+    }
+    return lut;
+}
+
+QImage StretchEngine::applyLut(const QImage& image, const StretchLut& lut, bool multithreaded) {
+    if (image.isNull()) {
+        return QImage();
+    }
+
+    // One table per channel with the level already shifted into place, so each pixel is
+    // three loads and two ORs
+    std::array<quint32, 256> blue, green, red;
+    for (int level = 0; level < 256; level++) {
+        blue[level] = lut[level];
+        green[level] = quint32(lut[level]) << 8;
+        red[level] = (quint32(lut[level]) << 16) | 0xFF000000u;
+    }
+
+    const QImage source = PixelFormat::toInternal(image, "stretch");
+    QImage output(source.size(), QImage::Format_RGB32);
+    if (output.isNull()) {
+        return output;
+    }
+    const int width = source.width();
+    // Rows are addressed from one bits() pointer; the non-const scanLine() may detach, which
+    // is not safe to call from several workers at once
+    uchar* base = output.bits();
+    const qsizetype stride = output.bytesPerLine();
+
+    auto stretchBand = [&](int firstRow) {
+        const int lastRow = std::min(source.height(), firstRow + BAND_ROWS);
+        for (int y = firstRow; y < lastRow; y++) {
+            const quint32* in = reinterpret_cast<const quint32*>(source.constScanLine(y));
+            quint32* out = reinterpret_cast<quint32*>(base + y * stride);
+            for (int x = 0; x < width; x++) {
+                const quint32 pixel = in[x];
+                out[x] = red[(pixel >> 16) & 0xFF] | green[(pixel >> 8) & 0xFF] | blue[pixel & 0xFF];
+            }
+        }
+    };
+
+    const QList<int> bands = rowBands(source.height());
+    if (multithreaded && bands.size() > 1) {
+        QtConcurrent::blockingMap(MosaicRenderer::pool(), bands, stretchBand);
+    } else {
+        for (int firstRow : bands) {
+            stretchBand(firstRow);
+        }
+    }
+    return output;
+}
+
+QString StretchEngine::modeName(StretchMode mode) {
+    switch (mode) {
+    case StretchMode::None: return "Survey";
+    case StretchMode::Linear: return "Linear";
+    case StretchMode::Log: return "Log";
+    case StretchMode::Asinh: return "Asinh";
+    case StretchMode::HistogramEqualize: return "Histogram equalize";
+    }
+    return QString();
+}
@@ -0,0 +1,61 @@
+// StretchEngine.h - Display stretches of a linear mosaic through 256-entry lookup tables
+#ifndef STRETCHENGINE_H
+#define STRETCHENGINE_H
+
+#include <QImage>
+#include <QString>
+#include <array>
+
+enum class StretchMode {
+    None,               // Survey JPEG levels as delivered
+    Linear,
+    Log,
+    Asinh,
+    HistogramEqualize
+};
+
+struct StretchParams {
+    StretchMode mode = StretchMode::None;
+    double black = 0.0;         // Input level shown as black
+    double white = 255.0;       // Input level shown at full intensity
+    double gamma = 1.0;         // Above 1 lifts faint structure
+    double strength = 20.0;     // Log/asinh: how hard faint levels are pulled up
+
+    bool isIdentity() const { return mode == StretchMode::None; }
+};
+
+using StretchLut = std::array<quint8, 256>;
+using StretchHistogram = std::array<qint64, 256>;
+
+// Holds the linear mosaic (shared, not copied) and its level histogram, so moving a
+// slider only rebuilds the 256-entry table and runs one lookup pass over the pixels.
+// The same curve is applied to R, G and B, which keeps the survey's colour balance.
+class StretchEngine {
+public:
+    StretchEngine() = default;
+    explicit StretchEngine(const QImage& linear, bool multithreaded = true);
+
+    bool isNull() const { return m_linear.isNull(); }
+    QImage linear() const { return m_linear; }
+    const StretchHistogram& histogram() const { return m_histogram; }
+
+    QImage apply(const StretchParams& params, bool multithreaded = true) const;
+
+    // Black and white points leaving the given fractions of samples below and above them
+    StretchParams autoLevels(StretchMode mode, double lowFraction = 0.001, double highFraction = 0.999) const;
+
+    // R, G and B samples counted together; alpha is ignored
+    static StretchHistogram levelHistogram(const QImage& image, bool multithreaded = true);
+    // histogram is only read for HistogramEqualize
+    static StretchLut buildLut(const StretchParams& params, const StretchHistogram& histogram = StretchHistogram());
+    // Format_RGB32 result with alpha forced opaque; row bands run on the render pool
+    static QImage applyLut(const QImage& image, const StretchLut& lut, bool multithreaded = true);
+
+    static QString modeName(StretchMode mode);
+
+private:
+    QImage m_linear;
+    StretchHistogram m_histogram{};
+};
+
+#endif // STRETCHENGINE_H
@@ -0,0 +1,228 @@
+// StripImageWriter.cpp - Streams an image to a TIFF/BigTIFF file one horizontal strip at a time
+#include "StripImageWriter.h"
+#include "PixelFormat.h"
+#include <QDataStream>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+    const quint16 TIFF_SHORT = 3;
+    const quint16 TIFF_LONG = 4;
+    const quint16 TIFF_LONG8 = 16;
+    const quint64 CLASSIC_LIMIT = 0xFFFFFFFFULL;
+
+    struct TiffEntry {
+        quint16 tag;
+        quint16 type;
+        quint64 count;
+        QByteArray payload;     // Little-endian values
+        quint64 offset;         // Where the payload went when it does not fit in the entry
+    };
+
+    QByteArray encodeValues(const QList<quint64>& values, quint16 type) {
+        QByteArray bytes;
+        QDataStream out(&bytes, QIODevice::WriteOnly);
+        out.setByteOrder(QDataStream::LittleEndian);
+        for (quint64 value : values) {
+            switch (type) {
+                case TIFF_SHORT: out << quint16(value); break;
+                case TIFF_LONG:  out << quint32(value); break;
+                default:         out << quint64(value); break;
+            }
+        }
+        return bytes;
+    }
+
+    TiffEntry entry(quint16 tag, quint16 type, const QList<quint64>& values) {
+        return {tag, type, quint64(values.size()), encodeValues(values, type), 0};
+    }
+}
+
+StripImageWriter::StripImageWriter(const QString& fileName, const QSize& size, int rowsPerStrip, Format format)
+    : m_file(fileName)
+    , m_size(size)
+    , m_rowsPerStrip(std::max(1, rowsPerStrip))
+    , m_rowsWritten(0) {
+
+    // Pixel data plus two offsets per strip and a little for the directory
+    quint64 strips = size.height() > 0 ? (quint64(size.height()) + m_rowsPerStrip - 1) / m_rowsPerStrip : 0;
+    quint64 estimated = quint64(std::max(0, size.width())) * quint64(std::max(0, size.height())) * 3
+                      + strips * 16 + 4096;
+    m_bigTiff = format == Format::BigTiff || (format == Format::Auto && estimated > CLASSIC_LIMIT);
+}
+
+bool StripImageWriter::fail(const QString& message) {
+    m_error = message;
+    qDebug() << QString("❌ StripImageWriter: %1").arg(message);
+    if (m_file.isOpen()) {
+        m_file.cancelWriting();
+    }
+    return false;
+}
+
+bool StripImageWriter::pad(int alignment) {
+    qint64 remainder = m_file.pos() % alignment;
+    if (remainder == 0) {
+        return true;
+    }
+    QByteArray zeros(alignment - remainder, '\0');
+    if (m_file.write(zeros) != zeros.size()) {
+        return fail(m_file.errorString());
+    }
+    return true;
+}
+
+bool StripImageWriter::open() {
+    if (m_size.isEmpty()) {
+        return fail("image size is empty");
+    }
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        return fail(QString("cannot open %1: %2").arg(m_file.fileName(), m_file.errorString()));
+    }
+
+    // The directory offset is patched in by finish()
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << quint8('I') << quint8('I');
+    if (m_bigTiff) {
+        out << quint16(43) << quint16(8) << quint16(0) << quint64(0);
+    } else {
+        out << quint16(42) << quint32(0);
+    }
+    if (m_file.write(header) != header.size()) {
+        return fail(m_file.errorString());
+    }
+
+    m_rowsWritten = 0;
+    m_stripOffsets.clear();
+    m_stripByteCounts.clear();
+    return true;
+}
+
+bool StripImageWriter::writeStrip(const QImage& strip) {
+    if (!m_file.isOpen()) {
+        return fail("writer is not open");
+    }
+
+    int expectedRows = std::min(m_rowsPerStrip, m_size.height() - m_rowsWritten);
+    if (strip.width() != m_size.width() || strip.height() != expectedRows) {
+        return fail(QString("strip at row %1 is %2x%3, expected %4x%5")
+                    .arg(m_rowsWritten).arg(strip.width()).arg(strip.height())
+                    .arg(m_size.width()).arg(expectedRows));
+    }
+
+    const qint64 rowBytes = qint64(m_size.width()) * 3;
+    quint64 offset = m_file.pos();
+    quint64 byteCount = quint64(rowBytes) * expectedRows;
+    if (!m_bigTiff && offset + byteCount > CLASSIC_LIMIT) {
+        return fail("image data passes 4 GB; write it as BigTIFF");
+    }
+
+    // Packed to RGB one row at a time, so the strip is never copied into an RGB888 image
+    const QImage source = PixelFormat::toInternal(strip, "tiff strip");
+    QByteArray packed(rowBytes, Qt::Uninitialized);
+    for (int y = 0; y < source.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        char* out = packed.data();
+        for (int x = 0; x < source.width(); ++x) {
+            out[3 * x] = char(qRed(line[x]));
+            out[3 * x + 1] = char(qGreen(line[x]));
+            out[3 * x + 2] = char(qBlue(line[x]));
+        }
+        if (m_file.write(packed) != rowBytes) {
+            return fail(m_file.errorString());
+        }
+    }
+
+    m_stripOffsets.append(offset);
+    m_stripByteCounts.append(byteCount);
+    m_rowsWritten += expectedRows;
+    return true;
+}
+
+bool StripImageWriter::writeDirectory() {
+    const int inlineBytes = m_bigTiff ? 8 : 4;
+    const quint16 offsetType = m_bigTiff ? TIFF_LONG8 : TIFF_LONG;
+
+    // Baseline RGB tags, in ascending tag order as TIFF requires
+    QList<TiffEntry> entries = {
+        entry(256, TIFF_LONG, {quint64(m_size.width())}),       // ImageWidth
+        entry(257, TIFF_LONG, {quint64(m_size.height())}),      // ImageLength
+        entry(258, TIFF_SHORT, {8, 8, 8}),                      // BitsPerSample
+        entry(259, TIFF_SHORT, {1}),                            // Compression: none
+        entry(262, TIFF_SHORT, {2}),                            // PhotometricInterpretation: RGB
+        entry(273, offsetType, m_stripOffsets),                 // StripOffsets
+        entry(277, TIFF_SHORT, {3}),                            // SamplesPerPixel
+        entry(278, TIFF_LONG, {quint64(m_rowsPerStrip)}),       // RowsPerStrip
+        entry(279, offsetType, m_stripByteCounts),              // StripByteCounts
+        entry(284, TIFF_SHORT, {1})                             // PlanarConfiguration: chunky
+    };
+
+    // Arrays too large for their entry go in front of the directory
+    for (TiffEntry& e : entries) {
+        if (e.payload.size() > inlineBytes) {
+            if (!pad(2)) return false;
+            e.offset = m_file.pos();
+            if (m_file.write(e.payload) != e.payload.size()) {
+                return fail(m_file.errorString());
+            }
+        }
+    }
+
+    if (!pad(m_bigTiff ? 8 : 2)) return false;
+    quint64 directoryOffset = m_file.pos();
+    if (!m_bigTiff && directoryOffset > CLASSIC_LIMIT) {
+        return fail("TIFF directory passes 4 GB; write it as BigTIFF");
+    }
+
+    QByteArray directory;
+    QDataStream out(&directory, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    if (m_bigTiff) {
+        out << quint64(entries.size());
+    } else {
+        out << quint16(entries.size());
+    }
+    for (const TiffEntry& e : entries) {
+        out << e.tag << e.type;
+        if (m_bigTiff) {
+            out << quint64(e.count);
+        } else {
+            out << quint32(e.count);
+        }
+        QByteArray value = e.payload.size() > inlineBytes ? encodeValues({e.offset}, offsetType)
+                                                          : e.payload.leftJustified(inlineBytes, '\0');
+        out.writeRawData(value.constData(), value.size());
+    }
+    if (m_bigTiff) {
+        out << quint64(0);      // No further directories
+    } else {
+        out << quint32(0);
+    }
+    if (m_file.write(directory) != directory.size()) {
+        return fail(m_file.errorString());
+    }
+
+    QByteArray pointer = encodeValues({directoryOffset}, offsetType);
+    if (!m_file.seek(m_bigTiff ? 8 : 4) || m_file.write(pointer) != pointer.size()) {
+        return fail(m_file.errorString());
+    }
+    return true;
+}
+
+bool StripImageWriter::finish() {
+    if (!m_file.isOpen()) {
+        return fail("writer is not open");
+    }
+    if (m_rowsWritten != m_size.height()) {
+        return fail(QString("only %1 of %2 rows were written").arg(m_rowsWritten).arg(m_size.height()));
+    }
+    if (!writeDirectory()) {
+        return false;
+    }
+    if (!m_file.commit()) {
+        return fail(QString("cannot save %1: %2").arg(m_file.fileName(), m_file.errorString()));
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+// StripImageWriter.h - Streams an image to a TIFF/BigTIFF file one horizontal strip at a time
+#ifndef STRIPIMAGEWRITER_H
+#define STRIPIMAGEWRITER_H
+
+#include <QImage>
+#include <QList>
+#include <QSaveFile>
+#include <QSize>
+#include <QString>
+
+// Uncompressed 8-bit RGB TIFF written top to bottom: pixel data goes straight to disk as
+// each strip arrives and the directory is appended at the end, so only the current strip
+// is ever held in memory. Files that would pass 4 GB are written as BigTIFF.
+class StripImageWriter {
+public:
+    enum class Format {
+        Auto,       // BigTIFF only when classic TIFF offsets would overflow
+        Tiff,
+        BigTiff
+    };
+
+    StripImageWriter(const QString& fileName, const QSize& size, int rowsPerStrip, Format format = Format::Auto);
+
+    bool open();
+
+    // Strips arrive in order; each is rowsPerStrip rows high except possibly the last
+    bool writeStrip(const QImage& strip);
+
+    // Writes the directory and atomically replaces the target file
+    bool finish();
+
+    QSize size() const { return m_size; }
+    int rowsPerStrip() const { return m_rowsPerStrip; }
+    int rowsWritten() const { return m_rowsWritten; }
+    bool isBigTiff() const { return m_bigTiff; }
+    QString errorString() const { return m_error; }
+
+private:
+    QSaveFile m_file;
+    QSize m_size;
+    int m_rowsPerStrip;
+    bool m_bigTiff;
+    int m_rowsWritten;
+    QList<quint64> m_stripOffsets;
+    QList<quint64> m_stripByteCounts;
+    QString m_error;
+
+    bool fail(const QString& message);
+    bool pad(int alignment);
+    bool writeDirectory();
+};
+
+#endif // STRIPIMAGEWRITER_H
@@ -0,0 +1,512 @@
+// TileCache.cpp - On-disk HiPS tile cache with HTTP revalidation metadata
+#include "TileCache.h"
+#include "TileCacheIndex.h"
+#include "TileMemoryCache.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QRegularExpression>
+
+namespace {
+    const qint64 DEFAULT_REVALIDATE_SECS = 7 * 24 * 3600;  // One week between conditional GETs
+    const qint64 DEFAULT_MISSING_TTL_SECS = 24 * 3600;     // Surveys do get backfilled, retry daily
+    const qint64 MIN_TILE_BYTES = 1024;                     // Smaller files are truncated downloads
+    const int INDEX_SAVE_INTERVAL = 64;                     // Index writes are batched
+
+    QString tilePathUnder(const QString& rootDir, const TileKey& key) {
+        long long dir = (key.pixel / 10000) * 10000;
+        return QString("%1/%2/Norder%3/Dir%4/Npix%5.%6")
+               .arg(rootDir)
+               .arg(key.survey)
+               .arg(key.order)
+               .arg(dir)
+               .arg(key.pixel)
+               .arg(key.format);
+    }
+
+    TileHttpMetadata readSidecar(const QString& path) {
+        TileHttpMetadata meta;
+
+        QFile file(path);
+        if (file.open(QIODevice::ReadOnly)) {
+            QJsonObject obj = QJsonDocument::fromJson(file.readAll()).object();
+            meta.etag = obj.value("etag").toString();
+            meta.lastModified = obj.value("lastModified").toString();
+            meta.expires = QDateTime::fromString(obj.value("expires").toString(), Qt::ISODate);
+            meta.fetchedAt = QDateTime::fromString(obj.value("fetchedAt").toString(), Qt::ISODate);
+            meta.validatedAt = QDateTime::fromString(obj.value("validatedAt").toString(), Qt::ISODate);
+        }
+        return meta;
+    }
+
+    // Outcome of checking the index against the files on disk, applied on the owning thread
+    struct IndexScanResult {
+        QList<QPair<TileKey, TileIndexEntry>> updated;
+        QList<TileKey> dropped;
+        int checked = 0;
+        int discovered = 0;
+    };
+
+    // Re-reads every indexed tile and verifies size and checksum, then picks up
+    // tiles written by older versions or other tools that the index has never seen
+    IndexScanResult scanCacheDirectory(const QString& rootDir,
+                                       const QHash<TileKey, TileIndexEntry>& snapshot,
+                                       const std::atomic<bool>& cancelled) {
+        IndexScanResult result;
+
+        for (auto it = snapshot.constBegin(); it != snapshot.constEnd() && !cancelled; ++it) {
+            result.checked++;
+
+            QFile file(tilePathUnder(rootDir, it.key()));
+            QByteArray data;
+            if (file.open(QIODevice::ReadOnly)) {
+                data = file.readAll();
+            }
+
+            if (data.size() != qsizetype(it.value().size) ||
+                TileCacheIndex::checksum(data) != it.value().checksum) {
+                result.dropped.append(it.key());
+            } else if (!it.value().validated) {
+                TileIndexEntry entry = it.value();
+                entry.validated = true;
+                result.updated.append({it.key(), entry});
+            }
+        }
+
+        QRegularExpression tilePattern("^([^/]+)/Norder(\\d+)/Dir\\d+/Npix(\\d+)\\.(jpg|png)$");
+        QDir root(rootDir);
+        QDirIterator dirIt(rootDir, {"Npix*.jpg", "Npix*.png"}, QDir::Files, QDirIterator::Subdirectories);
+
+        while (dirIt.hasNext() && !cancelled) {
+            QString path = dirIt.next();
+            QRegularExpressionMatch match = tilePattern.match(root.relativeFilePath(path));
+            if (!match.hasMatch()) continue;
+
+            TileKey key = {match.captured(1), match.captured(2).toInt(),
+                           match.captured(3).toLongLong(), match.captured(4)};
+            if (snapshot.contains(key)) continue;
+
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly)) continue;
+            QByteArray data = file.readAll();
+            if (data.size() < MIN_TILE_BYTES || !TileCache::isValidImageData(data)) continue;
+
+            TileIndexEntry entry;
+            entry.size = quint32(data.size());
+            entry.checksum = TileCacheIndex::checksum(data);
+            entry.validated = true;
+            entry.http = readSidecar(path + ".meta");
+
+            // Tiles cached before metadata existed count as validated when they were written
+            if (!entry.http.validatedAt.isValid()) {
+                entry.http.validatedAt = QFileInfo(path).lastModified().toUTC();
+                entry.http.fetchedAt = entry.http.validatedAt;
+            }
+
+            result.updated.append({key, entry});
+            result.discovered++;
+        }
+
+        return result;
+    }
+}
+
+TileCache::TileCache(const QString& rootDir, QObject* parent)
+    : QObject(parent), m_rootDir(rootDir), m_revalidateAfterSecs(DEFAULT_REVALIDATE_SECS),
+      m_missingTtlSecs(DEFAULT_MISSING_TTL_SECS),
+      m_indexComplete(false), m_unsavedChanges(0),
+      m_scanCancelled(new std::atomic<bool>(false)) {
+    QDir().mkpath(m_rootDir);
+
+    // One read brings the whole index into memory; the scan below keeps it honest
+    m_index = new TileCacheIndex(m_rootDir + "/cache_index.bin");
+    if (m_index->load()) {
+        qDebug() << QString("📇 Tile cache index: %1 entries, %2 known missing")
+                    .arg(m_index->size()).arg(m_index->missingCount());
+    }
+
+    m_memoryCache = new TileMemoryCache();
+
+    m_scanPool = new QThreadPool(this);
+    m_scanPool->setMaxThreadCount(1);
+    startBackgroundRevalidation();
+}
+
+TileCache::~TileCache() {
+    *m_scanCancelled = true;
+    m_scanPool->waitForDone();
+
+    if (m_index->isDirty()) {
+        m_index->save();
+    }
+    delete m_index;
+    delete m_memoryCache;
+}
+
+void TileCache::startBackgroundRevalidation() {
+    QHash<TileKey, TileIndexEntry> snapshot;
+    for (const TileKey& key : m_index->keys()) {
+        snapshot.insert(key, *m_index->find(key));
+    }
+
+    QString rootDir = m_rootDir;
+    QSharedPointer<std::atomic<bool>> cancelled = m_scanCancelled;
+    QPointer<TileCache> guard(this);
+
+    m_scanPool->start([=]() {
+        IndexScanResult result = scanCacheDirectory(rootDir, snapshot, *cancelled);
+        if (*cancelled) return;
+
+        QMetaObject::invokeMethod(guard, [guard, result, snapshot]() {
+            if (!guard) return;
+            TileCache* cache = guard.data();
+
+            for (const TileKey& key : result.dropped) {
+                // Only drop what we actually checked; a fresh download replaces the entry
+                const TileIndexEntry* current = cache->m_index->find(key);
+                if (current && current->checksum == snapshot.value(key).checksum) {
+                    cache->m_index->remove(key);
+                    cache->m_memoryCache->remove(key);
+                }
+            }
+            for (const auto& update : result.updated) {
+                // A download that landed during the scan is newer than what we found on disk
+                const TileIndexEntry* current = cache->m_index->find(update.first);
+                if (current && current->http.fetchedAt > update.second.http.fetchedAt) continue;
+                // So is a 404 or blank tile, which removed the file we read
+                if (cache->m_index->missingSince(update.first).isValid()) continue;
+                if (!QFile::exists(cache->tilePath(update.first))) continue;
+                cache->m_index->insert(update.first, update.second);
+            }
+
+            cache->m_index->pruneMissing(QDateTime::currentDateTimeUtc().addSecs(-cache->m_missingTtlSecs));
+            cache->m_indexComplete = true;
+            if (cache->m_index->isDirty()) {
+                cache->flushIndex();
+            }
+
+            if (!result.dropped.isEmpty() || result.discovered > 0) {
+                qDebug() << QString("📇 Tile cache revalidated: %1 checked, %2 dropped, %3 discovered")
+                            .arg(result.checked).arg(result.dropped.size()).arg(result.discovered);
+            }
+            emit cache->revalidationFinished(result.checked, result.dropped.size(), result.discovered);
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool TileCache::flushIndex() {
+    m_unsavedChanges = 0;
+    return m_index->save();
+}
+
+void TileCache::noteIndexChange() {
+    if (++m_unsavedChanges >= INDEX_SAVE_INTERVAL) {
+        flushIndex();
+    }
+}
+
+QString TileCache::tilePath(const TileKey& key) const {
+    return tilePathUnder(m_rootDir, key);
+}
+
+QString TileCache::metadataPath(const TileKey& key) const {
+    return tilePath(key) + ".meta";
+}
+
+bool TileCache::isValidImageData(const QByteArray& data) {
+    if (data.size() < 4) return false;
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.constData());
+
+    // JPEG files start with FF D8 FF
+    if (bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF) return true;
+
+    // PNG files start with 89 'P' 'N' 'G'
+    if (bytes[0] == 0x89 && bytes[1] == 'P' && bytes[2] == 'N' && bytes[3] == 'G') return true;
+
+    return false;
+}
+
+bool TileCache::hasValidTile(const TileKey& key) const {
+    const TileIndexEntry* entry = m_index->find(key);
+    if (entry) {
+        return entry->validated && !entry->stats.isBlank();
+    }
+
+    // Until the startup scan finishes, a miss may just be a tile the index has not seen yet
+    return !m_indexComplete && hasValidTileOnDisk(key);
+}
+
+bool TileCache::hasValidTileOnDisk(const TileKey& key) const {
+    QFileInfo fileInfo(tilePath(key));
+    if (!fileInfo.exists() || fileInfo.size() < MIN_TILE_BYTES) {
+        return false;
+    }
+
+    QFile file(fileInfo.filePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    return isValidImageData(file.read(4));
+}
+
+TileHttpMetadata TileCache::metadata(const TileKey& key) const {
+    const TileIndexEntry* entry = m_index->find(key);
+    if (entry) {
+        return entry->http;
+    }
+
+    TileHttpMetadata meta = readSidecar(metadataPath(key));
+
+    // Tiles cached before metadata existed count as validated when they were written
+    if (!meta.validatedAt.isValid()) {
+        QFileInfo fileInfo(tilePath(key));
+        if (fileInfo.exists()) {
+            meta.validatedAt = fileInfo.lastModified();
+            meta.fetchedAt = meta.validatedAt;
+        }
+    }
+
+    return meta;
+}
+
+bool TileCache::writeMetadata(const TileKey& key, const TileHttpMetadata& meta) const {
+    QJsonObject obj;
+    obj["etag"] = meta.etag;
+    obj["lastModified"] = meta.lastModified;
+    obj["expires"] = meta.expires.toString(Qt::ISODate);
+    obj["fetchedAt"] = meta.fetchedAt.toString(Qt::ISODate);
+    obj["validatedAt"] = meta.validatedAt.toString(Qt::ISODate);
+
+    QSaveFile file(metadataPath(key));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+bool TileCache::isFresh(const TileKey& key) const {
+    TileHttpMetadata meta = metadata(key);
+    if (!meta.validatedAt.isValid()) {
+        return false;
+    }
+
+    // The local TTL is a floor so servers sending no-cache do not cost a request per tile
+    QDateTime freshUntil = meta.validatedAt.addSecs(m_revalidateAfterSecs);
+    if (meta.expires.isValid() && meta.expires > freshUntil) {
+        freshUntil = meta.expires;
+    }
+
+    return QDateTime::currentDateTimeUtc() < freshUntil;
+}
+
+QByteArray TileCache::readTileFromDisk(const TileKey& key) const {
+    QFile file(tilePath(key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+QByteArray TileCache::readTile(const TileKey& key) const {
+    QByteArray data = m_memoryCache->bytes(key);
+    if (!data.isEmpty()) {
+        return data;
+    }
+
+    data = readTileFromDisk(key);
+    if (!data.isEmpty()) {
+        m_memoryCache->insertBytes(key, data);
+    }
+    return data;
+}
+
+QImage TileCache::loadTile(const TileKey& key) const {
+    QImage image = m_memoryCache->image(key);
+    if (!image.isNull()) {
+        return image;
+    }
+
+    QByteArray data = readTileFromDisk(key);
+    if (data.isEmpty()) {
+        return QImage();
+    }
+    return m_memoryCache->insertAndDecode(key, data);
+}
+
+void TileCache::markMissing(const TileKey& key) {
+    // The stale copy goes too, so neither the disk fallback nor the background scan revives it
+    m_index->markMissing(key, QDateTime::currentDateTimeUtc());
+    m_memoryCache->remove(key);
+    QFile::remove(tilePath(key));
+    QFile::remove(metadataPath(key));
+    noteIndexChange();
+}
+
+bool TileCache::isKnownMissing(const TileKey& key) const {
+    QDateTime since = m_index->missingSince(key);
+    return since.isValid() && since.addSecs(m_missingTtlSecs) > QDateTime::currentDateTimeUtc();
+}
+
+bool TileCache::recordStats(const TileKey& key, const TileStats& stats) {
+    // A blank tile is a miss: markMissing drops its entry and its files
+    if (stats.isBlank()) {
+        markMissing(key);
+        return true;
+    }
+
+    const TileIndexEntry* existing = m_index->find(key);
+    // Tiles served again from the cache measure the same; only new measurements dirty the index
+    if (existing && !existing->stats.measured) {
+        TileIndexEntry entry = *existing;
+        entry.stats = stats;
+        m_index->insert(key, entry);
+        noteIndexChange();
+    }
+    return false;
+}
+
+TileStats TileCache::stats(const TileKey& key) const {
+    const TileIndexEntry* entry = m_index->find(key);
+    return entry ? entry->stats : TileStats();
+}
+
+QString TileCache::selectSurvey(const QStringList& surveyPriority, int order, long long pixel) const {
+    for (const QString& survey : surveyPriority) {
+        if (!isKnownMissing({survey, order, pixel})) {
+            return survey;
+        }
+    }
+    return QString();
+}
+
+void TileCache::prepareRequest(const TileKey& key, QNetworkRequest& request) const {
+    if (!hasValidTile(key)) {
+        return;
+    }
+
+    TileHttpMetadata meta = metadata(key);
+    if (!meta.etag.isEmpty()) {
+        request.setRawHeader("If-None-Match", meta.etag.toUtf8());
+    }
+    if (!meta.lastModified.isEmpty()) {
+        request.setRawHeader("If-Modified-Since", meta.lastModified.toUtf8());
+    }
+}
+
+void TileCache::updateValidators(TileHttpMetadata& meta, QNetworkReply* reply, const QDateTime& now) const {
+    QByteArray etag = reply->rawHeader("ETag");
+    if (!etag.isEmpty()) {
+        meta.etag = QString::fromUtf8(etag);
+    }
+
+    QByteArray lastModified = reply->rawHeader("Last-Modified");
+    if (!lastModified.isEmpty()) {
+        meta.lastModified = QString::fromUtf8(lastModified);
+    }
+
+    // Cache-Control max-age takes precedence over Expires (RFC 9111)
+    QString cacheControl = QString::fromUtf8(reply->rawHeader("Cache-Control"));
+    QRegularExpressionMatch maxAge = QRegularExpression("max-age=(\\d+)").match(cacheControl);
+    if (maxAge.hasMatch()) {
+        meta.expires = now.addSecs(maxAge.captured(1).toLongLong());
+    } else {
+        QByteArray expires = reply->rawHeader("Expires");
+        if (!expires.isEmpty()) {
+            meta.expires = QDateTime::fromString(QString::fromUtf8(expires), Qt::RFC2822Date);
+        }
+    }
+
+    meta.validatedAt = now;
+}
+
+TileCache::FetchOutcome TileCache::storeReply(const TileKey& key, QNetworkReply* reply, QByteArray* payload) {
+    if (!reply) {
+        return FetchOutcome::Failed;
+    }
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    // The survey has no tile here; timeouts and 5xx stay retryable
+    if (httpStatus == 404 || httpStatus == 410) {
+        markMissing(key);
+        return FetchOutcome::Missing;
+    }
+
+    if (reply->error() != QNetworkReply::NoError) {
+        return FetchOutcome::Failed;
+    }
+
+    if (httpStatus == 304) {
+        // Server confirmed our copy: refresh the validators, keep the payload
+        TileHttpMetadata meta = metadata(key);
+        updateValidators(meta, reply, now);
+        writeMetadata(key, meta);
+
+        const TileIndexEntry* existing = m_index->find(key);
+        if (existing) {
+            TileIndexEntry entry = *existing;
+            entry.http = meta;
+            m_index->insert(key, entry);
+            noteIndexChange();
+        }
+
+        if (payload) {
+            *payload = readTile(key);
+        }
+        return FetchOutcome::NotModified;
+    }
+
+    QByteArray data = reply->readAll();
+    if (!isValidImageData(data)) {
+        qDebug() << QString("Tile cache: rejecting %1 - not an image (%2 bytes, HTTP %3)")
+                    .arg(key.toString()).arg(data.size()).arg(httpStatus);
+        markMissing(key);
+        return FetchOutcome::Missing;
+    }
+
+    QString path = tilePath(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // Store the server bytes verbatim - no JPEG re-encode
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Tile cache: cannot write" << path;
+        return FetchOutcome::Failed;
+    }
+    file.write(data);
+    if (!file.commit()) {
+        qDebug() << "Tile cache: failed to commit" << path;
+        return FetchOutcome::Failed;
+    }
+
+    TileHttpMetadata meta;
+    updateValidators(meta, reply, now);
+    meta.fetchedAt = now;
+    writeMetadata(key, meta);
+
+    TileIndexEntry entry;
+    entry.size = quint32(data.size());
+    entry.checksum = TileCacheIndex::checksum(data);
+    entry.validated = data.size() >= MIN_TILE_BYTES;
+    entry.http = meta;
+    m_index->insert(key, entry);
+    m_index->clearMissing(key);
+    noteIndexChange();
+
+    m_memoryCache->insertBytes(key, data);
+
+    if (payload) {
+        *payload = data;
+    }
+    return FetchOutcome::Stored;
+}
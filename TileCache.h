@@ -0,0 +1,139 @@
+// TileCache.h - On-disk HiPS tile cache with HTTP revalidation metadata
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QImage>
+#include <QHash>
+#include <QStringList>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <atomic>
+#include "TileStats.h"
+
+class TileCacheIndex;
+class TileMemoryCache;
+
+// Identifies one HiPS tile independently of where it is stored
+struct TileKey {
+    QString survey;            // Survey registry name (DSS2_Color, 2MASS_J, ...)
+    int order;                 // HiPS order (Norder)
+    long long pixel;           // NESTED HEALPix pixel at that order
+    QString format = "jpg";    // File extension, not part of the identity
+
+    QString toString() const {
+        return QString("%1/%2/%3").arg(survey).arg(order).arg(pixel);
+    }
+
+    bool operator==(const TileKey& other) const {
+        return survey == other.survey && order == other.order && pixel == other.pixel;
+    }
+};
+
+inline size_t qHash(const TileKey& key, size_t seed = 0) {
+    return qHash(key.survey, seed) ^ qHash(key.pixel, seed) ^ static_cast<size_t>(key.order);
+}
+
+// HTTP validators kept next to every cached tile
+struct TileHttpMetadata {
+    QString etag;              // ETag as sent by the server, echoed in If-None-Match
+    QString lastModified;      // Raw Last-Modified header, echoed in If-Modified-Since
+    QDateTime expires;         // From Cache-Control max-age or Expires, invalid if absent
+    QDateTime fetchedAt;       // Last time the payload was downloaded (HTTP 200)
+    QDateTime validatedAt;     // Last time the server confirmed the payload (200 or 304)
+};
+
+class TileCache : public QObject {
+    Q_OBJECT
+
+public:
+    enum class FetchOutcome {
+        Stored,                // New payload written to the cache
+        NotModified,           // HTTP 304, cached payload confirmed
+        Missing,               // HTTP 404/410 or a payload that is not an image
+        Failed                 // Network error or timeout, worth retrying
+    };
+
+    explicit TileCache(const QString& rootDir = "hips_tile_cache", QObject* parent = nullptr);
+    ~TileCache();
+
+    // Layout mirrors the HiPS server: <root>/<survey>/Norder<o>/Dir<d>/Npix<p>.<fmt>
+    QString tilePath(const TileKey& key) const;
+    QString rootDir() const { return m_rootDir; }
+
+    // A tile is valid when it exists, is not truncated and has an image signature.
+    // It is fresh while neither the server expiry nor the local TTL have passed.
+    // Both are answered from the in-memory index once the startup scan has run.
+    bool hasValidTile(const TileKey& key) const;
+    bool isFresh(const TileKey& key) const;
+
+    // Served from the RAM tiers when possible; disk reads populate the compressed tier
+    QByteArray readTile(const TileKey& key) const;
+    QImage loadTile(const TileKey& key) const;
+    TileMemoryCache* memoryCache() const { return m_memoryCache; }
+
+    // Adds If-None-Match / If-Modified-Since when a stale copy is on disk
+    void prepareRequest(const TileKey& key, QNetworkRequest& request) const;
+
+    // Consumes a finished reply; payload receives the tile bytes for 200 and 304
+    FetchOutcome storeReply(const TileKey& key, QNetworkReply* reply, QByteArray* payload = nullptr);
+
+    TileHttpMetadata metadata(const TileKey& key) const;
+
+    // Minimum time between revalidations, also used when the server sends no expiry
+    void setRevalidateAfter(qint64 seconds) { m_revalidateAfterSecs = seconds; }
+    qint64 revalidateAfter() const { return m_revalidateAfterSecs; }
+
+    // Negative cache: coverage holes are remembered so they are not requested again.
+    // Any copy on disk or in memory is dropped with the index entry.
+    void markMissing(const TileKey& key);
+    bool isKnownMissing(const TileKey& key) const;
+    void setMissingTtl(qint64 seconds) { m_missingTtlSecs = seconds; }
+    qint64 missingTtl() const { return m_missingTtlSecs; }
+
+    // Statistics measured when a tile was decoded are kept with its index entry. A blank
+    // tile (see TileStats::isBlank) is no longer valid and goes into the negative cache,
+    // so planners fall back to the next survey; returns true in that case.
+    bool recordStats(const TileKey& key, const TileStats& stats);
+    TileStats stats(const TileKey& key) const;
+
+    // First survey in priority order not known to be missing this tile, or empty if none
+    QString selectSurvey(const QStringList& surveyPriority, int order, long long pixel) const;
+
+    static bool isValidImageData(const QByteArray& data);
+
+    // Persists the index now instead of waiting for the next batch of writes
+    bool flushIndex();
+    bool isIndexComplete() const { return m_indexComplete; }
+
+signals:
+    // Background check of the index against the files on disk has finished
+    void revalidationFinished(int checked, int dropped, int discovered);
+
+private:
+    QString m_rootDir;
+    qint64 m_revalidateAfterSecs;
+    qint64 m_missingTtlSecs;
+
+    TileCacheIndex* m_index;
+    TileMemoryCache* m_memoryCache;
+    bool m_indexComplete;              // Index also covers files it has not seen yet
+    int m_unsavedChanges;
+    QThreadPool* m_scanPool;
+    QSharedPointer<std::atomic<bool>> m_scanCancelled;
+
+    QString metadataPath(const TileKey& key) const;
+    bool hasValidTileOnDisk(const TileKey& key) const;
+    QByteArray readTileFromDisk(const TileKey& key) const;
+    void startBackgroundRevalidation();
+    void noteIndexChange();
+    bool writeMetadata(const TileKey& key, const TileHttpMetadata& meta) const;
+    void updateValidators(TileHttpMetadata& meta, QNetworkReply* reply, const QDateTime& now) const;
+};
+
+#endif // TILECACHE_H
@@ -0,0 +1,287 @@
+// TileCacheIndex.cpp - Compact persistent index of validated tile cache entries
+#include "TileCacheIndex.h"
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+
+namespace {
+    const quint32 INDEX_MAGIC = 0x48545849;   // "HTXI"
+    const quint16 INDEX_VERSION = 3;            // 2 adds the negative cache section, 3 tile statistics
+    const int BLOOM_BITS_PER_ENTRY = 8;
+
+    qint64 toMsecs(const QDateTime& time) {
+        return time.isValid() ? time.toMSecsSinceEpoch() : -1;
+    }
+
+    QDateTime fromMsecs(qint64 msecs) {
+        return msecs < 0 ? QDateTime() : QDateTime::fromMSecsSinceEpoch(msecs, Qt::UTC);
+    }
+}
+
+TileBloomFilter::TileBloomFilter(int expectedEntries) {
+    reset(expectedEntries);
+}
+
+void TileBloomFilter::reset(int expectedEntries) {
+    quint64 bits = std::max<quint64>(1024, quint64(expectedEntries) * BLOOM_BITS_PER_ENTRY);
+    bits = (bits + 63) & ~quint64(63);
+    m_bitCount = bits;
+    m_bits.fill(0, int(bits / 64));
+}
+
+void TileBloomFilter::insert(const TileKey& key) {
+    // Double hashing: bit_i = h1 + i * h2
+    quint64 h1 = qHash(key, 0x9E3779B9);
+    quint64 h2 = qHash(key, 0x85EBCA6B) | 1;
+    for (int i = 0; i < HASH_COUNT; i++) {
+        quint64 bit = (h1 + i * h2) % m_bitCount;
+        m_bits[int(bit >> 6)] |= (quint64(1) << (bit & 63));
+    }
+}
+
+bool TileBloomFilter::mightContain(const TileKey& key) const {
+    quint64 h1 = qHash(key, 0x9E3779B9);
+    quint64 h2 = qHash(key, 0x85EBCA6B) | 1;
+    for (int i = 0; i < HASH_COUNT; i++) {
+        quint64 bit = (h1 + i * h2) % m_bitCount;
+        if (!(m_bits[int(bit >> 6)] & (quint64(1) << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TileCacheIndex::TileCacheIndex(const QString& indexPath)
+    : m_indexPath(indexPath), m_bloomCapacity(4096), m_dirty(false) {
+}
+
+quint32 TileCacheIndex::checksum(const QByteArray& data) {
+    // FNV-1a, fast enough to verify a 100 kB tile in well under a millisecond
+    quint32 hash = 2166136261u;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.constData());
+    for (qsizetype i = 0; i < data.size(); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void TileCacheIndex::rebuildBloom() {
+    m_bloomCapacity = std::max(4096, int(m_entries.size()) * 2);
+    m_bloom.reset(m_bloomCapacity);
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        m_bloom.insert(it.key());
+    }
+}
+
+bool TileCacheIndex::contains(const TileKey& key) const {
+    if (!m_bloom.mightContain(key)) {
+        return false;
+    }
+    return m_entries.contains(key);
+}
+
+const TileIndexEntry* TileCacheIndex::find(const TileKey& key) const {
+    if (!m_bloom.mightContain(key)) {
+        return nullptr;
+    }
+    auto it = m_entries.constFind(key);
+    return it == m_entries.constEnd() ? nullptr : &it.value();
+}
+
+void TileCacheIndex::insert(const TileKey& key, const TileIndexEntry& entry) {
+    bool isNew = !m_entries.contains(key);
+    m_entries.insert(key, entry);
+    m_dirty = true;
+
+    if (isNew) {
+        // Keep the false-positive rate bounded as the cache grows
+        if (m_entries.size() > m_bloomCapacity) {
+            rebuildBloom();
+        } else {
+            m_bloom.insert(key);
+        }
+    }
+}
+
+void TileCacheIndex::remove(const TileKey& key) {
+    // The bloom filter keeps the stale bit; the hash lookup settles it
+    if (m_entries.remove(key) > 0) {
+        m_dirty = true;
+    }
+}
+
+void TileCacheIndex::markMissing(const TileKey& key, const QDateTime& when) {
+    m_entries.remove(key);
+    m_missing.insert(key, when);
+    m_dirty = true;
+}
+
+void TileCacheIndex::clearMissing(const TileKey& key) {
+    if (m_missing.remove(key) > 0) {
+        m_dirty = true;
+    }
+}
+
+int TileCacheIndex::pruneMissing(const QDateTime& olderThan) {
+    int pruned = 0;
+    for (auto it = m_missing.begin(); it != m_missing.end(); ) {
+        if (!it.value().isValid() || it.value() < olderThan) {
+            it = m_missing.erase(it);
+            pruned++;
+        } else {
+            ++it;
+        }
+    }
+    if (pruned > 0) {
+        m_dirty = true;
+    }
+    return pruned;
+}
+
+bool TileCacheIndex::load() {
+    QFile file(m_indexPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray raw = file.readAll();
+    file.close();
+
+    QDataStream in(raw);
+    in.setVersion(QDataStream::Qt_6_0);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+    if (magic != INDEX_MAGIC || version < 1 || version > INDEX_VERSION) {
+        qDebug() << "Tile cache index" << m_indexPath << "has an unknown format, rebuilding";
+        return false;
+    }
+
+    // Survey/format pairs are stored once and referenced by a one-byte id
+    QStringList surveys;
+    QStringList formats;
+    in >> surveys >> formats;
+
+    quint32 count = 0;
+    in >> count;
+
+    QHash<TileKey, TileIndexEntry> entries;
+    entries.reserve(int(std::min<quint32>(count, 1 << 20)));
+
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        quint8 surveyId, order, flags;
+        qint64 pixel, expires, fetchedAt, validatedAt;
+        TileIndexEntry entry;
+
+        in >> surveyId >> order >> pixel >> entry.size >> entry.checksum >> flags
+           >> entry.http.etag >> entry.http.lastModified >> expires >> fetchedAt >> validatedAt;
+
+        if (version >= 3 && (flags & 2)) {
+            in >> entry.stats.minLevel >> entry.stats.maxLevel >> entry.stats.mean
+               >> entry.stats.emptyFraction >> entry.stats.saturatedFraction;
+            entry.stats.measured = true;
+        }
+
+        if (surveyId >= surveys.size()) break;
+
+        TileKey key = {surveys[surveyId], order, pixel, formats[surveyId]};
+        entry.validated = (flags & 1) != 0;
+        entry.http.expires = fromMsecs(expires);
+        entry.http.fetchedAt = fromMsecs(fetchedAt);
+        entry.http.validatedAt = fromMsecs(validatedAt);
+        entries.insert(key, entry);
+    }
+
+    QHash<TileKey, QDateTime> missing;
+    if (version >= 2) {
+        quint32 missingCount = 0;
+        in >> missingCount;
+        for (quint32 i = 0; i < missingCount && in.status() == QDataStream::Ok; i++) {
+            quint8 surveyId, order;
+            qint64 pixel, since;
+            in >> surveyId >> order >> pixel >> since;
+            if (surveyId >= surveys.size()) break;
+            missing.insert({surveys[surveyId], order, pixel, formats[surveyId]}, fromMsecs(since));
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << "Tile cache index" << m_indexPath << "is truncated, rebuilding";
+        return false;
+    }
+
+    m_entries = entries;
+    m_missing = missing;
+    m_dirty = false;
+    rebuildBloom();
+    return true;
+}
+
+bool TileCacheIndex::save() {
+    QByteArray raw;
+    QDataStream out(&raw, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    QStringList surveys;
+    QStringList formats;
+    QHash<QString, quint8> surveyIds;
+    auto registerSurvey = [&](const TileKey& key) {
+        QString id = key.survey + "|" + key.format;
+        if (!surveyIds.contains(id)) {
+            surveyIds.insert(id, quint8(surveys.size()));
+            surveys << key.survey;
+            formats << key.format;
+        }
+    };
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        registerSurvey(it.key());
+    }
+    for (auto it = m_missing.constBegin(); it != m_missing.constEnd(); ++it) {
+        registerSurvey(it.key());
+    }
+
+    out << INDEX_MAGIC << INDEX_VERSION << surveys << formats << quint32(m_entries.size());
+
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        const TileKey& key = it.key();
+        const TileIndexEntry& entry = it.value();
+        out << surveyIds.value(key.survey + "|" + key.format)
+            << quint8(key.order) << qint64(key.pixel)
+            << entry.size << entry.checksum
+            << quint8((entry.validated ? 1 : 0) | (entry.stats.measured ? 2 : 0))
+            << entry.http.etag << entry.http.lastModified
+            << toMsecs(entry.http.expires) << toMsecs(entry.http.fetchedAt) << toMsecs(entry.http.validatedAt);
+        // Only decoded tiles carry statistics; the flag bit says whether they follow
+        if (entry.stats.measured) {
+            out << entry.stats.minLevel << entry.stats.maxLevel << entry.stats.mean
+                << entry.stats.emptyFraction << entry.stats.saturatedFraction;
+        }
+    }
+
+    out << quint32(m_missing.size());
+    for (auto it = m_missing.constBegin(); it != m_missing.constEnd(); ++it) {
+        out << surveyIds.value(it.key().survey + "|" + it.key().format)
+            << quint8(it.key().order) << qint64(it.key().pixel) << toMsecs(it.value());
+    }
+
+    QDir().mkpath(QFileInfo(m_indexPath).absolutePath());
+    QSaveFile file(m_indexPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(raw);
+    if (!file.commit()) {
+        return false;
+    }
+
+    m_dirty = false;
+    return true;
+}
@@ -0,0 +1,75 @@
+// TileCacheIndex.h - Compact persistent index of validated tile cache entries
+#ifndef TILECACHEINDEX_H
+#define TILECACHEINDEX_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QDateTime>
+#include "TileCache.h"
+#include "TileStats.h"
+
+// One cache entry as recorded after validation
+struct TileIndexEntry {
+    quint32 size = 0;          // Payload size in bytes
+    quint32 checksum = 0;      // FNV-1a of the payload
+    bool validated = false;    // Signature, size and checksum verified
+    TileHttpMetadata http;     // Revalidation metadata
+    TileStats stats;           // Pixel statistics from the last decode, if any
+};
+
+// Fixed-size bloom filter answering "definitely not cached" without a hash lookup
+class TileBloomFilter {
+public:
+    explicit TileBloomFilter(int expectedEntries = 4096);
+
+    void reset(int expectedEntries);
+    void insert(const TileKey& key);
+    bool mightContain(const TileKey& key) const;
+
+private:
+    static const int HASH_COUNT = 4;   // ~2% false positives at 8 bits per entry
+    QVector<quint64> m_bits;
+    quint64 m_bitCount;
+};
+
+class TileCacheIndex {
+public:
+    explicit TileCacheIndex(const QString& indexPath);
+
+    // Whole index is read with a single file read; returns false if missing or corrupt
+    bool load();
+    bool save();
+
+    bool contains(const TileKey& key) const;
+    const TileIndexEntry* find(const TileKey& key) const;
+    void insert(const TileKey& key, const TileIndexEntry& entry);
+    void remove(const TileKey& key);
+
+    // Negative entries: tiles the server does not have, with the time they were last seen missing.
+    // Marking a tile missing drops its positive entry, so the two never disagree.
+    void markMissing(const TileKey& key, const QDateTime& when);
+    void clearMissing(const TileKey& key);
+    QDateTime missingSince(const TileKey& key) const { return m_missing.value(key); }
+    int pruneMissing(const QDateTime& olderThan);
+    int missingCount() const { return m_missing.size(); }
+
+    QList<TileKey> keys() const { return m_entries.keys(); }
+    int size() const { return m_entries.size(); }
+    bool isDirty() const { return m_dirty; }
+
+    static quint32 checksum(const QByteArray& data);
+
+private:
+    QString m_indexPath;
+    QHash<TileKey, TileIndexEntry> m_entries;
+    QHash<TileKey, QDateTime> m_missing;
+    TileBloomFilter m_bloom;
+    int m_bloomCapacity;
+    bool m_dirty;
+
+    void rebuildBloom();
+};
+
+#endif // TILECACHEINDEX_H
@@ -0,0 +1,102 @@
+// TileFetcher.cpp - Parallel HiPS tile downloader feeding the shared TileCache
+#include "TileFetcher.h"
+#include <QDebug>
+#include <QTimer>
+#include <QUrl>
+#include <memory>
+
+TileFetcher::TileFetcher(TileCache* cache, ProperHipsClient* hipsClient, QObject* parent)
+    : QObject(parent), m_cache(cache), m_hipsClient(hipsClient),
+      m_maxParallel(6), m_timeoutMs(15000) {
+    m_networkManager = new QNetworkAccessManager(this);
+}
+
+void TileFetcher::fetch(const QList<TileKey>& keys) {
+    for (const TileKey& key : keys) {
+        if (m_known.contains(key)) continue;
+        m_known.insert(key);
+        m_queue.append(key);
+    }
+
+    startNext();
+
+    // Nothing to do - still report completion so callers can chain on it
+    if (isIdle()) {
+        QTimer::singleShot(0, this, &TileFetcher::allFinished);
+    }
+}
+
+void TileFetcher::startNext() {
+    while (m_inFlight.size() < m_maxParallel && !m_queue.isEmpty()) {
+        TileKey key = m_queue.takeFirst();
+
+        QString url = m_hipsClient->buildTileUrlForPixel(key.survey, key.pixel, key.order);
+        if (url.isEmpty()) {
+            qDebug() << "Tile fetcher: no URL for" << key.toString();
+            m_known.remove(key);
+            emit tileFinished(key, TileCache::FetchOutcome::Failed, 0, 0);
+            continue;
+        }
+
+        QNetworkRequest request{QUrl(url)};
+        request.setHeader(QNetworkRequest::UserAgentHeader, "ProperHipsClient/1.0");
+        request.setRawHeader("Accept", "image/*");
+        m_cache->prepareRequest(key, request);
+
+        QNetworkReply* reply = m_networkManager->get(request);
+        m_inFlight.insert(reply, key);
+
+        connect(reply, &QNetworkReply::finished, this, &TileFetcher::onReplyFinished);
+        abortAfterSend(reply, m_timeoutMs);
+    }
+}
+
+void TileFetcher::abortAfterSend(QNetworkReply* reply, int timeoutMs) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    // QNetworkAccessManager opens at most six connections per host; replies queued behind
+    // them have not been sent yet. The clock starts when this request's socket starts
+    // connecting, or when it is written to a reused connection, whichever comes first.
+    auto armed = std::make_shared<bool>(false);
+    auto arm = [reply, timeoutMs, armed]() {
+        if (*armed) return;
+        *armed = true;
+        QTimer::singleShot(timeoutMs, reply, &QNetworkReply::abort);
+    };
+    connect(reply, &QNetworkReply::socketStartedConnecting, reply, arm);
+    connect(reply, &QNetworkReply::requestSent, reply, arm);
+    connect(reply, &QNetworkReply::metaDataChanged, reply, arm);
+#else
+    // No send notifications before Qt 6.3: time from the hand-off to the manager
+    QTimer::singleShot(timeoutMs, reply, &QNetworkReply::abort);
+#endif
+}
+
+void TileFetcher::onReplyFinished() {
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply || !m_inFlight.contains(reply)) return;
+
+    TileKey key = m_inFlight.take(reply);
+    m_known.remove(key);
+
+    int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QByteArray payload;
+    TileCache::FetchOutcome outcome = m_cache->storeReply(key, reply, &payload);
+    qint64 networkBytes = (outcome == TileCache::FetchOutcome::Stored) ? payload.size() : 0;
+
+    if (outcome == TileCache::FetchOutcome::Failed) {
+        qDebug() << QString("Tile fetcher: %1 failed (HTTP %2, %3)")
+                    .arg(key.toString()).arg(httpStatus).arg(reply->errorString());
+    } else if (outcome == TileCache::FetchOutcome::Missing) {
+        qDebug() << QString("Tile fetcher: %1 not in survey (HTTP %2), remembered as missing")
+                    .arg(key.toString()).arg(httpStatus);
+    }
+
+    reply->deleteLater();
+
+    emit tileFinished(key, outcome, networkBytes, httpStatus);
+
+    startNext();
+    if (isIdle()) {
+        emit allFinished();
+    }
+}
@@ -0,0 +1,54 @@
+// TileFetcher.h - Parallel HiPS tile downloader feeding the shared TileCache
+#ifndef TILEFETCHER_H
+#define TILEFETCHER_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include "ProperHipsClient.h"
+#include "TileCache.h"
+#include <algorithm>
+
+class TileFetcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit TileFetcher(TileCache* cache, ProperHipsClient* hipsClient, QObject* parent = nullptr);
+
+    // Keys already queued or in flight are ignored, so callers may enqueue overlapping sets
+    void fetch(const QList<TileKey>& keys);
+    void setMaxParallel(int maxParallel) { m_maxParallel = std::max(1, maxParallel); }
+    void setTimeoutMs(int timeoutMs) { m_timeoutMs = timeoutMs; }
+
+    int pendingCount() const { return m_queue.size() + m_inFlight.size(); }
+    bool isIdle() const { return pendingCount() == 0; }
+
+    // Aborts reply timeoutMs after it actually goes out, not when it is queued
+    static void abortAfterSend(QNetworkReply* reply, int timeoutMs);
+
+signals:
+    // networkBytes is the payload actually transferred (0 for a 304)
+    void tileFinished(const TileKey& key, TileCache::FetchOutcome outcome, qint64 networkBytes, int httpStatus);
+    void allFinished();
+
+private slots:
+    void onReplyFinished();
+
+private:
+    TileCache* m_cache;
+    ProperHipsClient* m_hipsClient;
+    QNetworkAccessManager* m_networkManager;
+
+    QList<TileKey> m_queue;
+    QHash<QNetworkReply*, TileKey> m_inFlight;
+    QSet<TileKey> m_known;
+    int m_maxParallel;
+    int m_timeoutMs;
+
+    void startNext();
+};
+
+#endif // TILEFETCHER_H
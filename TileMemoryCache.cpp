@@ -0,0 +1,137 @@
+// TileMemoryCache.cpp - Two-tier in-memory tile cache: compressed bytes and decoded images
+#include "TileMemoryCache.h"
+#include "PixelFormat.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+TileMemoryCache::TileMemoryCache(int compressedBudgetMB, int decodedBudgetMB)
+    : m_compressed(compressedBudgetMB * 1024), m_decoded(decodedBudgetMB * 1024),
+      m_promoteAfterHits(2) {
+}
+
+QImage TileMemoryCache::decode(const QByteArray& data) {
+    QElapsedTimer timer;
+    timer.start();
+
+    QImage image = PixelFormat::decode(data);
+
+    QMutexLocker locker(&m_mutex);
+    m_stats.decodes++;
+    m_stats.decodeNsTotal += timer.nsecsElapsed();
+    return image;
+}
+
+bool TileMemoryCache::shouldPromote(const CompressedEntry& entry) const {
+    // Spare decoded capacity costs nothing to use; under pressure only hot tiles get in
+    if (m_decoded.totalCost() < m_decoded.maxCost() / 2) {
+        return true;
+    }
+    return entry.hits >= m_promoteAfterHits;
+}
+
+QImage TileMemoryCache::image(const TileKey& key) {
+    QByteArray data;
+    bool promote = false;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if (QImage* decoded = m_decoded.object(key)) {
+            m_stats.decodedHits++;
+            if (m_stats.decodes > 0) {
+                m_stats.decodeNsSaved += m_stats.decodeNsTotal / m_stats.decodes;
+            }
+            return *decoded;
+        }
+
+        CompressedEntry* entry = m_compressed.object(key);
+        if (!entry) {
+            m_stats.misses++;
+            return QImage();
+        }
+
+        m_stats.compressedHits++;
+        entry->hits++;
+        data = entry->data;
+        promote = shouldPromote(*entry);
+    }
+
+    // Decoding happens outside the lock so parallel callers do not serialise on it
+    QImage image = decode(data);
+
+    if (promote && !image.isNull()) {
+        QMutexLocker locker(&m_mutex);
+        // Only if the bytes we decoded are still current; insertBytes() or remove() may have run
+        CompressedEntry* entry = m_compressed.object(key);
+        if (entry && entry->data.constData() == data.constData()) {
+            m_decoded.insert(key, new QImage(image), costKB(image.sizeInBytes()));
+            m_stats.promotions++;
+        }
+    }
+
+    return image;
+}
+
+QByteArray TileMemoryCache::bytes(const TileKey& key) {
+    QMutexLocker locker(&m_mutex);
+    CompressedEntry* entry = m_compressed.object(key);
+    return entry ? entry->data : QByteArray();
+}
+
+void TileMemoryCache::insertBytes(const TileKey& key, const QByteArray& data) {
+    QMutexLocker locker(&m_mutex);
+
+    // New bytes invalidate any decoded copy of the old payload
+    m_decoded.remove(key);
+
+    CompressedEntry* entry = new CompressedEntry;
+    entry->data = data;
+    m_compressed.insert(key, entry, costKB(data.size()));
+}
+
+QImage TileMemoryCache::insertAndDecode(const TileKey& key, const QByteArray& data) {
+    insertBytes(key, data);
+    return decode(data);
+}
+
+void TileMemoryCache::remove(const TileKey& key) {
+    QMutexLocker locker(&m_mutex);
+    m_compressed.remove(key);
+    m_decoded.remove(key);
+}
+
+void TileMemoryCache::clear() {
+    QMutexLocker locker(&m_mutex);
+    m_compressed.clear();
+    m_decoded.clear();
+}
+
+TileMemoryStats TileMemoryCache::stats() const {
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+void TileMemoryCache::resetStats() {
+    QMutexLocker locker(&m_mutex);
+    m_stats = TileMemoryStats();
+}
+
+void TileMemoryCache::logStats(const QString& label) const {
+    QMutexLocker locker(&m_mutex);
+
+    qint64 lookups = std::max<qint64>(1, m_stats.lookups());
+    qDebug() << QString("🧠 %1 memory tiers: decoded %2% (%3 tiles, %4 MB), compressed %5% (%6 tiles, %7 MB), miss %8%")
+                .arg(label)
+                .arg(100.0 * m_stats.decodedHits / lookups, 0, 'f', 1)
+                .arg(m_decoded.count())
+                .arg(m_decoded.totalCost() / 1024.0, 0, 'f', 1)
+                .arg(100.0 * m_stats.compressedHits / lookups, 0, 'f', 1)
+                .arg(m_compressed.count())
+                .arg(m_compressed.totalCost() / 1024.0, 0, 'f', 1)
+                .arg(100.0 * m_stats.misses / lookups, 0, 'f', 1);
+    qDebug() << QString("   %1 decodes (%2 ms), %3 promotions, decode time saved %4 ms")
+                .arg(m_stats.decodes)
+                .arg(m_stats.decodeNsTotal / 1e6, 0, 'f', 1)
+                .arg(m_stats.promotions)
+                .arg(m_stats.decodeNsSaved / 1e6, 0, 'f', 1);
+}
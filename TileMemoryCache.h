@@ -0,0 +1,65 @@
+// TileMemoryCache.h - Two-tier in-memory tile cache: compressed bytes and decoded images
+#ifndef TILEMEMORYCACHE_H
+#define TILEMEMORYCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include "TileCache.h"
+#include <algorithm>
+
+// Counters for the memory tiers, reset with TileMemoryCache::resetStats()
+struct TileMemoryStats {
+    qint64 decodedHits = 0;        // Served as a ready QImage
+    qint64 compressedHits = 0;     // Served from RAM bytes, decoded on demand
+    qint64 misses = 0;             // Caller had to go to disk or network
+    qint64 promotions = 0;         // Compressed entries moved up to the decoded tier
+    qint64 decodes = 0;
+    qint64 decodeNsTotal = 0;      // Time spent decoding
+    qint64 decodeNsSaved = 0;      // Estimated decode time avoided by decoded hits
+
+    qint64 lookups() const { return decodedHits + compressedHits + misses; }
+};
+
+class TileMemoryCache {
+public:
+    // Budgets in MB; defaults hold ~2500 compressed and ~128 decoded 512x512 tiles
+    explicit TileMemoryCache(int compressedBudgetMB = 256, int decodedBudgetMB = 128);
+
+    // Decoded tier first, then decode from the compressed tier; null image on a miss
+    QImage image(const TileKey& key);
+    QByteArray bytes(const TileKey& key);
+
+    void insertBytes(const TileKey& key, const QByteArray& data);
+    // Miss path: keeps the bytes and returns the decoded image, timed like any other decode
+    QImage insertAndDecode(const TileKey& key, const QByteArray& data);
+    void remove(const TileKey& key);
+    void clear();
+
+    // A compressed entry is promoted after this many hits while the decoded tier is under
+    // pressure; while it is less than half full the first hit promotes
+    void setPromoteAfterHits(int hits) { m_promoteAfterHits = std::max(1, hits); }
+
+    TileMemoryStats stats() const;
+    void resetStats();
+    void logStats(const QString& label) const;
+
+private:
+    struct CompressedEntry {
+        QByteArray data;
+        int hits = 0;
+    };
+
+    mutable QMutex m_mutex;
+    QCache<TileKey, CompressedEntry> m_compressed;   // Cost in KB
+    QCache<TileKey, QImage> m_decoded;               // Cost in KB
+    int m_promoteAfterHits;
+    TileMemoryStats m_stats;
+
+    QImage decode(const QByteArray& data);
+    bool shouldPromote(const CompressedEntry& entry) const;
+    static int costKB(qint64 bytes) { return int(std::max<qint64>(1, bytes / 1024)); }
+};
+
+#endif // TILEMEMORYCACHE_H
@@ -0,0 +1,162 @@
+// TileStats.cpp - Per-tile pixel statistics that flag blank and saturated survey tiles
+#include "TileStats.h"
+#include "PixelFormat.h"
+#include <algorithm>
+
+#if defined(__SSE2__) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#include <emmintrin.h>
+#define TILE_STATS_SSE2 1
+#endif
+
+namespace {
+    struct Accumulator {
+        int minLevel = 255;
+        int maxLevel = 0;
+        quint64 sum = 0;
+        qint64 empty = 0;
+        qint64 saturated = 0;
+    };
+
+#ifdef TILE_STATS_SSE2
+    int horizontalMin(__m128i v) {
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 4));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 2));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 1));
+        return _mm_cvtsi128_si32(v) & 0xFF;
+    }
+
+    int horizontalMax(__m128i v) {
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+        v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+        return _mm_cvtsi128_si32(v) & 0xFF;
+    }
+
+    quint64 horizontalSum(__m128i sad) {
+        return quint64(_mm_cvtsi128_si32(sad)) + quint64(_mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+    }
+
+    qint64 horizontalCount(__m128i counts) {
+        counts = _mm_add_epi32(counts, _mm_srli_si128(counts, 8));
+        counts = _mm_add_epi32(counts, _mm_srli_si128(counts, 4));
+        return _mm_cvtsi128_si32(counts);
+    }
+#endif
+
+    // 0xAARRGGBB pixels; alpha is forced to 0xFF for the minimum and to 0 for the maximum
+    // and the sum, so it never decides either
+    void accumulateRgb32(const quint32* in, int width, Accumulator& acc) {
+        int x = 0;
+#ifdef TILE_STATS_SSE2
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+        const __m128i colour = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i emptyLevel = _mm_set1_epi8(char(TileStats::EMPTY_LEVEL));
+        const __m128i saturatedLevel = _mm_set1_epi8(char(TileStats::SATURATED_LEVEL));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i low = _mm_set1_epi8(char(0xFF));
+        __m128i high = zero;
+        __m128i sum = zero;
+        __m128i emptyCount = zero;          // Matching lanes are all ones, so subtracting counts them
+        __m128i saturatedCount = zero;
+        for (; x + 4 <= width; x += 4) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            const __m128i opaque = _mm_or_si128(pixels, alpha);
+            const __m128i clear = _mm_and_si128(pixels, colour);
+            low = _mm_min_epu8(low, opaque);
+            high = _mm_max_epu8(high, clear);
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(clear, zero));
+            // A channel above the level survives the saturating subtract; an all-zero pixel is empty
+            const __m128i empty = _mm_cmpeq_epi32(_mm_subs_epu8(clear, emptyLevel), zero);
+            const __m128i saturated = _mm_cmpeq_epi32(_mm_subs_epu8(saturatedLevel, opaque), zero);
+            emptyCount = _mm_sub_epi32(emptyCount, empty);
+            saturatedCount = _mm_sub_epi32(saturatedCount, saturated);
+        }
+        if (x > 0) {
+            acc.minLevel = std::min(acc.minLevel, horizontalMin(low));
+            acc.maxLevel = std::max(acc.maxLevel, horizontalMax(high));
+            acc.sum += horizontalSum(sum);
+            acc.empty += horizontalCount(emptyCount);
+            acc.saturated += horizontalCount(saturatedCount);
+        }
+#endif
+        for (; x < width; x++) {
+            const int r = qRed(in[x]), g = qGreen(in[x]), b = qBlue(in[x]);
+            const int low = std::min({r, g, b});
+            const int high = std::max({r, g, b});
+            acc.minLevel = std::min(acc.minLevel, low);
+            acc.maxLevel = std::max(acc.maxLevel, high);
+            acc.sum += quint64(r + g + b);
+            acc.empty += high <= TileStats::EMPTY_LEVEL;
+            acc.saturated += low >= TileStats::SATURATED_LEVEL;
+        }
+    }
+
+    void accumulateGray8(const quint8* in, int width, Accumulator& acc) {
+        int x = 0;
+#ifdef TILE_STATS_SSE2
+        const __m128i emptyLevel = _mm_set1_epi8(char(TileStats::EMPTY_LEVEL));
+        const __m128i saturatedLevel = _mm_set1_epi8(char(TileStats::SATURATED_LEVEL));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i low = _mm_set1_epi8(char(0xFF));
+        __m128i high = zero;
+        const __m128i one = _mm_set1_epi8(1);
+        __m128i sum = zero;
+        __m128i emptyCount = zero;          // Matching bytes summed as ones, like the levels
+        __m128i saturatedCount = zero;
+        for (; x + 16 <= width; x += 16) {
+            const __m128i levels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            low = _mm_min_epu8(low, levels);
+            high = _mm_max_epu8(high, levels);
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(levels, zero));
+            const __m128i empty = _mm_cmpeq_epi8(_mm_subs_epu8(levels, emptyLevel), zero);
+            const __m128i saturated = _mm_cmpeq_epi8(_mm_subs_epu8(saturatedLevel, levels), zero);
+            emptyCount = _mm_add_epi64(emptyCount, _mm_sad_epu8(_mm_and_si128(empty, one), zero));
+            saturatedCount = _mm_add_epi64(saturatedCount, _mm_sad_epu8(_mm_and_si128(saturated, one), zero));
+        }
+        if (x > 0) {
+            acc.minLevel = std::min(acc.minLevel, horizontalMin(low));
+            acc.maxLevel = std::max(acc.maxLevel, horizontalMax(high));
+            acc.sum += horizontalSum(sum);
+            acc.empty += qint64(horizontalSum(emptyCount));
+            acc.saturated += qint64(horizontalSum(saturatedCount));
+        }
+#endif
+        for (; x < width; x++) {
+            acc.minLevel = std::min(acc.minLevel, int(in[x]));
+            acc.maxLevel = std::max(acc.maxLevel, int(in[x]));
+            acc.sum += in[x];
+            acc.empty += in[x] <= TileStats::EMPTY_LEVEL;
+            acc.saturated += in[x] >= TileStats::SATURATED_LEVEL;
+        }
+    }
+}
+
+TileStats TileStats::measure(const QImage& image) {
+    TileStats stats;
+    if (image.isNull()) {
+        return stats;
+    }
+
+    const bool gray = image.format() == QImage::Format_Grayscale8;
+    const QImage source = gray ? image : PixelFormat::toInternal(image, "tile stats");
+
+    Accumulator acc;
+    for (int y = 0; y < source.height(); y++) {
+        if (gray) {
+            accumulateGray8(source.constScanLine(y), source.width(), acc);
+        } else {
+            accumulateRgb32(reinterpret_cast<const quint32*>(source.constScanLine(y)), source.width(), acc);
+        }
+    }
+
+    const double pixels = double(source.width()) * source.height();
+    stats.minLevel = quint8(acc.minLevel);
+    stats.maxLevel = quint8(acc.maxLevel);
+    stats.mean = float(acc.sum / (pixels * (gray ? 1 : 3)));
+    stats.emptyFraction = float(acc.empty / pixels);
+    stats.saturatedFraction = float(acc.saturated / pixels);
+    stats.measured = true;
+    return stats;
+}
@@ -0,0 +1,37 @@
+// TileStats.h - Per-tile pixel statistics that flag blank and saturated survey tiles
+#ifndef TILESTATS_H
+#define TILESTATS_H
+
+#include <QImage>
+#include <QtGlobal>
+
+// Surveys answer some requests at their coverage edges with a well-formed JPEG that is
+// all black, or clipped white. Such a tile passes every byte-level check of the cache,
+// so it is judged from its pixels instead: channel minimum and maximum, mean level, and
+// the fraction of pixels whose channels are all near black or all near white.
+//
+// measure() reads each scanline once, sixteen bytes at a time with SSE2 (unsigned byte
+// min/max, SAD sums, saturating-subtract compares), and runs on the render pool right
+// after the decode while the pixels are still in cache. Alpha is ignored; Grayscale8 is
+// read as is, other formats are converted to RGB32 first.
+struct TileStats {
+    static const int EMPTY_LEVEL = 4;           // Pixels with every channel at or below this are empty
+    static const int SATURATED_LEVEL = 251;     // ... at or above this are saturated
+
+    quint8 minLevel = 0;
+    quint8 maxLevel = 0;
+    float mean = 0.0f;                  // Over all colour channels, 0-255
+    float emptyFraction = 0.0f;
+    float saturatedFraction = 0.0f;
+    bool measured = false;
+
+    // Nothing usable: almost every pixel empty or saturated, or no contrast at all.
+    // Partially covered edge tiles are kept; their empty pixels simply stay dark.
+    bool isBlank() const {
+        return measured && (emptyFraction >= 0.98f || saturatedFraction >= 0.98f || maxLevel - minLevel <= 2);
+    }
+
+    static TileStats measure(const QImage& image);
+};
+
+#endif // TILESTATS_H
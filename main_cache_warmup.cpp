@@ -0,0 +1,281 @@
+// main_cache_warmup.cpp - Headless bulk pre-fetch of mosaic tiles into the shared tile cache
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegularExpression>
+#include <QSet>
+#include <QSizeF>
+#include <QTextStream>
+#include "ProperHipsClient.h"
+#include "MessierCatalog.h"
+#include "TileCache.h"
+#include "TileFetcher.h"
+
+class CacheWarmupRunner : public QObject {
+    Q_OBJECT
+
+public:
+    explicit CacheWarmupRunner(const QString& cacheDir, QObject *parent = nullptr);
+
+    void setSurvey(const QString& survey) { m_survey = survey; }
+    void setOrders(const QList<int>& orders) { m_orders = orders; }
+    void setMaxParallel(int maxParallel) { m_fetcher->setMaxParallel(maxParallel); }
+    void setRevalidateAfterDays(int days) { m_tileCache->setRevalidateAfter(qint64(days) * 24 * 3600); }
+
+    void addTarget(const SkyPosition& position) { m_targets.append(position); }
+    int targetCount() const { return m_targets.size(); }
+
+    void run();
+
+signals:
+    void finished(bool allSucceeded);
+
+private slots:
+    void onTileFinished(const TileKey& key, TileCache::FetchOutcome outcome, qint64 networkBytes, int httpStatus);
+    void onAllFinished();
+
+private:
+    ProperHipsClient* m_hipsClient;
+    TileCache* m_tileCache;
+    TileFetcher* m_fetcher;
+
+    QString m_survey;
+    QList<int> m_orders;
+    QList<SkyPosition> m_targets;
+
+    // Progress accounting
+    QElapsedTimer m_timer;
+    int m_totalToFetch;
+    int m_completed;
+    int m_stored;
+    int m_revalidated;
+    int m_missing;
+    int m_failed;
+    qint64 m_networkBytes;
+
+    QList<TileKey> planTiles(int* requestedCount, int* alreadyCached, int* knownMissing);
+    void printProgress() const;
+};
+
+CacheWarmupRunner::CacheWarmupRunner(const QString& cacheDir, QObject *parent)
+    : QObject(parent), m_survey("DSS2_Color"), m_orders({8}),
+      m_totalToFetch(0), m_completed(0), m_stored(0), m_revalidated(0), m_missing(0), m_failed(0), m_networkBytes(0) {
+
+    m_hipsClient = new ProperHipsClient(this);
+    m_tileCache = new TileCache(cacheDir, this);
+    m_fetcher = new TileFetcher(m_tileCache, m_hipsClient, this);
+
+    connect(m_fetcher, &TileFetcher::tileFinished, this, &CacheWarmupRunner::onTileFinished);
+    connect(m_fetcher, &TileFetcher::allFinished, this, &CacheWarmupRunner::onAllFinished);
+}
+
+QList<TileKey> CacheWarmupRunner::planTiles(int* requestedCount, int* alreadyCached, int* knownMissing) {
+    // Union of every 3x3 grid the mosaic creators will request, across all orders
+    QSet<TileKey> unique;
+    QList<TileKey> ordered;
+    *requestedCount = 0;
+    *alreadyCached = 0;
+    *knownMissing = 0;
+
+    for (const SkyPosition& target : m_targets) {
+        for (int order : m_orders) {
+            long long centerPixel = m_hipsClient->calculateHealPixel(target, order);
+            if (centerPixel < 0) continue;
+
+            QList<QList<long long>> grid = m_hipsClient->createProper3x3Grid(centerPixel, order);
+            for (const QList<long long>& row : grid) {
+                for (long long pixel : row) {
+                    if (pixel < 0) continue;  // No neighbour at a HEALPix face corner
+
+                    (*requestedCount)++;
+                    TileKey key = {m_survey, order, pixel, m_hipsClient->getSurveyFormat(m_survey)};
+                    if (unique.contains(key)) continue;
+                    unique.insert(key);
+
+                    // Resuming: fresh tiles from an earlier run are skipped outright
+                    if (m_tileCache->hasValidTile(key) && m_tileCache->isFresh(key)) {
+                        (*alreadyCached)++;
+                        continue;
+                    }
+
+                    // Coverage holes found by earlier runs are not asked for again until their TTL expires
+                    if (m_tileCache->isKnownMissing(key)) {
+                        (*knownMissing)++;
+                        continue;
+                    }
+                    ordered.append(key);
+                }
+            }
+        }
+    }
+
+    return ordered;
+}
+
+void CacheWarmupRunner::run() {
+    int requested = 0;
+    int alreadyCached = 0;
+    int knownMissing = 0;
+    QList<TileKey> toFetch = planTiles(&requested, &alreadyCached, &knownMissing);
+
+    int uniqueTiles = toFetch.size() + alreadyCached + knownMissing;
+
+    qDebug() << "\n=== Tile Cache Warm-up ===";
+    qDebug() << QString("Targets: %1, survey: %2, orders: %3")
+                .arg(m_targets.size()).arg(m_survey)
+                .arg([this]() {
+                    QStringList list;
+                    for (int order : m_orders) list << QString::number(order);
+                    return list.join(",");
+                }());
+    qDebug() << QString("Tiles requested by mosaics: %1, unique: %2 (%3 shared between targets)")
+                .arg(requested).arg(uniqueTiles).arg(requested - uniqueTiles);
+    qDebug() << QString("Already cached and fresh: %1, known missing: %2, to fetch or revalidate: %3")
+                .arg(alreadyCached).arg(knownMissing).arg(toFetch.size());
+
+    m_totalToFetch = toFetch.size();
+    m_timer.start();
+    m_fetcher->fetch(toFetch);
+}
+
+void CacheWarmupRunner::onTileFinished(const TileKey& key, TileCache::FetchOutcome outcome,
+                                       qint64 networkBytes, int httpStatus) {
+    m_completed++;
+    m_networkBytes += networkBytes;
+
+    switch (outcome) {
+        case TileCache::FetchOutcome::Stored:      m_stored++; break;
+        case TileCache::FetchOutcome::NotModified: m_revalidated++; break;
+        case TileCache::FetchOutcome::Missing:     m_missing++; break;
+        case TileCache::FetchOutcome::Failed:
+            m_failed++;
+            qDebug() << QString("❌ %1 failed (HTTP %2)").arg(key.toString()).arg(httpStatus);
+            break;
+    }
+
+    // Roughly 20 progress lines per run, plus the last tile
+    int step = std::max(1, m_totalToFetch / 20);
+    if (m_completed % step == 0 || m_completed == m_totalToFetch) {
+        printProgress();
+    }
+}
+
+void CacheWarmupRunner::printProgress() const {
+    double elapsedSec = std::max(0.001, m_timer.elapsed() / 1000.0);
+    double tilesPerSec = m_completed / elapsedSec;
+    double kbPerSec = (m_networkBytes / 1024.0) / elapsedSec;
+    int remaining = m_totalToFetch - m_completed;
+    double etaSec = tilesPerSec > 0 ? remaining / tilesPerSec : 0.0;
+
+    qDebug() << QString("  %1/%2 tiles (%3%) | %4 tiles/s | %5 kB/s | ETA %6s")
+                .arg(m_completed).arg(m_totalToFetch)
+                .arg(m_totalToFetch > 0 ? 100.0 * m_completed / m_totalToFetch : 100.0, 0, 'f', 1)
+                .arg(tilesPerSec, 0, 'f', 1)
+                .arg(kbPerSec, 0, 'f', 0)
+                .arg(etaSec, 0, 'f', 0);
+}
+
+void CacheWarmupRunner::onAllFinished() {
+    double elapsedSec = m_timer.elapsed() / 1000.0;
+
+    qDebug() << "\n=== Warm-up Complete ===";
+    qDebug() << QString("Downloaded: %1, revalidated (304): %2, not in survey: %3, failed: %4")
+                .arg(m_stored).arg(m_revalidated).arg(m_missing).arg(m_failed);
+    qDebug() << QString("Transferred %1 MB in %2s")
+                .arg(m_networkBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                .arg(elapsedSec, 0, 'f', 1);
+    if (m_failed > 0) {
+        qDebug() << "Re-run the same command to retry failed tiles; cached tiles are skipped.";
+    }
+
+    emit finished(m_failed == 0);
+}
+
+// Target list: one "name ra_deg dec_deg" per line, '#' starts a comment
+static bool loadTargetFile(const QString& filename, CacheWarmupRunner& runner) {
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "Cannot open target list" << filename;
+        return false;
+    }
+
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while (!in.atEnd()) {
+        QString line = in.readLine().section('#', 0, 0).trimmed();
+        lineNumber++;
+        if (line.isEmpty()) continue;
+
+        QStringList parts = line.split(QRegularExpression("\\s+"));
+        bool raOk = false, decOk = false;
+        double ra = parts.size() >= 3 ? parts[1].toDouble(&raOk) : 0.0;
+        double dec = parts.size() >= 3 ? parts[2].toDouble(&decOk) : 0.0;
+        if (!raOk || !decOk) {
+            qDebug() << QString("%1:%2: expected \"name ra_deg dec_deg\"").arg(filename).arg(lineNumber);
+            continue;
+        }
+        runner.addTarget({ra, dec, parts[0], "Warm-up target"});
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("HipsCacheWarmup");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Pre-fetch HiPS mosaic tiles into the shared tile cache");
+    parser.addHelpOption();
+
+    QCommandLineOption cacheOption("cache", "Tile cache directory.", "dir", "hips_tile_cache");
+    QCommandLineOption surveyOption("survey", "Survey to fetch.", "name", "DSS2_Color");
+    QCommandLineOption ordersOption("orders", "Comma-separated HiPS orders.", "list", "8");
+    QCommandLineOption parallelOption("parallel", "Concurrent downloads.", "n", "8");
+    QCommandLineOption ttlOption("ttl-days", "Revalidate cached tiles older than this.", "days", "7");
+    QCommandLineOption targetsOption("targets", "Target list file instead of the Messier catalog.", "file");
+    QCommandLineOption objectsOption("objects", "Only these Messier objects, e.g. M81,M82.", "list");
+    parser.addOptions({cacheOption, surveyOption, ordersOption, parallelOption,
+                       ttlOption, targetsOption, objectsOption});
+    parser.process(app);
+
+    CacheWarmupRunner runner(parser.value(cacheOption));
+    runner.setSurvey(parser.value(surveyOption));
+    runner.setMaxParallel(parser.value(parallelOption).toInt());
+    runner.setRevalidateAfterDays(parser.value(ttlOption).toInt());
+
+    QList<int> orders;
+    for (const QString& order : parser.value(ordersOption).split(',', Qt::SkipEmptyParts)) {
+        orders.append(order.trimmed().toInt());
+    }
+    runner.setOrders(orders);
+
+    if (parser.isSet(targetsOption)) {
+        if (!loadTargetFile(parser.value(targetsOption), runner)) {
+            return 1;
+        }
+    } else {
+        QStringList wanted = parser.value(objectsOption).toUpper().split(',', Qt::SkipEmptyParts);
+        for (const MessierObject& obj : MessierCatalog::getAllObjects()) {
+            if (wanted.isEmpty() || wanted.contains(obj.name.toUpper())) {
+                runner.addTarget(obj.sky_position);
+            }
+        }
+    }
+
+    if (runner.targetCount() == 0) {
+        qDebug() << "No targets to warm up";
+        return 1;
+    }
+
+    QObject::connect(&runner, &CacheWarmupRunner::finished, &app, [&app](bool allSucceeded) {
+        app.exit(allSucceeded ? 0 : 2);
+    });
+
+    runner.run();
+
+    return app.exec();
+}
+
+#include "main_cache_warmup.moc"
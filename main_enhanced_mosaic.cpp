@@ -3,10 +3,6 @@
 #include <QDebug>
 #include <QTimer>
 #include <QDir>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
-#include <QUrl>
-#include <QNetworkRequest>
 #include <QPixmap>
 #include <QImage>
 #include <QPainter>
@@ -30,10 +26,19 @@
 #include <QScrollArea>
 #include <QSplitter>
 #include <QTextStream>
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include "ProperHipsClient.h"
 #include "MessierCatalog.h"
+#include "TileCache.h"
+#include "TileMemoryCache.h"
+#include "MosaicEngine.h"
+#include "MosaicRenderer.h"
+#include "ProgressiveMosaic.h"
+#include "MipPyramid.h"
+#include "PixelFormat.h"
+#include "StretchControls.h"
 
 // Coordinate parser (same as original)
 struct SimpleCoordinateParser {
@@ -128,14 +133,13 @@ private slots:
     void onCreateMosaicClicked();
     void onCreateCustomMosaicClicked();
     void onCoordinatesChanged();
-    void onTileDownloaded();
-    void processNextTile();
     void onTabChanged(int index);
     void onPrefillFromMessier();  // FIXED: Properly connected slot
 
 private:
     ProperHipsClient* m_hipsClient;
-    QNetworkAccessManager* m_networkManager;
+    TileCache* m_tileCache;
+    MosaicEngine* m_engine;  // Grid, fetch, decode and compose; this class only drives the UI
     
     // UI Components with improved layout
     QTabWidget* m_tabWidget;
@@ -152,6 +156,7 @@ private:
     QLabel* m_previewLabel;
     QLabel* m_statusLabel;
     QCheckBox* m_zoomToObjectCheckBox;
+    StretchControls* m_stretchControls;  // Flatten and stretch, re-applied through m_engine
     
     // Target tracking
     MessierObject m_currentObject;
@@ -159,25 +164,18 @@ private:
     SkyPosition m_actualTarget;
     bool m_usingCustomCoordinates;
     QImage m_fullMosaic;
+    MipPyramid m_mosaicPyramid;  // Halving levels of m_fullMosaic for preview rescales and crops
+    QList<ExtractedSource> m_sources;  // Stars found on the linear mosaic, brightest first
     
     // Coordinate stepping with arrow keys
     bool m_coordinateInputFocused;
     
-    // Tile structure
-    struct SimpleTile {
-        int gridX, gridY;
-        long long healpixPixel;
-        QString filename;
-        QString url;
-        QImage image;
-        bool downloaded;
-        SkyPosition skyCoordinates;
-    };
-    
-    QList<SimpleTile> m_tiles;
-    int m_currentTileIndex;
+    int m_outputSize;              // Side of the centered output window in pixels
+    QRect m_cropRect;              // Output window in raw 3x3 grid pixels, planned before fetching
     QString m_outputDir;
-    QDateTime m_downloadStartTime;
+    QString m_renderTargetName;
+    QString m_mosaicFilename;
+    QString m_deepZoomFilename;
     
     // UI setup methods
     void setupUI();
@@ -191,27 +189,24 @@ private:
     void createMosaic(const MessierObject& messierObj);
     void createCustomMosaic(const SkyPosition& target);
     void createTileGrid(const SkyPosition& position);
-    void downloadTile(int tileIndex);
     
     // Enhanced mosaic assembly
     void assembleFinalMosaicCentered();
+    void onMosaicRendered(const MosaicFrame& frame);
     QPoint calculateTargetPixelPosition();
-    QImage cropMosaicToCenter(const QImage& rawMosaic, const QPoint& targetPixel);
+    QRect planCropRect(const QPoint& targetPixel) const;
     
     // Helper functions
     void saveProgressReport(const QString& targetName);
-    bool checkExistingTile(const SimpleTile& tile);
-    bool isValidJpeg(const QString& filename);
     void updatePreviewDisplay();
-    QImage createZoomedView(const QImage& fullMosaic);
+    void showStretched(const QImage& mosaic);
+    QRect zoomedViewRect(const QImage& fullMosaic);
     QPoint findBrightnessCenter(const QImage& image);
-    QImage applyGaussianBlur(const QImage& image, int radius);
     
     // NEW: Coordinate adjustment by buttons
     void adjustCoordinateByButton(double deltaRA, double deltaDec);
     
-    // HEALPix coordinate conversion helpers
-    SkyPosition healpixToSkyPosition(long long pixel, int order) const;
+    // Angular separation for placing the target within its tile
     double calculateAngularDistance(const SkyPosition& pos1, const SkyPosition& pos2) const;
 };
 
@@ -219,14 +214,28 @@ EnhancedMosaicCreator::EnhancedMosaicCreator(QWidget *parent)
     : QWidget(parent), m_usingCustomCoordinates(false), m_coordinateInputFocused(false) {
     
     m_hipsClient = new ProperHipsClient(this);
-    m_networkManager = new QNetworkAccessManager(this);
-    m_currentTileIndex = 0;
+    m_tileCache = new TileCache("hips_tile_cache", this);
+    m_engine = new MosaicEngine(m_tileCache, m_hipsClient, this);
+    m_engine->setUserAgent("EnhancedMosaicCreator/1.0");
+    m_engine->setSeamWidth(32);   // Fallback surveys differ in brightness tile to tile
+    m_outputSize = 1200;
     
     m_outputDir = "enhanced_mosaics";
     QDir().mkpath(m_outputDir);
     
     setupUI();
     
+    // Live preview while tiles arrive; the finished frame replaces it at the end
+    connect(m_engine, &MosaicEngine::previewUpdated, this, [this](const QImage& preview) {
+        m_previewLabel->setPixmap(PixelFormat::toPixmap(preview, "live preview"));
+    });
+    connect(m_engine, &MosaicEngine::tilePlaced, this, [this]() {
+        m_statusLabel->setText(QString("%1/%2 tiles on the canvas...")
+                              .arg(m_engine->progressive()->tilesAdded()).arg(m_engine->tiles().size()));
+    });
+    connect(m_engine, &MosaicEngine::fetchFinished, this, &EnhancedMosaicCreator::assembleFinalMosaicCentered);
+    connect(m_engine, &MosaicEngine::rendered, this, &EnhancedMosaicCreator::onMosaicRendered);
+    
     qDebug() << "=== Enhanced Mosaic Creator - Coordinate Centered ===";
     qDebug() << "Precise coordinate placement with sub-tile accuracy!";
     qDebug() << "Arrow keys: ±0.1° steps, Shift+Arrow: ±0.01° steps";
@@ -262,6 +271,14 @@ void EnhancedMosaicCreator::setupUI() {
     connect(m_zoomToObjectCheckBox, &QCheckBox::toggled, this, &EnhancedMosaicCreator::updatePreviewDisplay);
     leftLayout->addWidget(m_zoomToObjectCheckBox);
     
+    // Background flattening and display stretch, re-applied to the kept mosaic without refetching or recompositing
+    QGroupBox* stretchGroup = new QGroupBox("Display Stretch", leftPanel);
+    QVBoxLayout* stretchLayout = new QVBoxLayout(stretchGroup);
+    m_stretchControls = new StretchControls(m_engine, Qt::Vertical, stretchGroup);
+    connect(m_stretchControls, &StretchControls::restretched, this, &EnhancedMosaicCreator::showStretched);
+    stretchLayout->addWidget(m_stretchControls);
+    leftLayout->addWidget(stretchGroup);
+    
     m_statusLabel = new QLabel("Ready to create coordinate-centered mosaic", leftPanel);
     m_statusLabel->setWordWrap(true);
     leftLayout->addWidget(m_statusLabel);
@@ -809,7 +826,7 @@ void EnhancedMosaicCreator::updateCoordinatePreview() {
     
     // Calculate which HEALPix tile this falls into
     long long nearestPixel = m_hipsClient->calculateHealPixel(m_customTarget, 8);
-    SkyPosition tileCenter = healpixToSkyPosition(nearestPixel, 8);
+    SkyPosition tileCenter = MosaicEngine::tileCenter(nearestPixel, 8);
     
     // Calculate offset from tile center
     double offsetRA = (m_customTarget.ra_deg - tileCenter.ra_deg) * 3600.0; // arcseconds
@@ -859,9 +876,7 @@ void EnhancedMosaicCreator::createMosaic(const MessierObject& messierObj) {
     qDebug() << QString("Target coordinates: RA=%1°, Dec=%2°")
                 .arg(m_actualTarget.ra_deg, 0, 'f', 6)
                 .arg(m_actualTarget.dec_deg, 0, 'f', 6);
-    qDebug() << QString("Starting download of %1 tiles...").arg(m_tiles.size());
-    m_currentTileIndex = 0;
-    processNextTile();
+    m_engine->start();
 }
 
 void EnhancedMosaicCreator::createCustomMosaic(const SkyPosition& target) {
@@ -877,134 +892,27 @@ void EnhancedMosaicCreator::createCustomMosaic(const SkyPosition& target) {
     qDebug() << QString("Target coordinates: RA=%1°, Dec=%2°")
                 .arg(m_actualTarget.ra_deg, 0, 'f', 6)
                 .arg(m_actualTarget.dec_deg, 0, 'f', 6);
-    qDebug() << QString("Starting download of %1 tiles...").arg(m_tiles.size());
-    m_currentTileIndex = 0;
-    processNextTile();
+    m_engine->start();
 }
 
 void EnhancedMosaicCreator::createTileGrid(const SkyPosition& position) {
-    m_tiles.clear();
-    int order = 8;
-    
-    long long centerPixel = m_hipsClient->calculateHealPixel(position, order);
-    QList<QList<long long>> grid = m_hipsClient->createProper3x3Grid(centerPixel, order);
+    m_engine->plan(position);
     
-    qDebug() << QString("Creating 3×3 tile grid around %1:").arg(position.name);
-    
-    for (int y = 0; y < 3; y++) {
-        for (int x = 0; x < 3; x++) {
-            SimpleTile tile;
-            tile.gridX = x;
-            tile.gridY = y;
-            tile.healpixPixel = grid[y][x];
-            tile.downloaded = false;
-            
-            // Calculate the sky coordinates for this tile
-            tile.skyCoordinates = healpixToSkyPosition(tile.healpixPixel, order);
-            
-            QString objectName = position.name.toLower();
-            tile.filename = QString("%1/tile_pixel%5.jpg")
-                           .arg(m_outputDir).arg(tile.healpixPixel);
-            
-            qDebug() << QDir::currentPath() << tile.filename;
-            
-            int dir = (tile.healpixPixel / 10000) * 10000;
-            tile.url = QString("http://alasky.u-strasbg.fr/DSS/DSSColor/Norder%1/Dir%2/Npix%3.jpg")
-                      .arg(order).arg(dir).arg(tile.healpixPixel);
-            
-            // Calculate distance from target to tile center
-            double distance = calculateAngularDistance(m_actualTarget, tile.skyCoordinates);
-            
-            if (tile.healpixPixel == centerPixel) {
-                qDebug() << QString("  Grid(%1,%2): HEALPix %3 ★ NEAREST TILE ★ (%4 arcsec from target)")
-                            .arg(x).arg(y).arg(tile.healpixPixel).arg(distance * 3600.0, 0, 'f', 1);
-            } else {
-                qDebug() << QString("  Grid(%1,%2): HEALPix %3 (%4 arcsec from target)")
-                            .arg(x).arg(y).arg(tile.healpixPixel).arg(distance * 3600.0, 0, 'f', 1);
-            }
-            
-            m_tiles.append(tile);
-        }
+    for (const EngineTile& tile : m_engine->tiles()) {
+        double distance = calculateAngularDistance(m_actualTarget, tile.center);
+        qDebug() << QString("  Grid(%1,%2): HEALPix %3 (%4 arcsec from target)")
+                    .arg(tile.gridX).arg(tile.gridY).arg(tile.healpixPixel).arg(distance * 3600.0, 0, 'f', 1);
     }
     
-    qDebug() << QString("Created %1 tile grid - will crop to center target precisely").arg(m_tiles.size());
-}
-
-void EnhancedMosaicCreator::processNextTile() {
-    if (m_currentTileIndex >= m_tiles.size()) {
-        assembleFinalMosaicCentered();
-        return;
-    }
-    
-    SimpleTile& tile = m_tiles[m_currentTileIndex];
-    if (checkExistingTile(tile)) {
-        m_currentTileIndex++;
-        QTimer::singleShot(100, this, &EnhancedMosaicCreator::processNextTile);
-        return;
-    }
-    
-    downloadTile(m_currentTileIndex);
-}
-
-void EnhancedMosaicCreator::downloadTile(int tileIndex) {
-    if (tileIndex >= m_tiles.size()) return;
-    
-    const SimpleTile& tile = m_tiles[tileIndex];
-    
-    qDebug() << QString("Downloading tile %1/%2: Grid(%3,%4) HEALPix %5")
-                .arg(tileIndex + 1).arg(m_tiles.size())
-                .arg(tile.gridX).arg(tile.gridY)
-                .arg(tile.healpixPixel);
-    
-    QNetworkRequest request(QUrl(tile.url));
-    request.setHeader(QNetworkRequest::UserAgentHeader, "EnhancedMosaicCreator/1.0");
-    request.setRawHeader("Accept", "image/*");
-    
-    m_downloadStartTime = QDateTime::currentDateTime();
-    QNetworkReply* reply = m_networkManager->get(request);
-    
-    reply->setProperty("tileIndex", tileIndex);
-    connect(reply, &QNetworkReply::finished, this, &EnhancedMosaicCreator::onTileDownloaded);
-    
-    QTimer::singleShot(15000, reply, &QNetworkReply::abort);
-}
-
-void EnhancedMosaicCreator::onTileDownloaded() {
-    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
-    if (!reply) return;
-    
-    int tileIndex = reply->property("tileIndex").toInt();
-    if (tileIndex >= m_tiles.size()) {
-        reply->deleteLater();
-        return;
-    }
-    
-    SimpleTile& tile = m_tiles[tileIndex];
-    
-    if (reply->error() == QNetworkReply::NoError) {
-        QByteArray imageData = reply->readAll();
-        tile.image.loadFromData(imageData);
-        
-        if (!tile.image.isNull()) {
-            bool saved = tile.image.save(tile.filename);
-            tile.downloaded = true;
-            
-            qint64 downloadTime = m_downloadStartTime.msecsTo(QDateTime::currentDateTime());
-            qDebug() << QString("✅ Tile %1/%2 downloaded: %3ms, %4 bytes, %5x%6 pixels%7")
-                        .arg(tileIndex + 1).arg(m_tiles.size())
-                        .arg(downloadTime).arg(imageData.size())
-                        .arg(tile.image.width()).arg(tile.image.height())
-                        .arg(saved ? ", saved" : ", save failed");
-        }
-    } else {
-        qDebug() << QString("❌ Tile %1/%2 download failed: %3")
-                    .arg(tileIndex + 1).arg(m_tiles.size())
-                    .arg(reply->errorString());
-    }
+    // Plan the output window from tile sky positions before anything is fetched or decoded
+    QPoint targetPixel = calculateTargetPixelPosition();
+    m_cropRect = planCropRect(targetPixel);
+    m_engine->setWindow(m_cropRect);
     
-    reply->deleteLater();
-    m_currentTileIndex++;
-    QTimer::singleShot(500, this, &EnhancedMosaicCreator::processNextTile);
+    m_fullMosaic = QImage();
+    m_mosaicPyramid = MipPyramid();
+    m_sources.clear();
+    PixelFormat::resetStats();
 }
 
 void EnhancedMosaicCreator::assembleFinalMosaicCentered() {
@@ -1012,113 +920,100 @@ void EnhancedMosaicCreator::assembleFinalMosaicCentered() {
     
     qDebug() << QString("\n=== Assembling Coordinate-Centered %1 Mosaic ===").arg(targetName);
     
-    int successfulTiles = 0;
-    for (const SimpleTile& tile : m_tiles) {
-        if (tile.downloaded && !tile.image.isNull()) {
-            successfulTiles++;
-        }
-    }
-    
-    if (successfulTiles == 0) {
+    if (m_engine->tilesPlaced() == 0) {
         m_statusLabel->setText(QString("Failed to download tiles for %1").arg(targetName));
         m_createButton->setEnabled(true);
         m_createCustomButton->setEnabled(true);
         return;
     }
     
-    // Step 1: Create the raw 3x3 mosaic
-    int tileSize = 512;
-    int rawMosaicSize = 3 * tileSize; // 1536x1536
-    
-    QImage rawMosaic(rawMosaicSize, rawMosaicSize, QImage::Format_RGB32);
-    rawMosaic.fill(Qt::black);
-    
-    QPainter rawPainter(&rawMosaic);
-    
-    qDebug() << QString("Step 1: Assembling raw 3x3 mosaic (%1x%1 pixels)").arg(rawMosaicSize);
-    
-    for (const SimpleTile& tile : m_tiles) {
-        if (!tile.downloaded || tile.image.isNull()) {
-            qDebug() << QString("  Skipping tile %1,%2 - not downloaded").arg(tile.gridX).arg(tile.gridY);
-            continue;
-        }
-        
-        int pixelX = tile.gridX * tileSize;
-        int pixelY = tile.gridY * tileSize;
-        
-        rawPainter.drawImage(pixelX, pixelY, tile.image);
-        
-        qDebug() << QString("  ✅ Placed tile (%1,%2) at pixel (%3,%4)")
-                    .arg(tile.gridX).arg(tile.gridY).arg(pixelX).arg(pixelY);
-    }
-    rawPainter.end();
-    
-    // Step 2: Calculate where the target coordinates fall in the raw mosaic
-    QPoint targetPixel = calculateTargetPixelPosition();
-    
-    qDebug() << QString("Step 2: Target coordinates map to pixel (%1,%2) in raw mosaic")
-                .arg(targetPixel.x()).arg(targetPixel.y());
-    
-    // Step 3: Crop the mosaic to center the target coordinates
-    QImage centeredMosaic = cropMosaicToCenter(rawMosaic, targetPixel);
-    
-    qDebug() << QString("Step 3: Cropped to %1x%2 centered mosaic")
-                .arg(centeredMosaic.width()).arg(centeredMosaic.height());
-    
-    // Step 4: Add crosshairs and labels at the true center
-    QPainter painter(&centeredMosaic);
-    
-    // Add crosshairs at the exact center (where target coordinates are)
-    painter.setPen(QPen(Qt::yellow, 3));
-    int centerX = centeredMosaic.width() / 2;
-    int centerY = centeredMosaic.height() / 2;
-    
-    painter.drawLine(centerX - 30, centerY, centerX + 30, centerY);
-    painter.drawLine(centerX, centerY - 30, centerX, centerY + 30);
-    
-    // Add precise coordinate labels
-    painter.setPen(QPen(Qt::yellow, 1));
-    painter.setFont(QFont("Arial", 14, QFont::Bold));
+    // Step 1: The planned output window was composed tile by tile as each one decoded.
+    // Every tile sits at its offset relative to the window and only the rows and columns
+    // inside it were copied, so the 1536x1536 raw mosaic is never materialized.
+    qDebug() << QString("Step 1: Composed %1x%2 output window at (%3,%4) of the 3x3 grid")
+                .arg(m_cropRect.width()).arg(m_cropRect.height())
+                .arg(m_cropRect.x()).arg(m_cropRect.y());
+    MosaicRenderRequest request = m_engine->renderRequest();
     
+    // Step 2: Add crosshairs and labels at the true center. The overlay runs on the
+    // render pool together with the PNG encode, so it only captures values.
     QString labelText = targetName;
     if (!m_usingCustomCoordinates && !m_currentObject.common_name.isEmpty()) {
         labelText = m_currentObject.common_name;
     }
-    painter.drawText(centerX + 40, centerY - 20, labelText);
-    
-    painter.setFont(QFont("Arial", 10));
     QString coordText = QString("RA:%1° Dec:%2°")
                        .arg(m_actualTarget.ra_deg, 0, 'f', 4)
                        .arg(m_actualTarget.dec_deg, 0, 'f', 4);
-    painter.drawText(centerX + 40, centerY - 5, coordText);
-    
-    painter.drawText(centerX + 40, centerY + 10, "COORDINATE CENTERED");
     
-    painter.end();
+    request.overlay = [labelText, coordText](QImage& centeredMosaic) {
+        QPainter painter(&centeredMosaic);
+        
+        // Add crosshairs at the exact center (where target coordinates are)
+        painter.setPen(QPen(Qt::yellow, 3));
+        int centerX = centeredMosaic.width() / 2;
+        int centerY = centeredMosaic.height() / 2;
+        
+        painter.drawLine(centerX - 30, centerY, centerX + 30, centerY);
+        painter.drawLine(centerX, centerY - 30, centerX, centerY + 30);
+        
+        // Add precise coordinate labels
+        painter.setPen(QPen(Qt::yellow, 1));
+        painter.setFont(QFont("Arial", 14, QFont::Bold));
+        painter.drawText(centerX + 40, centerY - 20, labelText);
+        
+        painter.setFont(QFont("Arial", 10));
+        painter.drawText(centerX + 40, centerY - 5, coordText);
+        
+        painter.drawText(centerX + 40, centerY + 10, "COORDINATE CENTERED");
+        
+        painter.end();
+    };
     
-    // Store the final centered mosaic
-    m_fullMosaic = centeredMosaic;
+    // The saved PNG carries the flatten and stretch shown now; later changes only affect the display
+    request.flatten = m_stretchControls->flatten();
+    request.stretch = m_stretchControls->stretch();
     
-    // Save final mosaic
     QString safeName = targetName.toLower().replace(" ", "_").replace("(", "").replace(")", "");
-    QString mosaicFilename = QString("%1/%2_centered_mosaic.png").arg(m_outputDir).arg(safeName);
-    bool saved = centeredMosaic.save(mosaicFilename);
+    m_renderTargetName = targetName;
+    m_mosaicFilename = QString("%1/%2_centered_mosaic.png").arg(m_outputDir).arg(safeName);
+    m_deepZoomFilename = QString("%1/%2_centered_deepzoom.dzi").arg(m_outputDir).arg(safeName);
+    request.outputFile = m_mosaicFilename;
+    request.previewFile = QString("%1/%2_centered_preview.jpg").arg(m_outputDir).arg(safeName);
+    request.deepZoomFile = m_deepZoomFilename;
+    request.extractSources = true;
+    
+    m_statusLabel->setText(QString("Rendering %1 mosaic...").arg(targetName));
+    m_engine->render(request);
+}
+
+void EnhancedMosaicCreator::onMosaicRendered(const MosaicFrame& frame) {
+    const QString& targetName = m_renderTargetName;
+    
+    // Store the final centered mosaic
+    m_fullMosaic = frame.mosaic;
+    m_mosaicPyramid = frame.pyramid;
+    m_sources = frame.sources;
     
     qDebug() << QString("\n🎯 %1 COORDINATE-CENTERED MOSAIC COMPLETE!").arg(targetName);
     qDebug() << QString("📁 Final size: %1×%2 pixels (%3 tiles used)")
-                .arg(centeredMosaic.width()).arg(centeredMosaic.height()).arg(successfulTiles);
+                .arg(frame.mosaic.width()).arg(frame.mosaic.height()).arg(frame.tilesPlaced);
     qDebug() << QString("📁 Saved to: %1 (%2)")
-                .arg(mosaicFilename).arg(saved ? "SUCCESS" : "FAILED");
+                .arg(m_mosaicFilename).arg(frame.saved ? "SUCCESS" : "FAILED");
+    qDebug() << QString("🗺️ Deep zoom pyramid: %1").arg(m_deepZoomFilename);
     qDebug() << QString("✅ Target coordinates are now at exact center pixel (%1,%2)")
-                .arg(centerX).arg(centerY);
-    
-    // Update preview
-    updatePreviewDisplay();
-    
-    // Save preview
-    QString previewFilename = QString("%1/%2_centered_preview.jpg").arg(m_outputDir).arg(safeName);
-    QImage preview512 = centeredMosaic.scaled(512, 512, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    preview512.save(previewFilename);
+                .arg(frame.mosaic.width() / 2).arg(frame.mosaic.height() / 2);
+    qDebug() << QString("⏱️ Render: compose %1ms (flatten %2ms), encode %3ms (off the GUI thread)")
+                .arg(frame.composeMs).arg(frame.flattenMs).arg(frame.encodeMs);
+    qDebug() << QString("⭐ %1 sources extracted in %2ms").arg(m_sources.size()).arg(frame.extractMs);
+    m_tileCache->memoryCache()->logStats("Tile cache");
+    PixelFormat::logStats("Pixel formats");
+    
+    // Update preview; the unzoomed view was already scaled on the worker
+    if (m_zoomToObjectCheckBox->isChecked()) {
+        updatePreviewDisplay();
+    } else {
+        m_previewLabel->setPixmap(PixelFormat::toPixmap(frame.display, "preview"));
+    }
     
     saveProgressReport(targetName);
     
@@ -1131,11 +1026,11 @@ void EnhancedMosaicCreator::assembleFinalMosaicCentered() {
 
 QPoint EnhancedMosaicCreator::calculateTargetPixelPosition() {
     // Find the tile that contains our target
-    SimpleTile* containingTile = nullptr;
+    const EngineTile* containingTile = nullptr;
     double minDistance = std::numeric_limits<double>::max();
     
-    for (SimpleTile& tile : m_tiles) {
-        double distance = calculateAngularDistance(m_actualTarget, tile.skyCoordinates);
+    for (const EngineTile& tile : m_engine->tiles()) {
+        double distance = calculateAngularDistance(m_actualTarget, tile.center);
         if (distance < minDistance) {
             minDistance = distance;
             containingTile = &tile;
@@ -1149,15 +1044,15 @@ QPoint EnhancedMosaicCreator::calculateTargetPixelPosition() {
     
     qDebug() << QString("Target is in tile (%1,%2) with center at RA=%3°, Dec=%4°")
                 .arg(containingTile->gridX).arg(containingTile->gridY)
-                .arg(containingTile->skyCoordinates.ra_deg, 0, 'f', 6)
-                .arg(containingTile->skyCoordinates.dec_deg, 0, 'f', 6);
+                .arg(containingTile->center.ra_deg, 0, 'f', 6)
+                .arg(containingTile->center.dec_deg, 0, 'f', 6);
     
     // Use definitive astrometry data
     const double ARCSEC_PER_PIXEL = 1.61;
     
     // Calculate angular offsets from the nearest tile center
-    double offsetRA_arcsec = (m_actualTarget.ra_deg - containingTile->skyCoordinates.ra_deg) * 3600.0;
-    double offsetDec_arcsec = (m_actualTarget.dec_deg - containingTile->skyCoordinates.dec_deg) * 3600.0;
+    double offsetRA_arcsec = (m_actualTarget.ra_deg - containingTile->center.ra_deg) * 3600.0;
+    double offsetDec_arcsec = (m_actualTarget.dec_deg - containingTile->center.dec_deg) * 3600.0;
     
     // Apply cosine correction for RA at this declination
     offsetRA_arcsec *= cos(m_actualTarget.dec_deg * M_PI / 180.0);
@@ -1191,12 +1086,10 @@ QPoint EnhancedMosaicCreator::calculateTargetPixelPosition() {
     return QPoint(targetPixelX, targetPixelY);
 }
 
-QImage EnhancedMosaicCreator::cropMosaicToCenter(const QImage& rawMosaic, const QPoint& targetPixel) {
-    // Determine crop size - aim for ~1200x1200 final mosaic
-    int cropSize = 1200;
-    
-    // Ensure we don't exceed the raw mosaic bounds
-    cropSize = std::min(cropSize, std::min(rawMosaic.width(), rawMosaic.height()));
+QRect EnhancedMosaicCreator::planCropRect(const QPoint& targetPixel) const {
+    // Crop window inside the 1536x1536 area covered by the 3x3 grid
+    const int rawMosaicSize = 3 * 512;
+    int cropSize = std::min(m_outputSize, rawMosaicSize);
     
     // Calculate crop rectangle so target pixel becomes the center
     int cropX = targetPixel.x() - cropSize / 2;
@@ -1211,48 +1104,21 @@ QImage EnhancedMosaicCreator::cropMosaicToCenter(const QImage& rawMosaic, const
         qDebug() << QString("Crop Y adjusted from %1 to 0 (target too close to top edge)").arg(cropY);
         cropY = 0;
     }
-    if (cropX + cropSize > rawMosaic.width()) {
+    if (cropX + cropSize > rawMosaicSize) {
         int oldCropX = cropX;
-        cropX = rawMosaic.width() - cropSize;
+        cropX = rawMosaicSize - cropSize;
         qDebug() << QString("Crop X adjusted from %1 to %2 (target too close to right edge)").arg(oldCropX).arg(cropX);
     }
-    if (cropY + cropSize > rawMosaic.height()) {
+    if (cropY + cropSize > rawMosaicSize) {
         int oldCropY = cropY;
-        cropY = rawMosaic.height() - cropSize;
+        cropY = rawMosaicSize - cropSize;
         qDebug() << QString("Crop Y adjusted from %1 to %2 (target too close to bottom edge)").arg(oldCropY).arg(cropY);
     }
     
-    QRect cropRect(cropX, cropY, cropSize, cropSize);
-    
     qDebug() << QString("Crop rectangle: (%1,%2) %3x%4")
                 .arg(cropX).arg(cropY).arg(cropSize).arg(cropSize);
     
-    return rawMosaic.copy(cropRect);
-}
-
-SkyPosition EnhancedMosaicCreator::healpixToSkyPosition(long long pixel, int order) const {
-    try {
-        long long nside = 1LL << order;
-        Healpix_Base healpix(nside, NEST, SET_NSIDE);
-        
-        pointing pt = healpix.pix2ang(pixel);
-        
-        SkyPosition pos;
-        pos.ra_deg = pt.phi * 180.0 / M_PI;
-        pos.dec_deg = 90.0 - pt.theta * 180.0 / M_PI;
-        pos.name = QString("HEALPix_%1").arg(pixel);
-        pos.description = QString("Order %1 pixel %2").arg(order).arg(pixel);
-        
-        return pos;
-    } catch (...) {
-        // Fallback
-        SkyPosition pos;
-        pos.ra_deg = 0.0;
-        pos.dec_deg = 0.0;
-        pos.name = "Error";
-        pos.description = "HEALPix conversion failed";
-        return pos;
-    }
+    return QRect(cropX, cropY, cropSize, cropSize);
 }
 
 double EnhancedMosaicCreator::calculateAngularDistance(const SkyPosition& pos1, const SkyPosition& pos2) const {
@@ -1276,20 +1142,24 @@ double EnhancedMosaicCreator::calculateAngularDistance(const SkyPosition& pos1,
 void EnhancedMosaicCreator::updatePreviewDisplay() {
     if (m_fullMosaic.isNull()) return;
     
-    QImage displayImage;
+    QRect crop = m_zoomToObjectCheckBox->isChecked() ? zoomedViewRect(m_fullMosaic) : QRect();
     
-    if (m_zoomToObjectCheckBox->isChecked()) {
-        displayImage = createZoomedView(m_fullMosaic);
-    } else {
-        displayImage = m_fullMosaic;
+    // Scaled from the nearest pyramid level, never from the full-resolution mosaic
+    if (m_mosaicPyramid.size() != m_fullMosaic.size()) {
+        m_mosaicPyramid = MipPyramid(m_fullMosaic);
     }
-    
-    QPixmap preview = QPixmap::fromImage(displayImage.scaled(400, 400, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    QPixmap preview = PixelFormat::toPixmap(m_mosaicPyramid.scaled(QSize(400, 400), Qt::KeepAspectRatio, crop), "preview");
     m_previewLabel->setPixmap(preview);
 }
 
-QImage EnhancedMosaicCreator::createZoomedView(const QImage& fullMosaic) {
-    if (fullMosaic.isNull()) return QImage();
+void EnhancedMosaicCreator::showStretched(const QImage& mosaic) {
+    m_fullMosaic = mosaic;
+    m_mosaicPyramid = MipPyramid(m_fullMosaic);
+    updatePreviewDisplay();
+}
+
+QRect EnhancedMosaicCreator::zoomedViewRect(const QImage& fullMosaic) {
+    if (fullMosaic.isNull()) return QRect();
     
     // For coordinate-centered mosaics, the target is already at the center
     double objectSize = 10.0; // Default for custom targets
@@ -1317,7 +1187,7 @@ QImage EnhancedMosaicCreator::createZoomedView(const QImage& fullMosaic) {
     cropX = std::max(0, std::min(cropX, fullMosaic.width() - cropSize));
     cropY = std::max(0, std::min(cropY, fullMosaic.height() - cropSize));
     
-    return fullMosaic.copy(QRect(cropX, cropY, cropSize, cropSize));
+    return QRect(cropX, cropY, cropSize, cropSize);
 }
 
 QPoint EnhancedMosaicCreator::findBrightnessCenter(const QImage& image) {
@@ -1325,67 +1195,6 @@ QPoint EnhancedMosaicCreator::findBrightnessCenter(const QImage& image) {
     return QPoint(image.width()/2, image.height()/2);
 }
 
-QImage EnhancedMosaicCreator::applyGaussianBlur(const QImage& image, int radius) {
-    if (image.isNull() || radius <= 0) return image;
-    
-    // Simple box blur approximation
-    QImage result = image.copy();
-    int width = result.width();
-    int height = result.height();
-    
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int totalR = 0, totalG = 0, totalB = 0;
-            int count = 0;
-            
-            for (int dx = -radius; dx <= radius; dx++) {
-                int nx = x + dx;
-                if (nx >= 0 && nx < width) {
-                    QRgb pixel = image.pixel(nx, y);
-                    totalR += qRed(pixel);
-                    totalG += qGreen(pixel);
-                    totalB += qBlue(pixel);
-                    count++;
-                }
-            }
-            
-            if (count > 0) {
-                result.setPixel(x, y, qRgb(totalR/count, totalG/count, totalB/count));
-            }
-        }
-    }
-    
-    return result;
-}
-
-bool EnhancedMosaicCreator::checkExistingTile(const SimpleTile& tile) {
-    QFileInfo fileInfo(tile.filename);
-    if (!fileInfo.exists() || fileInfo.size() < 1024) return false;
-    
-    if (!isValidJpeg(tile.filename)) return false;
-    
-    SimpleTile* mutableTile = const_cast<SimpleTile*>(&tile);
-    mutableTile->image.load(tile.filename);
-    
-    if (mutableTile->image.isNull()) return false;
-    
-    mutableTile->downloaded = true;
-    return true;
-}
-
-bool EnhancedMosaicCreator::isValidJpeg(const QString& filename) {
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly)) return false;
-    
-    QByteArray header = file.read(4);
-    file.close();
-    
-    return (header.size() >= 3 && 
-            static_cast<unsigned char>(header[0]) == 0xFF && 
-            static_cast<unsigned char>(header[1]) == 0xD8 && 
-            static_cast<unsigned char>(header[2]) == 0xFF);
-}
-
 void EnhancedMosaicCreator::saveProgressReport(const QString& targetName) {
     QString safeName = targetName.toLower().replace(" ", "_").replace("(", "").replace(")", "");
     QString reportFile = QString("%1/%2_centered_report.txt").arg(m_outputDir).arg(safeName);
@@ -1417,17 +1226,27 @@ void EnhancedMosaicCreator::saveProgressReport(const QString& targetName) {
     out << "\n3x3 Tile Grid Used:\n";
     out << "Grid_X,Grid_Y,HEALPix_Pixel,Tile_RA,Tile_Dec,Downloaded,ImageSize,Filename\n";
     
-    for (const SimpleTile& tile : m_tiles) {
+    for (const EngineTile& tile : m_engine->tiles()) {
         out << QString("%1,%2,%3,%4,%5,%6,%7x%8,%9\n")
                .arg(tile.gridX).arg(tile.gridY)
                .arg(tile.healpixPixel)
-               .arg(tile.skyCoordinates.ra_deg, 0, 'f', 6)
-               .arg(tile.skyCoordinates.dec_deg, 0, 'f', 6)
+               .arg(tile.center.ra_deg, 0, 'f', 6)
+               .arg(tile.center.dec_deg, 0, 'f', 6)
                .arg(tile.downloaded ? "YES" : "NO")
                .arg(tile.image.width()).arg(tile.image.height())
                .arg(tile.filename);
     }
     
+    // Brightest detections, for guiding simulations and alignment checks
+    out << QString("\nDetected sources: %1 (brightest 20 below)\n").arg(m_sources.size());
+    out << "X,Y,Flux,Peak,Area\n";
+    for (int i = 0; i < std::min<qsizetype>(20, m_sources.size()); i++) {
+        const ExtractedSource& source = m_sources[i];
+        out << QString("%1,%2,%3,%4,%5\n")
+               .arg(source.centroid.x(), 0, 'f', 2).arg(source.centroid.y(), 0, 'f', 2)
+               .arg(source.flux, 0, 'f', 0).arg(source.peak, 0, 'f', 1).arg(source.area);
+    }
+    
     file.close();
 }
 
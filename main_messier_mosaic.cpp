@@ -1,12 +1,7 @@
 // main_messier_mosaic.cpp - Messier object selection version
 #include <QApplication>
 #include <QDebug>
-#include <QTimer>
 #include <QDir>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
-#include <QUrl>
-#include <QNetworkRequest>
 #include <QPixmap>
 #include <QImage>
 #include <QPainter>
@@ -22,6 +17,17 @@
 #include <QCheckBox>
 #include "ProperHipsClient.h"
 #include "MessierCatalog.h"
+#include "TileCache.h"
+#include "TileMemoryCache.h"
+#include "MosaicEngine.h"
+#include "MosaicRenderer.h"
+#include "ProgressiveMosaic.h"
+#include "ImageFilters.h"
+#include "BrightnessCentroid.h"
+#include "MipPyramid.h"
+#include "PixelFormat.h"
+#include "StretchControls.h"
+#include <algorithm>
 
 class MessierMosaicCreator : public QWidget {
     Q_OBJECT
@@ -33,13 +39,13 @@ public:
 private slots:
     void onObjectSelectionChanged();
     void onCreateMosaicClicked();
-    void onTileDownloaded();
-    void processNextTile();
     void assembleFinalMosaic();
+    void onMosaicRendered(const MosaicFrame& frame);
 
 private:
     ProperHipsClient* m_hipsClient;
-    QNetworkAccessManager* m_networkManager;
+    TileCache* m_tileCache;
+    MosaicEngine* m_engine;  // Grid, fetch, decode and compose; this class only drives the UI
     
     // UI Components
     QComboBox* m_objectSelector;
@@ -49,43 +55,36 @@ private:
     QLabel* m_previewLabel;
     QLabel* m_statusLabel;
     QCheckBox* m_zoomToObjectCheckBox;
+    StretchControls* m_stretchControls;  // Flatten and stretch, re-applied through m_engine
     
     // Current selection
     MessierObject m_currentObject;
     QImage m_fullMosaic;  // Store the full mosaic for zooming
+    QImage m_coarseMosaic;  // 1/8 scale copy built while tiles decoded, for auto-centering
+    MipPyramid m_mosaicPyramid;  // Halving levels of m_fullMosaic for preview rescales and crops
+    QList<ExtractedSource> m_sources;  // Stars found on the linear mosaic, brightest first
     
-    // Simple tile structure for 3x3 grid
-    struct SimpleTile {
-        int gridX, gridY;
-        long long healpixPixel;
-        QString filename;
-        QString url;
-        QImage image;
-        bool downloaded;
-    };
-    
-    QList<SimpleTile> m_tiles;
-    int m_currentTileIndex;
     QString m_outputDir;
-    QDateTime m_downloadStartTime;
+    QString m_mosaicFilename;
+    QString m_previewFilename;
+    QString m_deepZoomFilename;
+    QString m_labelText;
     
     void setupUI();
     void updateObjectInfo();
-    void createTileGrid(const SkyPosition& position);
-    void downloadTile(int tileIndex);
     void saveProgressReport();
-    bool checkExistingTile(const SimpleTile& tile);
-    bool isValidJpeg(const QString& filename);
-    QImage createZoomedView(const QImage& fullMosaic);
+    QRect zoomedViewRect(const QImage& fullMosaic);
     void updatePreviewDisplay();
+    void showStretched(const QImage& mosaic);
     QPoint findBrightnessCenter(const QImage& image);
-    QImage applyGaussianBlur(const QImage& image, int radius);
 };
 
 MessierMosaicCreator::MessierMosaicCreator(QWidget *parent) : QWidget(parent) {
     m_hipsClient = new ProperHipsClient(this);
-    m_networkManager = new QNetworkAccessManager(this);
-    m_currentTileIndex = 0;
+    m_tileCache = new TileCache("hips_tile_cache", this);
+    m_engine = new MosaicEngine(m_tileCache, m_hipsClient, this);
+    m_engine->setUserAgent("MessierMosaicCreator/1.0");
+    m_engine->setSeamWidth(32);   // Fallback surveys differ in brightness tile to tile
     
     // Create output directory
     m_outputDir = "messier_mosaics";
@@ -93,6 +92,17 @@ MessierMosaicCreator::MessierMosaicCreator(QWidget *parent) : QWidget(parent) {
     
     setupUI();
     
+    // Live preview while tiles arrive; the finished frame replaces it at the end
+    connect(m_engine, &MosaicEngine::previewUpdated, this, [this](const QImage& preview) {
+        m_previewLabel->setPixmap(PixelFormat::toPixmap(preview, "live preview"));
+    });
+    connect(m_engine, &MosaicEngine::tileStarted, this, [this](int index, bool fromCache) {
+        m_statusLabel->setText(QString(fromCache ? "Using existing tile %1/%2 for %3..." : "Downloading tile %1/%2 for %3...")
+                              .arg(index + 1).arg(m_engine->tiles().size()).arg(m_currentObject.name));
+    });
+    connect(m_engine, &MosaicEngine::fetchFinished, this, &MessierMosaicCreator::assembleFinalMosaic);
+    connect(m_engine, &MosaicEngine::rendered, this, &MessierMosaicCreator::onMosaicRendered);
+    
     qDebug() << "=== Messier Object Mosaic Creator ===";
     qDebug() << "Select any Messier object to create a 3x3 HiPS mosaic!";
 }
@@ -170,6 +180,11 @@ void MessierMosaicCreator::setupUI() {
     previewLayout->addStretch();
     resultsLayout->addLayout(previewLayout);
     
+    // Background flattening and display stretch, re-applied to the kept mosaic without refetching or recompositing
+    m_stretchControls = new StretchControls(m_engine, Qt::Horizontal, this);
+    connect(m_stretchControls, &StretchControls::restretched, this, &MessierMosaicCreator::showStretched);
+    resultsLayout->addWidget(m_stretchControls);
+    
     mainLayout->addWidget(resultsGroup);
     
     // Initialize with first object
@@ -241,168 +256,23 @@ void MessierMosaicCreator::createMosaic(const MessierObject& messierObj) {
                 .arg(messierObj.sky_position.ra_deg)
                 .arg(messierObj.sky_position.dec_deg);
     
-    createTileGrid(messierObj.sky_position);
-    
-    qDebug() << QString("Starting download of %1 tiles...").arg(m_tiles.size());
-    m_currentTileIndex = 0;
-    processNextTile();
-}
-
-void MessierMosaicCreator::createTileGrid(const SkyPosition& position) {
-    m_tiles.clear();
-    int order = 8;
-    
-    // Calculate 3x3 grid around the target position
-    long long centerPixel = m_hipsClient->calculateHealPixel(position, order);
-    QList<QList<long long>> grid = m_hipsClient->createProper3x3Grid(centerPixel, order);
-    
-    qDebug() << QString("Creating 3×3 tile grid for %1:").arg(position.name);
-    
-    for (int y = 0; y < 3; y++) {
-        for (int x = 0; x < 3; x++) {
-            SimpleTile tile;
-            tile.gridX = x;
-            tile.gridY = y;
-            tile.healpixPixel = grid[y][x];
-            tile.downloaded = false;
-            
-            // Build filename and URL
-            QString objectName = m_currentObject.name.toLower();
-            tile.filename = QString("%1/%2_tile_%3_%4_pixel%5.jpg")
-                           .arg(m_outputDir).arg(objectName).arg(x).arg(y).arg(tile.healpixPixel);
-            
-            int dir = (tile.healpixPixel / 10000) * 10000;
-            tile.url = QString("http://alasky.u-strasbg.fr/DSS/DSSColor/Norder%1/Dir%2/Npix%3.jpg")
-                      .arg(order).arg(dir).arg(tile.healpixPixel);
-            
-            if (tile.healpixPixel == centerPixel) {
-                qDebug() << QString("  Grid(%1,%2): HEALPix %3 ★ TARGET TILE! ★")
-                            .arg(x).arg(y).arg(tile.healpixPixel);
-            } else {
-                qDebug() << QString("  Grid(%1,%2): HEALPix %3")
-                            .arg(x).arg(y).arg(tile.healpixPixel);
-            }
-            
-            m_tiles.append(tile);
-        }
-    }
-    
-    qDebug() << QString("Created %1 tile grid for %2").arg(m_tiles.size()).arg(position.name);
-}
-
-void MessierMosaicCreator::processNextTile() {
-    if (m_currentTileIndex >= m_tiles.size()) {
-        assembleFinalMosaic();
-        return;
-    }
-    
-    // Check if tile already exists and is valid before downloading
-    SimpleTile& tile = m_tiles[m_currentTileIndex];
-    if (checkExistingTile(tile)) {
-        qDebug() << QString("✓ Using existing tile %1/%2: %3")
-                    .arg(m_currentTileIndex + 1).arg(m_tiles.size())
-                    .arg(QFileInfo(tile.filename).fileName());
-        
-        m_statusLabel->setText(QString("Using existing tile %1/%2 for %3...")
-                              .arg(m_currentTileIndex + 1).arg(m_tiles.size()).arg(m_currentObject.name));
-        
-        m_currentTileIndex++;
-        
-        // Small delay before processing next tile
-        QTimer::singleShot(100, this, &MessierMosaicCreator::processNextTile);
-        return;
-    }
-    
-    downloadTile(m_currentTileIndex);
-}
-
-void MessierMosaicCreator::downloadTile(int tileIndex) {
-    if (tileIndex >= m_tiles.size()) return;
-    
-    const SimpleTile& tile = m_tiles[tileIndex];
-    
-    qDebug() << QString("Downloading tile %1/%2: Grid(%3,%4) HEALPix %5")
-                .arg(tileIndex + 1).arg(m_tiles.size())
-                .arg(tile.gridX).arg(tile.gridY)
-                .arg(tile.healpixPixel);
-    
-    m_statusLabel->setText(QString("Downloading tile %1/%2 for %3...")
-                          .arg(tileIndex + 1).arg(m_tiles.size()).arg(m_currentObject.name));
-    
-    // Create network request
-    QNetworkRequest request(QUrl(tile.url));
-    request.setHeader(QNetworkRequest::UserAgentHeader, "MessierMosaicCreator/1.0");
-    request.setRawHeader("Accept", "image/*");
-    
-    m_downloadStartTime = QDateTime::currentDateTime();
-    QNetworkReply* reply = m_networkManager->get(request);
-    
-    // Store tile index in reply
-    reply->setProperty("tileIndex", tileIndex);
-    
-    connect(reply, &QNetworkReply::finished, this, &MessierMosaicCreator::onTileDownloaded);
+    m_fullMosaic = QImage();
+    m_mosaicPyramid = MipPyramid();
+    m_sources.clear();
+    m_coarseMosaic = QImage();
+    PixelFormat::resetStats();
     
-    // Set timeout
-    QTimer::singleShot(15000, reply, &QNetworkReply::abort);
-}
-
-void MessierMosaicCreator::onTileDownloaded() {
-    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
-    if (!reply) return;
-    
-    int tileIndex = reply->property("tileIndex").toInt();
-    if (tileIndex >= m_tiles.size()) {
-        reply->deleteLater();
-        return;
-    }
-    
-    SimpleTile& tile = m_tiles[tileIndex];
-    
-    if (reply->error() == QNetworkReply::NoError) {
-        QByteArray imageData = reply->readAll();
-        tile.image.loadFromData(imageData);
-        
-        if (!tile.image.isNull()) {
-            bool saved = tile.image.save(tile.filename);
-            tile.downloaded = true;
-            
-            qint64 downloadTime = m_downloadStartTime.msecsTo(QDateTime::currentDateTime());
-            
-            qDebug() << QString("✅ Tile %1/%2 downloaded: %3ms, %4 bytes, %5x%6 pixels%7")
-                        .arg(tileIndex + 1).arg(m_tiles.size())
-                        .arg(downloadTime).arg(imageData.size())
-                        .arg(tile.image.width()).arg(tile.image.height())
-                        .arg(saved ? ", saved" : ", save failed");
-        } else {
-            qDebug() << QString("❌ Tile %1/%2 - invalid image data")
-                        .arg(tileIndex + 1).arg(m_tiles.size());
-        }
-    } else {
-        qDebug() << QString("❌ Tile %1/%2 download failed: %3")
-                    .arg(tileIndex + 1).arg(m_tiles.size())
-                    .arg(reply->errorString());
-    }
-    
-    reply->deleteLater();
-    
-    m_currentTileIndex++;
-    
-    // Small delay between downloads
-    QTimer::singleShot(500, this, &MessierMosaicCreator::processNextTile);
+    // The engine plans the grid, fetches center tile first and composes as tiles decode
+    m_engine->plan(messierObj.sky_position);
+    m_engine->start();
 }
 
 void MessierMosaicCreator::assembleFinalMosaic() {
     qDebug() << QString("\n=== Assembling %1 Mosaic ===").arg(m_currentObject.name);
     
-    int successfulTiles = 0;
-    for (const SimpleTile& tile : m_tiles) {
-        if (tile.downloaded && !tile.image.isNull()) {
-            successfulTiles++;
-        }
-    }
-    
+    int successfulTiles = m_engine->tilesPlaced();
     qDebug() << QString("Downloaded %1/%2 tiles for %3")
-                .arg(successfulTiles).arg(m_tiles.size()).arg(m_currentObject.name);
+                .arg(successfulTiles).arg(m_engine->tiles().size()).arg(m_currentObject.name);
     
     if (successfulTiles == 0) {
         qDebug() << "❌ No tiles downloaded successfully";
@@ -411,94 +281,89 @@ void MessierMosaicCreator::assembleFinalMosaic() {
         return;
     }
     
-    // Create 3x3 mosaic: 3*512 = 1536 pixels
-    int tileSize = 512;
-    int mosaicSize = 3 * tileSize; // 1536x1536
-    
-    QImage finalMosaic(mosaicSize, mosaicSize, QImage::Format_RGB32);
-    finalMosaic.fill(Qt::black);
-    
-    QPainter painter(&finalMosaic);
-    
-    int tilesPlaced = 0;
-    
     qDebug() << QString("Placing tiles for %1 in 3x3 grid:").arg(m_currentObject.name);
+    MosaicRenderRequest request = m_engine->renderRequest();
     
-    for (const SimpleTile& tile : m_tiles) {
-        if (!tile.downloaded || tile.image.isNull()) {
-            qDebug() << QString("  Skipping tile %1,%2 - not downloaded").arg(tile.gridX).arg(tile.gridY);
-            continue;
-        }
-        
-        // Simple placement: gridX * 512, gridY * 512
-        int pixelX = tile.gridX * tileSize;
-        int pixelY = tile.gridY * tileSize;
-        
-        // Draw the tile
-        painter.drawImage(pixelX, pixelY, tile.image);
-        
-        tilesPlaced++;
-        
-        qDebug() << QString("  ✅ Placed tile (%1,%2) at pixel (%3,%4)")
-                    .arg(tile.gridX).arg(tile.gridY).arg(pixelX).arg(pixelY);
-    }
-    
-    // Add crosshairs and label at center
-    painter.setPen(QPen(Qt::yellow, 3));
-    int centerX = mosaicSize / 2;
-    int centerY = mosaicSize / 2;
-    
-    // Draw crosshairs
-    painter.drawLine(centerX - 30, centerY, centerX + 30, centerY);
-    painter.drawLine(centerX, centerY - 30, centerX, centerY + 30);
-    
-    // Add object label
-    painter.setPen(QPen(Qt::yellow, 1));
-    painter.setFont(QFont("Arial", 14, QFont::Bold));
     QString labelText = m_currentObject.name;
     if (!m_currentObject.common_name.isEmpty()) {
         labelText = m_currentObject.common_name;
     }
-    painter.drawText(centerX + 40, centerY - 10, labelText);
+    QString typeText = MessierCatalog::objectTypeToString(m_currentObject.object_type);
     
-    // Add object type label
-    painter.setFont(QFont("Arial", 10));
-    painter.drawText(centerX + 40, centerY + 10, 
-                    MessierCatalog::objectTypeToString(m_currentObject.object_type));
-    
-    painter.end();
+    // Captures by value only - the overlay is drawn on a worker thread
+    const QSize canvasSize = request.canvasSize;
+    request.overlay = [canvasSize, labelText, typeText](QImage& mosaic) {
+        QPainter painter(&mosaic);
+        
+        // Add crosshairs and label at center
+        painter.setPen(QPen(Qt::yellow, 3));
+        int centerX = canvasSize.width() / 2;
+        int centerY = canvasSize.height() / 2;
+        
+        // Draw crosshairs
+        painter.drawLine(centerX - 30, centerY, centerX + 30, centerY);
+        painter.drawLine(centerX, centerY - 30, centerX, centerY + 30);
+        
+        // Add object label
+        painter.setPen(QPen(Qt::yellow, 1));
+        painter.setFont(QFont("Arial", 14, QFont::Bold));
+        painter.drawText(centerX + 40, centerY - 10, labelText);
+        
+        // Add object type label
+        painter.setFont(QFont("Arial", 10));
+        painter.drawText(centerX + 40, centerY + 10, typeText);
+        
+        painter.end();
+    };
     
-    // Store the full mosaic for potential zooming
-    m_fullMosaic = finalMosaic;
+    // The saved PNG carries the flatten and stretch shown now; later changes only affect the display
+    request.flatten = m_stretchControls->flatten();
+    request.stretch = m_stretchControls->stretch();
     
-    // Save final mosaic
     QString objectName = m_currentObject.name.toLower();
-    QString mosaicFilename = QString("%1/%2_mosaic_3x3.png").arg(m_outputDir).arg(objectName);
-    bool saved = finalMosaic.save(mosaicFilename);
+    m_mosaicFilename = QString("%1/%2_mosaic_3x3.png").arg(m_outputDir).arg(objectName);
+    m_previewFilename = QString("%1/%2_preview.jpg").arg(m_outputDir).arg(objectName);
+    m_deepZoomFilename = QString("%1/%2_deepzoom.dzi").arg(m_outputDir).arg(objectName);
+    m_labelText = labelText;
+    request.outputFile = m_mosaicFilename;
+    request.previewFile = m_previewFilename;
+    request.deepZoomFile = m_deepZoomFilename;
+    request.extractSources = true;
+    
+    m_statusLabel->setText(QString("Rendering %1 mosaic...").arg(m_currentObject.name));
+    m_engine->render(request);
+}
+
+void MessierMosaicCreator::onMosaicRendered(const MosaicFrame& frame) {
+    // Store the full mosaic for potential zooming
+    m_fullMosaic = frame.mosaic;
+    m_mosaicPyramid = frame.pyramid;
+    m_sources = frame.sources;
+    m_coarseMosaic = m_engine->progressive()->coarseCanvas();
     
+    qDebug() << QString("🗺️ Deep zoom pyramid: %1").arg(m_deepZoomFilename);
     qDebug() << QString("\n🖼️  %1 mosaic complete!").arg(m_currentObject.name);
     qDebug() << QString("📁 Size: %1×%2 pixels (%3 tiles placed)")
-                .arg(mosaicSize).arg(mosaicSize).arg(tilesPlaced);
+                .arg(frame.mosaic.width()).arg(frame.mosaic.height()).arg(frame.tilesPlaced);
     qDebug() << QString("📁 Saved to: %1 (%2)")
-                .arg(mosaicFilename).arg(saved ? "SUCCESS" : "FAILED");
+                .arg(m_mosaicFilename).arg(frame.saved ? "SUCCESS" : "FAILED");
+    qDebug() << QString("⏱️ Render: compose %1ms (flatten %2ms), encode %3ms (off the GUI thread)")
+                .arg(frame.composeMs).arg(frame.flattenMs).arg(frame.encodeMs);
+    qDebug() << QString("⭐ %1 sources extracted in %2ms").arg(m_sources.size()).arg(frame.extractMs);
+    m_tileCache->memoryCache()->logStats("Tile cache");
+    PixelFormat::logStats("Pixel formats");
     
-    // Update preview with 1:1 aspect ratio
-    QPixmap preview = QPixmap::fromImage(finalMosaic.scaled(400, 400, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    m_previewLabel->setPixmap(preview);
-    
-    // Also save a smaller preview
-    QString previewFilename = QString("%1/%2_preview.jpg").arg(m_outputDir).arg(objectName);
-    QImage preview512 = finalMosaic.scaled(512, 512, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    preview512.save(previewFilename);
-    qDebug() << QString("📁 Preview: %1").arg(previewFilename);
+    // Update preview with 1:1 aspect ratio, pre-scaled on the worker
+    m_previewLabel->setPixmap(PixelFormat::toPixmap(frame.display, "preview"));
+    qDebug() << QString("📁 Preview: %1").arg(m_previewFilename);
     
     saveProgressReport();
     
     m_statusLabel->setText(QString("✅ %1 mosaic complete! (%2 tiles)")
-                          .arg(m_currentObject.name).arg(tilesPlaced));
+                          .arg(m_currentObject.name).arg(frame.tilesPlaced));
     
     qDebug() << QString("\n🎯 %1 MOSAIC COMPLETE!").arg(m_currentObject.name);
-    qDebug() << QString("✅ %1 should be visible in the center tile with crosshairs").arg(labelText);
+    qDebug() << QString("✅ %1 should be visible in the center tile with crosshairs").arg(m_labelText);
     
     m_createButton->setEnabled(true);
 }
@@ -533,7 +398,7 @@ void MessierMosaicCreator::saveProgressReport() {
     out << "3x3 Grid Layout:\n";
     out << "Grid_X,Grid_Y,HEALPix_Pixel,Downloaded,ImageSize,Filename\n";
     
-    for (const SimpleTile& tile : m_tiles) {
+    for (const EngineTile& tile : m_engine->tiles()) {
         out << QString("%1,%2,%3,%4,%5x%6,%7\n")
                .arg(tile.gridX).arg(tile.gridY)
                .arg(tile.healpixPixel)
@@ -542,72 +407,18 @@ void MessierMosaicCreator::saveProgressReport() {
                .arg(tile.filename);
     }
     
-    file.close();
-    qDebug() << "Report saved:" << reportFile;
-}
-
-bool MessierMosaicCreator::checkExistingTile(const SimpleTile& tile) {
-    // Check if file exists
-    QFileInfo fileInfo(tile.filename);
-    if (!fileInfo.exists()) {
-        return false;
-    }
-    
-    // Check if file size is reasonable (not empty or too small)
-    if (fileInfo.size() < 1024) {  // Less than 1KB suggests corrupted file
-        qDebug() << QString("Existing tile %1 is too small (%2 bytes), will re-download")
-                    .arg(fileInfo.fileName()).arg(fileInfo.size());
-        return false;
-    }
-    
-    // Check if it's a valid JPEG
-    if (!isValidJpeg(tile.filename)) {
-        qDebug() << QString("Existing tile %1 is not a valid JPEG, will re-download")
-                    .arg(fileInfo.fileName());
-        return false;
-    }
-    
-    // Load the image to verify it's valid and update the tile structure
-    SimpleTile* mutableTile = const_cast<SimpleTile*>(&tile);
-    mutableTile->image.load(tile.filename);
-    
-    if (mutableTile->image.isNull()) {
-        qDebug() << QString("Existing tile %1 failed to load as image, will re-download")
-                    .arg(fileInfo.fileName());
-        return false;
-    }
-    
-    // Mark as downloaded since we have a valid existing file
-    mutableTile->downloaded = true;
-    
-    qDebug() << QString("Found valid existing tile: %1 (%2 bytes, %3x%4 pixels)")
-                .arg(fileInfo.fileName())
-                .arg(fileInfo.size())
-                .arg(mutableTile->image.width())
-                .arg(mutableTile->image.height());
-    
-    return true;
-}
-
-bool MessierMosaicCreator::isValidJpeg(const QString& filename) {
-    QFile file(filename);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return false;
+    // Brightest detections, for guiding simulations and alignment checks
+    out << QString("\nDetected sources: %1 (brightest 20 below)\n").arg(m_sources.size());
+    out << "X,Y,Flux,Peak,Area\n";
+    for (int i = 0; i < std::min<qsizetype>(20, m_sources.size()); i++) {
+        const ExtractedSource& source = m_sources[i];
+        out << QString("%1,%2,%3,%4,%5\n")
+               .arg(source.centroid.x(), 0, 'f', 2).arg(source.centroid.y(), 0, 'f', 2)
+               .arg(source.flux, 0, 'f', 0).arg(source.peak, 0, 'f', 1).arg(source.area);
     }
     
-    // Read first few bytes to check JPEG magic number
-    QByteArray header = file.read(4);
     file.close();
-    
-    // JPEG files start with FF D8 FF
-    if (header.size() >= 3 && 
-        static_cast<unsigned char>(header[0]) == 0xFF && 
-        static_cast<unsigned char>(header[1]) == 0xD8 && 
-        static_cast<unsigned char>(header[2]) == 0xFF) {
-        return true;
-    }
-    
-    return false;
+    qDebug() << "Report saved:" << reportFile;
 }
 
 void MessierMosaicCreator::updatePreviewDisplay() {
@@ -615,27 +426,35 @@ void MessierMosaicCreator::updatePreviewDisplay() {
         return;  // No mosaic to display yet
     }
     
-    QImage displayImage;
+    QRect crop;
     
     if (m_zoomToObjectCheckBox->isChecked()) {
-        displayImage = createZoomedView(m_fullMosaic);
+        crop = zoomedViewRect(m_fullMosaic);
         qDebug() << QString("Displaying zoomed view of %1 (%2 × %3 arcmin)")
                     .arg(m_currentObject.name)
                     .arg(m_currentObject.size_arcmin.width(), 0, 'f', 1)
                     .arg(m_currentObject.size_arcmin.height(), 0, 'f', 1);
     } else {
-        displayImage = m_fullMosaic;
         qDebug() << QString("Displaying full 3x3 mosaic of %1").arg(m_currentObject.name);
     }
     
-    // Scale to fit 400x400 preview while maintaining aspect ratio
-    QPixmap preview = QPixmap::fromImage(displayImage.scaled(400, 400, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    // Scale to fit 400x400 preview while maintaining aspect ratio, from the nearest pyramid level
+    if (m_mosaicPyramid.size() != m_fullMosaic.size()) {
+        m_mosaicPyramid = MipPyramid(m_fullMosaic);
+    }
+    QPixmap preview = PixelFormat::toPixmap(m_mosaicPyramid.scaled(QSize(400, 400), Qt::KeepAspectRatio, crop), "preview");
     m_previewLabel->setPixmap(preview);
 }
 
-QImage MessierMosaicCreator::createZoomedView(const QImage& fullMosaic) {
+void MessierMosaicCreator::showStretched(const QImage& mosaic) {
+    m_fullMosaic = mosaic;
+    m_mosaicPyramid = MipPyramid(m_fullMosaic);
+    updatePreviewDisplay();
+}
+
+QRect MessierMosaicCreator::zoomedViewRect(const QImage& fullMosaic) {
     if (fullMosaic.isNull()) {
-        return QImage();
+        return QRect();
     }
     
     // First, find the actual center of the object based on brightness
@@ -743,140 +562,24 @@ QImage MessierMosaicCreator::createZoomedView(const QImage& fullMosaic) {
                 .arg(zoomFraction, 0, 'f', 3)
                 .arg(cropX).arg(cropY);
     
-    return fullMosaic.copy(cropRect);
+    return cropRect;
 }
 
 QPoint MessierMosaicCreator::findBrightnessCenter(const QImage& image) {
-    if (image.isNull()) {
-        return QPoint(image.width()/2, image.height()/2);
-    }
-    
-    // Convert to grayscale and apply slight blur to reduce noise
-    QImage workingImage = image.convertToFormat(QImage::Format_RGB32);
-    QImage blurred = applyGaussianBlur(workingImage, 3);
-    
-    // Create brightness map
-    int width = blurred.width();
-    int height = blurred.height();
-    
-    // Find the brightest regions using a weighted centroid approach
-    double totalWeightedX = 0.0;
-    double totalWeightedY = 0.0;
-    double totalWeight = 0.0;
-    
-    // First pass: find the maximum brightness to normalize
-    int maxBrightness = 0;
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            QRgb pixel = blurred.pixel(x, y);
-            int brightness = qGray(pixel);
-            maxBrightness = std::max(maxBrightness, brightness);
-        }
-    }
-    
-    if (maxBrightness == 0) {
-        return QPoint(width/2, height/2);  // Fallback to center
-    }
-    
-    // Second pass: calculate weighted centroid using only bright pixels
-    // Use threshold to focus on the brightest regions (top 30% of brightness)
-    int brightnessThreshold = static_cast<int>(maxBrightness * 0.7);
-    
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            QRgb pixel = blurred.pixel(x, y);
-            int brightness = qGray(pixel);
-            
-            // Only consider bright pixels for centroid calculation
-            if (brightness > brightnessThreshold) {
-                // Weight by brightness squared to emphasize the brightest areas
-                double weight = static_cast<double>(brightness * brightness);
-                
-                totalWeightedX += x * weight;
-                totalWeightedY += y * weight;
-                totalWeight += weight;
-            }
-        }
+    // Coarse estimate on the 1/8 scale copy, then the blurred-luminance centroid (top 30% of
+    // brightness) in a small full-resolution window around it
+    const int factor = ProgressiveMosaic::COARSE_FACTOR;
+    QImage coarse = m_coarseMosaic;
+    if (coarse.size() != QSize((image.width() + factor - 1) / factor, (image.height() + factor - 1) / factor)) {
+        coarse = ImageFilters::boxDownsample(image, factor);
     }
-    
-    QPoint center;
-    if (totalWeight > 0) {
-        center.setX(static_cast<int>(totalWeightedX / totalWeight));
-        center.setY(static_cast<int>(totalWeightedY / totalWeight));
-    } else {
-        // Fallback to geometric center if no bright regions found
-        center = QPoint(width/2, height/2);
-    }
-    
-    // Ensure the center is within the image bounds
-    center.setX(std::max(0, std::min(center.x(), width - 1)));
-    center.setY(std::max(0, std::min(center.y(), height - 1)));
+    BrightnessCentroid centroid = BrightnessCentroid::coarseToFine(image, coarse, 3, 0.7);
     
     qDebug() << QString("Brightness analysis: max=%1, threshold=%2, weight=%3, center=(%4,%5)")
-                .arg(maxBrightness).arg(brightnessThreshold).arg(totalWeight, 0, 'f', 0)
-                .arg(center.x()).arg(center.y());
-    
-    return center;
-}
-
-QImage MessierMosaicCreator::applyGaussianBlur(const QImage& image, int radius) {
-    if (image.isNull() || radius <= 0) {
-        return image;
-    }
-    
-    QImage result = image.copy();
-    int width = result.width();
-    int height = result.height();
-    
-    // Simple box blur approximation of Gaussian blur
-    // Apply horizontal blur
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int totalR = 0, totalG = 0, totalB = 0;
-            int count = 0;
-            
-            for (int dx = -radius; dx <= radius; dx++) {
-                int nx = x + dx;
-                if (nx >= 0 && nx < width) {
-                    QRgb pixel = image.pixel(nx, y);
-                    totalR += qRed(pixel);
-                    totalG += qGreen(pixel);
-                    totalB += qBlue(pixel);
-                    count++;
-                }
-            }
-            
-            if (count > 0) {
-                result.setPixel(x, y, qRgb(totalR/count, totalG/count, totalB/count));
-            }
-        }
-    }
-    
-    // Apply vertical blur
-    QImage final = result.copy();
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            int totalR = 0, totalG = 0, totalB = 0;
-            int count = 0;
-            
-            for (int dy = -radius; dy <= radius; dy++) {
-                int ny = y + dy;
-                if (ny >= 0 && ny < height) {
-                    QRgb pixel = result.pixel(x, ny);
-                    totalR += qRed(pixel);
-                    totalG += qGreen(pixel);
-                    totalB += qBlue(pixel);
-                    count++;
-                }
-            }
-            
-            if (count > 0) {
-                final.setPixel(x, y, qRgb(totalR/count, totalG/count, totalB/count));
-            }
-        }
-    }
+                .arg(centroid.maxBrightness).arg(centroid.threshold).arg(centroid.totalWeight, 0, 'f', 0)
+                .arg(centroid.center.x()).arg(centroid.center.y());
     
-    return final;
+    return centroid.center;
 }
 
 // Add missing constellation to string function
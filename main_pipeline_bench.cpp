@@ -0,0 +1,1321 @@
+// main_pipeline_bench.cpp - Offline benchmarks for the mosaic pipeline stages
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QBuffer>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "BackgroundFlattener.h"
+#include "BrightnessCentroid.h"
+#include "DeepZoomWriter.h"
+#include "HipsReprojector.h"
+#include "ImageFilters.h"
+#include "MipPyramid.h"
+#include "MosaicCompositor.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include "ReprojectionMap.h"
+#include "SourceExtractor.h"
+#include "StretchEngine.h"
+#include "TileStats.h"
+#include "healpix_base.h"
+#include "pointing.h"
+
+// Synthetic sky-like tile: smooth gradient, a few bright blobs and pixel noise
+static QImage makeSyntheticTile(int size, QImage::Format format, quint32 seed) {
+    QRandomGenerator rng(seed);
+    QImage tile(size, size, QImage::Format_RGB32);
+
+    for (int y = 0; y < size; y++) {
+        QRgb* line = reinterpret_cast<QRgb*>(tile.scanLine(y));
+        for (int x = 0; x < size; x++) {
+            int base = 20 + (x + y) * 40 / (2 * size);
+            int noise = int(rng.bounded(12));
+            int v = std::min(255, base + noise);
+            line[x] = qRgb(v, std::min(255, v + 5), std::min(255, v + 12));
+        }
+    }
+
+    QPainter painter(&tile);
+    painter.setPen(Qt::NoPen);
+    for (int i = 0; i < 6; i++) {
+        int r = 4 + int(rng.bounded(20));
+        painter.setBrush(QColor(200 + int(rng.bounded(55)), 200 + int(rng.bounded(55)), 255));
+        painter.drawEllipse(QPoint(int(rng.bounded(size)), int(rng.bounded(size))), r, r);
+    }
+    painter.end();
+
+    return format == QImage::Format_RGB32 ? tile : tile.convertToFormat(format);
+}
+
+// grid x grid synthetic tiles laid edge to edge, seeded seed, seed + 1, ... in row order
+static QImage makeSyntheticMosaic(int grid, int tileSize, quint32 seed) {
+    MosaicCompositor compositor(grid * tileSize, grid * tileSize);
+    for (int i = 0; i < grid * grid; i++) {
+        compositor.blit(makeSyntheticTile(tileSize, QImage::Format_RGB32, seed + i), (i % grid) * tileSize, (i / grid) * tileSize);
+    }
+    return compositor.takeCanvas();
+}
+
+// Synthetic tile seeded seed + index whose levels are all shifted by up to 20, as when
+// neighbouring tiles come from plates with different sky backgrounds
+static QImage makeUnevenTile(int size, quint32 seed, int index) {
+    QImage tile = makeSyntheticTile(size, QImage::Format_RGB32, seed + index);
+    const int shift = int((index * 37) % 41) - 20;
+    for (int y = 0; y < size; y++) {
+        QRgb* line = reinterpret_cast<QRgb*>(tile.scanLine(y));
+        for (int x = 0; x < size; x++) {
+            line[x] = qRgb(std::clamp(qRed(line[x]) + shift, 0, 255), std::clamp(qGreen(line[x]) + shift, 0, 255),
+                           std::clamp(qBlue(line[x]) + shift, 0, 255));
+        }
+    }
+    return tile;
+}
+
+// Runs fn repeatedly and returns the best time in milliseconds (least disturbed by the OS)
+static double bestOfMs(int iterations, const std::function<void()>& fn) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        fn();
+        best = std::min(best, timer.nsecsElapsed() / 1e6);
+    }
+    return best;
+}
+
+static QString formatName(QImage::Format format) {
+    switch (format) {
+        case QImage::Format_RGB32:      return "RGB32";
+        case QImage::Format_ARGB32:     return "ARGB32";
+        case QImage::Format_RGB888:     return "RGB888";
+        case QImage::Format_Grayscale8: return "Gray8";
+        case QImage::Format_Indexed8:   return "Indexed8";
+        default:                        return QString("format %1").arg(int(format));
+    }
+}
+
+// 3x3 grid of 512px tiles into a 1536x1536 canvas, as the mosaic creators do
+static bool benchCompose(int iterations) {
+    const int tileSize = 512;
+    const int mosaicSize = 3 * tileSize;
+    bool allMatch = true;
+
+    qDebug() << "\n=== Compose: 3x3 tiles -> 1536x1536 ===";
+
+    for (QImage::Format format : {QImage::Format_RGB32, QImage::Format_RGB888, QImage::Format_Grayscale8}) {
+        QList<QImage> tiles;
+        for (int i = 0; i < 9; i++) {
+            tiles.append(makeSyntheticTile(tileSize, format, 1000 + i));
+        }
+
+        QImage painterResult;
+        double painterMs = bestOfMs(iterations, [&]() {
+            QImage mosaic(mosaicSize, mosaicSize, QImage::Format_RGB32);
+            mosaic.fill(Qt::black);
+            QPainter painter(&mosaic);
+            for (int i = 0; i < 9; i++) {
+                painter.drawImage((i % 3) * tileSize, (i / 3) * tileSize, tiles[i]);
+            }
+            painter.end();
+            painterResult = mosaic;
+        });
+
+        QImage compositorResult;
+        double compositorMs = bestOfMs(iterations, [&]() {
+            MosaicCompositor compositor(mosaicSize, mosaicSize);
+            compositor.clear();
+            for (int i = 0; i < 9; i++) {
+                compositor.blit(tiles[i], (i % 3) * tileSize, (i / 3) * tileSize);
+            }
+            compositorResult = compositor.takeCanvas();
+        });
+
+        bool match = (painterResult == compositorResult);
+        allMatch = allMatch && match;
+
+        double megapixels = double(mosaicSize) * mosaicSize / 1e6;
+        qDebug() << QString("  %1 tiles: QPainter %2 ms (%3 MP/s) | compositor %4 ms (%5 MP/s) | %6x | output %7")
+                    .arg(formatName(format), -6)
+                    .arg(painterMs, 0, 'f', 2).arg(megapixels / (painterMs / 1000.0), 0, 'f', 0)
+                    .arg(compositorMs, 0, 'f', 2).arg(megapixels / (compositorMs / 1000.0), 0, 'f', 0)
+                    .arg(painterMs / std::max(0.001, compositorMs), 0, 'f', 1)
+                    .arg(match ? "identical" : "DIFFERS");
+    }
+
+    // Clipped placement, as when tiles hang over the edge of a crop
+    QImage tile = makeSyntheticTile(tileSize, QImage::Format_RGB32, 7);
+    QImage painterClip(700, 700, QImage::Format_RGB32);
+    painterClip.fill(Qt::black);
+    QPainter painter(&painterClip);
+    painter.drawImage(-200, 350, tile);
+    painter.drawImage(400, -100, tile);
+    painter.end();
+
+    MosaicCompositor compositor(700, 700);
+    compositor.clear();
+    compositor.blit(tile, -200, 350);
+    compositor.blit(tile, 400, -100);
+    bool clipMatch = (painterClip == compositor.takeCanvas());
+    qDebug() << QString("  Clipped blits: output %1").arg(clipMatch ? "identical" : "DIFFERS");
+
+    return allMatch && clipMatch;
+}
+
+struct StallStats {
+    double maxGapMs = 0.0;
+    double p95GapMs = 0.0;
+    double totalMs = 0.0;
+};
+
+// Runs job inside an event loop with a 5 ms heartbeat timer and records the gaps between
+// heartbeats - a stand-in for how long a GUI would go without repainting or taking input
+static StallStats measureStalls(const std::function<void(std::function<void()>)>& job) {
+    QEventLoop loop;
+    QElapsedTimer clock;
+    QList<double> gaps;
+    qint64 last = 0;
+
+    QTimer heartbeat;
+    heartbeat.setTimerType(Qt::PreciseTimer);
+    heartbeat.setInterval(5);
+    QObject::connect(&heartbeat, &QTimer::timeout, [&]() {
+        qint64 now = clock.nsecsElapsed();
+        gaps.append((now - last) / 1e6);
+        last = now;
+    });
+
+    clock.start();
+    heartbeat.start();
+    QTimer::singleShot(0, &loop, [&]() { job([&loop]() { loop.quit(); }); });
+    loop.exec();
+    heartbeat.stop();
+
+    gaps.append((clock.nsecsElapsed() - last) / 1e6);
+    std::sort(gaps.begin(), gaps.end());
+
+    StallStats stats;
+    stats.maxGapMs = gaps.last();
+    stats.p95GapMs = gaps[std::min<qsizetype>(gaps.size() - 1, gaps.size() * 95 / 100)];
+    stats.totalMs = clock.nsecsElapsed() / 1e6;
+    return stats;
+}
+
+// 10x10 grid of JPEG tiles decoded, composed and PNG-encoded while the event loop is timed:
+// once with every stage in slot handlers (the old GUI path), once through MosaicRenderer
+static bool benchStall() {
+    const int grid = 10;
+    const int tileSize = 512;
+
+    qDebug() << "\n=== Event-loop stall: 100 tiles -> 5120x5120 PNG ===";
+
+    QList<QByteArray> encodedTiles;
+    for (int i = 0; i < grid * grid; i++) {
+        QByteArray jpeg;
+        QBuffer buffer(&jpeg);
+        buffer.open(QIODevice::WriteOnly);
+        makeSyntheticTile(tileSize, QImage::Format_RGB32, 2000 + i).save(&buffer, "JPEG", 90);
+        encodedTiles.append(jpeg);
+    }
+
+    QTemporaryDir outputDir;
+    if (!outputDir.isValid()) {
+        qDebug() << "  ❌ Could not create a temporary output directory";
+        return false;
+    }
+
+    auto makeRequest = [&](const QList<QImage>& images, const QString& name) {
+        MosaicRenderRequest request;
+        request.canvasSize = QSize(grid * tileSize, grid * tileSize);
+        for (int i = 0; i < images.size(); i++) {
+            request.tiles.append({images[i], QPoint((i % grid) * tileSize, (i / grid) * tileSize)});
+        }
+        request.outputFile = outputDir.filePath(name + ".png");
+        request.previewFile = outputDir.filePath(name + "_preview.jpg");
+        return request;
+    };
+
+    // Synchronous: one tile decoded per slot invocation, then compose + encode in one slot
+    MosaicFrame syncFrame;
+    QList<QImage> syncImages;
+    std::function<void()> finishSync;
+    std::function<void()> syncStep = [&]() {
+        if (syncImages.size() < encodedTiles.size()) {
+            syncImages.append(MosaicRenderer::decodeAndMeasure(encodedTiles[syncImages.size()]).image);
+            QTimer::singleShot(0, syncStep);
+            return;
+        }
+        syncFrame = MosaicRenderer::render(makeRequest(syncImages, "sync"));
+        finishSync();
+    };
+    StallStats syncStats = measureStalls([&](std::function<void()> done) {
+        finishSync = done;
+        syncStep();
+    });
+
+    // Asynchronous: decodes fan out over the render pool, the frame comes back via a watcher
+    MosaicFrame asyncFrame;
+    StallStats asyncStats = measureStalls([&](std::function<void()> done) {
+        auto images = std::make_shared<QList<QImage>>(encodedTiles.size());
+        auto remaining = std::make_shared<int>(int(encodedTiles.size()));
+        for (int i = 0; i < encodedTiles.size(); i++) {
+            QFutureWatcher<DecodedTile>* watcher = new QFutureWatcher<DecodedTile>();
+            QObject::connect(watcher, &QFutureWatcher<DecodedTile>::finished, [&, watcher, images, remaining, i, done]() {
+                (*images)[i] = watcher->result().image;
+                watcher->deleteLater();
+                if (--(*remaining) > 0) return;
+
+                QFutureWatcher<MosaicFrame>* render = new QFutureWatcher<MosaicFrame>();
+                QObject::connect(render, &QFutureWatcher<MosaicFrame>::finished, [&, render, done]() {
+                    asyncFrame = render->result();
+                    render->deleteLater();
+                    done();
+                });
+                render->setFuture(MosaicRenderer::renderAsync(makeRequest(*images, "async")));
+            });
+            watcher->setFuture(MosaicRenderer::decodeAsync(encodedTiles[i]));
+        }
+    });
+
+    bool match = syncFrame.saved && asyncFrame.saved && syncFrame.mosaic == asyncFrame.mosaic;
+
+    for (const auto& row : {qMakePair(QString("GUI thread"), syncStats), qMakePair(QString("render pool"), asyncStats)}) {
+        qDebug() << QString("  %1: total %2 ms | longest stall %3 ms | p95 heartbeat gap %4 ms")
+                    .arg(row.first, -11)
+                    .arg(row.second.totalMs, 0, 'f', 0)
+                    .arg(row.second.maxGapMs, 0, 'f', 1)
+                    .arg(row.second.p95GapMs, 0, 'f', 1);
+    }
+    qDebug() << QString("  Compose %1 ms, encode %2 ms per frame | output %3")
+                .arg(asyncFrame.composeMs).arg(asyncFrame.encodeMs)
+                .arg(match ? "identical" : "DIFFERS");
+
+    return match;
+}
+
+static QString kernelName(ResampleKernel kernel) {
+    switch (kernel) {
+        case ResampleKernel::Nearest:  return "nearest";
+        case ResampleKernel::Bilinear: return "bilinear";
+        case ResampleKernel::Lanczos3: return "lanczos3";
+    }
+    return QString();
+}
+
+// TAN reprojection of synthetic tiles around M51: face math checked against the HEALPix
+// library, then each kernel timed single-threaded and on the render pool
+static bool benchReproject(int iterations) {
+    qDebug() << "\n=== Reproject: HEALPix tiles -> 2048x2048 TAN ===";
+
+    // Sky position -> NEST index must agree with Healpix_Base at tile-pixel resolution
+    const int pixelOrder = 17;   // Order 8 tiles of 512 pixels
+    Healpix_Base2 healpix(pixelOrder, NEST);
+    QRandomGenerator rng(42);
+    int samples = 200000;
+    int mismatches = 0;
+    for (int i = 0; i < samples; i++) {
+        double ra = rng.generateDouble() * 360.0;
+        double dec = std::asin(2.0 * rng.generateDouble() - 1.0) * 180.0 / M_PI;
+        long long ours = HipsReprojector::faceToNest(HipsReprojector::skyToFace(ra, dec), pixelOrder);
+        long long reference = healpix.ang2pix(pointing((90.0 - dec) * M_PI / 180.0, ra * M_PI / 180.0));
+        if (ours != reference) mismatches++;
+    }
+    bool faceMatch = mismatches * 10000 <= samples;   // Only points on a pixel boundary may differ
+    qDebug() << QString("  Face math vs Healpix_Base (order %1): %2 of %3 points differ")
+                .arg(pixelOrder).arg(mismatches).arg(samples);
+
+    TanProjection projection;
+    projection.centerRaDeg = 202.4696;
+    projection.centerDecDeg = 47.1952;
+    projection.pixelScaleDeg = 1.0 / 3600.0;
+    projection.size = QSize(2048, 2048);
+    projection.rotationDeg = 30.0;
+
+    HipsTileSet tiles;
+    tiles.order = HipsReprojector::orderForScale(projection.pixelScaleDeg, tiles.tileWidth);
+    QList<long long> needed = HipsReprojector::requiredTiles(projection, tiles.order, tiles.tileWidth,
+                                                             ResampleKernel::Lanczos3);
+    for (long long index : needed) {
+        tiles.insert(index, makeSyntheticTile(tiles.tileWidth, QImage::Format_RGB32, quint32(index)));
+    }
+    qDebug() << QString("  Order %1, %2 tiles, 1\"/px, rotated %3°")
+                .arg(tiles.order).arg(needed.size()).arg(projection.rotationDeg, 0, 'f', 0);
+
+    int runs = std::max(1, std::min(iterations, 5));
+    double megapixels = double(projection.size.width()) * projection.size.height() / 1e6;
+    bool allMatch = faceMatch;
+
+    for (ResampleKernel kernel : {ResampleKernel::Nearest, ResampleKernel::Bilinear, ResampleKernel::Lanczos3}) {
+        QImage single;
+        double singleMs = bestOfMs(runs, [&]() { single = HipsReprojector::render(projection, tiles, kernel, false); });
+        QImage threaded;
+        double threadedMs = bestOfMs(runs, [&]() { threaded = HipsReprojector::render(projection, tiles, kernel, true); });
+
+        bool match = (single == threaded);
+        allMatch = allMatch && match;
+        qDebug() << QString("  %1: 1 thread %2 ms (%3 MP/s) | pool %4 ms (%5 MP/s) | output %6")
+                    .arg(kernelName(kernel), -8)
+                    .arg(singleMs, 0, 'f', 1).arg(megapixels / (singleMs / 1000.0), 0, 'f', 1)
+                    .arg(threadedMs, 0, 'f', 1).arg(megapixels / (threadedMs / 1000.0), 0, 'f', 1)
+                    .arg(match ? "identical" : "DIFFERS");
+    }
+
+    // Three surveys of the same frame: the spherical pass once, then three sampling passes
+    QList<HipsTileSet> surveys;
+    for (int band = 0; band < 3; band++) {
+        HipsTileSet survey;
+        survey.order = tiles.order;
+        for (long long index : needed) {
+            survey.insert(index, makeSyntheticTile(survey.tileWidth, QImage::Format_RGB32, quint32(index * 3 + band)));
+        }
+        surveys.append(survey);
+    }
+
+    QSharedPointer<const ReprojectionMap> map;
+    double mapMs = bestOfMs(runs, [&]() { map = HipsReprojector::buildMap(projection, tiles.order, tiles.tileWidth); });
+    double samplingMs = bestOfMs(runs, [&]() {
+        for (const HipsTileSet& survey : surveys) {
+            HipsReprojector::render(*map, survey, ResampleKernel::Bilinear);
+        }
+    });
+    qDebug() << QString("  3 surveys, bilinear: map %1 ms (%2 MB, %3 tiles) + sampling %4 ms | %5 ms without map reuse")
+                .arg(mapMs, 0, 'f', 1)
+                .arg(map->memoryBytes() / (1024.0 * 1024.0), 0, 'f', 1).arg(map->tiles().size())
+                .arg(samplingMs, 0, 'f', 1)
+                .arg(3 * mapMs + samplingMs, 0, 'f', 1);
+
+    return allMatch;
+}
+
+static bool benchChannels(int iterations) {
+    qDebug() << "\n=== False colour: 3 surveys -> 2048x2048 RGB ===";
+
+    TanProjection projection;
+    projection.centerRaDeg = 83.8221;
+    projection.centerDecDeg = -5.3911;
+    projection.pixelScaleDeg = 1.0 / 3600.0;
+    projection.size = QSize(2048, 2048);
+
+    int order = HipsReprojector::orderForScale(projection.pixelScaleDeg);
+    QList<long long> needed = HipsReprojector::requiredTiles(projection, order, 512);
+    QSharedPointer<const ReprojectionMap> map = HipsReprojector::buildMap(projection, order, 512);
+
+    // K, H, J into red, green, blue with different stretches; J also tints green a little
+    QList<ChannelBand> bands(3);
+    const double stretches[3][3] = {{10.0, 220.0, 1.0}, {20.0, 240.0, 1.5}, {0.0, 200.0, 2.2}};
+    for (int b = 0; b < 3; b++) {
+        bands[b].tiles.order = order;
+        for (long long index : needed) {
+            bands[b].tiles.insert(index, makeSyntheticTile(512, QImage::Format_RGB32, quint32(index * 7 + b)));
+        }
+        bands[b].black = stretches[b][0];
+        bands[b].white = stretches[b][1];
+        bands[b].gamma = stretches[b][2];
+    }
+    bands[0].red = 1.0;
+    bands[1].green = 1.0;
+    bands[2].blue = 1.0;
+    bands[2].green = 0.25;
+
+    // Reference: one reprojected image per survey, then a per-pixel combine
+    int runs = std::max(1, iterations / 10);
+    QImage reference;
+    double separateMs = bestOfMs(runs, [&]() {
+        QList<QImage> images;
+        for (const ChannelBand& band : bands) {
+            images.append(HipsReprojector::render(*map, band.tiles, ResampleKernel::Bilinear));
+        }
+        reference = QImage(projection.size, QImage::Format_RGB32);
+        for (int y = 0; y < reference.height(); y++) {
+            QRgb* out = reinterpret_cast<QRgb*>(reference.scanLine(y));
+            for (int x = 0; x < reference.width(); x++) {
+                float rgb[3] = {0.0f, 0.0f, 0.0f};
+                for (int b = 0; b < bands.size(); b++) {
+                    QRgb p = reinterpret_cast<const QRgb*>(images[b].constScanLine(y))[x];
+                    int level = (qRed(p) * 77 + qGreen(p) * 150 + qBlue(p) * 29) >> 8;
+                    double t = std::clamp((level - bands[b].black) / (bands[b].white - bands[b].black), 0.0, 1.0);
+                    float intensity = float(255.0 * std::pow(t, 1.0 / bands[b].gamma));
+                    rgb[0] += intensity * float(bands[b].red);
+                    rgb[1] += intensity * float(bands[b].green);
+                    rgb[2] += intensity * float(bands[b].blue);
+                }
+                out[x] = qRgb(int(std::clamp(std::lrint(rgb[0]), 0L, 255L)),
+                              int(std::clamp(std::lrint(rgb[1]), 0L, 255L)),
+                              int(std::clamp(std::lrint(rgb[2]), 0L, 255L)));
+            }
+        }
+    });
+
+    QImage fused;
+    double fusedMs = bestOfMs(runs, [&]() { fused = HipsReprojector::renderChannels(*map, bands, ResampleKernel::Bilinear); });
+
+    // Float sums may round the other way on exact .5 boundaries
+    int worst = 0;
+    for (int y = 0; y < fused.height(); y++) {
+        for (int x = 0; x < fused.width(); x++) {
+            QRgb a = fused.pixel(x, y);
+            QRgb b = reference.pixel(x, y);
+            worst = std::max({worst, qAbs(qRed(a) - qRed(b)), qAbs(qGreen(a) - qGreen(b)), qAbs(qBlue(a) - qBlue(b))});
+        }
+    }
+    bool match = worst <= 1;
+    qDebug() << QString("  separate renders + combine %1 ms | fused %2 ms (%3x) | max channel difference %4 %5")
+                .arg(separateMs, 0, 'f', 1).arg(fusedMs, 0, 'f', 1)
+                .arg(separateMs / std::max(0.001, fusedMs), 0, 'f', 2)
+                .arg(worst).arg(match ? "✅" : "❌");
+    return match;
+}
+
+static QImage referenceHalve(const QImage& image) {
+    QImage half((image.width() + 1) / 2, (image.height() + 1) / 2, QImage::Format_RGB32);
+    for (int y = 0; y < half.height(); y++) {
+        for (int x = 0; x < half.width(); x++) {
+            int r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    QRgb p = image.pixel(std::min(2 * x + dx, image.width() - 1), std::min(2 * y + dy, image.height() - 1));
+                    r += qRed(p);
+                    g += qGreen(p);
+                    b += qBlue(p);
+                }
+            }
+            half.setPixel(x, y, qRgb((r + 2) / 4, (g + 2) / 4, (b + 2) / 4));
+        }
+    }
+    return half;
+}
+
+static bool benchPyramid() {
+    const int grid = 8;
+    const int tileSize = 512;
+    const DeepZoomOptions options;
+
+    qDebug() << "\n=== Deep zoom pyramid: 4096x4096 mosaic -> DZI tiles ===";
+
+    QImage mosaic = makeSyntheticMosaic(grid, tileSize, 3000);
+
+    // Odd sizes exercise the repeated edge pixels
+    QImage odd = mosaic.copy(0, 0, 1001, 777);
+    bool halveMatch = DeepZoomWriter::halve(odd) == referenceHalve(odd);
+    qDebug() << QString("  2x2 box filter vs per-pixel reference: %1").arg(halveMatch ? "identical" : "DIFFERENT");
+
+    QTemporaryDir outputDir;
+    if (!outputDir.isValid()) {
+        qDebug() << "  ❌ Could not create a temporary output directory";
+        return false;
+    }
+
+    // Level after level on one thread: scale the previous level, then encode its tiles
+    QElapsedTimer timer;
+    timer.start();
+    int serialTiles = 0;
+    QImage level = mosaic;
+    for (int index = 0; !level.isNull(); index++) {
+        QDir().mkpath(QString("%1/serial/%2").arg(outputDir.path()).arg(index));
+        for (int y = 0; y < level.height(); y += options.tileSize) {
+            for (int x = 0; x < level.width(); x += options.tileSize) {
+                QRect rect = QRect(x - options.overlap, y - options.overlap,
+                                   options.tileSize + 2 * options.overlap, options.tileSize + 2 * options.overlap)
+                             .intersected(level.rect());
+                level.copy(rect).save(QString("%1/serial/%2/%3_%4.jpg").arg(outputDir.path()).arg(index).arg(x).arg(y),
+                                      "jpg", options.quality);
+                serialTiles++;
+            }
+        }
+        level = level.size() == QSize(1, 1) ? QImage()
+              : level.scaled((level.width() + 1) / 2, (level.height() + 1) / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    double serialMs = timer.restart();
+
+    DeepZoomWriter writer(outputDir.path() + "/mosaic.dzi", mosaic.size(), options);
+    bool written = writer.open() && writer.writeRows(mosaic) && writer.finish();
+    double streamedMs = timer.elapsed();
+
+    bool countMatch = written && writer.tilesWritten() == serialTiles;
+    qDebug() << QString("  %1 levels, %2 tiles | serial %3 ms | streamed %4 ms on %5 threads (%6x)")
+                .arg(writer.levelCount()).arg(writer.tilesWritten())
+                .arg(serialMs, 0, 'f', 0).arg(streamedMs, 0, 'f', 0)
+                .arg(MosaicRenderer::pool()->maxThreadCount())
+                .arg(serialMs / std::max(1.0, streamedMs), 0, 'f', 2);
+    if (!countMatch) {
+        qDebug() << QString("  ❌ Expected %1 tiles: %2").arg(serialTiles).arg(writer.errorString());
+    }
+
+    return halveMatch && countMatch;
+}
+
+// Preview scaling on a 1536x1536 mosaic: straight from the full-resolution buffer vs from the mip pyramid
+static bool benchMip(int iterations) {
+    const int tileSize = 512;
+    const int grid = 3;
+    const QSize previewSize(400, 400);
+
+    qDebug() << "\n=== Mip pyramid: 1536x1536 mosaic -> 400px previews ===";
+
+    QImage mosaic = makeSyntheticMosaic(grid, tileSize, 7000);
+
+    MipPyramid pyramid;
+    double serialMs = bestOfMs(iterations, [&]() { pyramid = MipPyramid(mosaic, 64, false); });
+    double pooledMs = bestOfMs(iterations, [&]() { pyramid = MipPyramid(mosaic, 64, true); });
+
+    // Every level is even-sized here, so each must equal the DZI box filter of the one above
+    bool levelsMatch = pyramid.levelCount() > 1;
+    for (int index = 1; index < pyramid.levelCount(); index++) {
+        levelsMatch = levelsMatch && pyramid.level(index) == DeepZoomWriter::halve(pyramid.level(index - 1));
+    }
+
+    // Full view and the creators' 2x zoom crop around the centre
+    const QRect crop(mosaic.width() / 4, mosaic.height() / 4, mosaic.width() / 2, mosaic.height() / 2);
+    QImage direct, directCrop, fromPyramid, fromPyramidCrop;
+    double directMs = bestOfMs(iterations, [&]() {
+        direct = mosaic.scaled(previewSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        directCrop = mosaic.copy(crop).scaled(previewSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    });
+    double mipMs = bestOfMs(iterations, [&]() {
+        fromPyramid = pyramid.scaled(previewSize);
+        fromPyramidCrop = pyramid.scaled(previewSize, Qt::KeepAspectRatio, crop);
+    });
+
+    // Both are area averages of the same pixels, so they differ only by filter rounding
+    auto meanDifference = [](const QImage& a, const QImage& b) {
+        if (a.size() != b.size()) {
+            return 255.0;
+        }
+        qint64 total = 0;
+        for (int y = 0; y < a.height(); y++) {
+            for (int x = 0; x < a.width(); x++) {
+                total += std::abs(qGreen(a.pixel(x, y)) - qGreen(b.pixel(x, y)));
+            }
+        }
+        return double(total) / (qint64(a.width()) * a.height());
+    };
+    double difference = std::max(meanDifference(direct, fromPyramid), meanDifference(directCrop, fromPyramidCrop));
+    bool previewsMatch = difference <= 3.0;
+
+    qDebug() << QString("  %1 levels | build serial %2 ms, %3 threads %4 ms | levels vs DZI halve: %5")
+                .arg(pyramid.levelCount()).arg(serialMs, 0, 'f', 2)
+                .arg(MosaicRenderer::pool()->maxThreadCount()).arg(pooledMs, 0, 'f', 2)
+                .arg(levelsMatch ? "identical" : "DIFFERENT");
+    qDebug() << QString("  Full view + 2x crop: direct scaled() %1 ms | pyramid %2 ms (%3x) | mean difference %4 %5")
+                .arg(directMs, 0, 'f', 2).arg(mipMs, 0, 'f', 2)
+                .arg(directMs / std::max(0.001, mipMs), 0, 'f', 1)
+                .arg(difference, 0, 'f', 2).arg(previewsMatch ? "✅" : "❌");
+
+    return levelsMatch && previewsMatch;
+}
+
+// Asinh stretch evaluated per sample with pixel()/setPixel(), as a straightforward display stretch would
+static QImage referenceAsinhStretch(const QImage& image, const StretchParams& params) {
+    QImage output(image.size(), QImage::Format_RGB32);
+    const double range = params.white - params.black;
+    auto curve = [&](int level) {
+        double t = std::clamp((level - params.black) / range, 0.0, 1.0);
+        t = std::asinh(params.strength * t) / std::asinh(params.strength);
+        return int(std::lround(255.0 * std::pow(t, 1.0 / params.gamma)));
+    };
+    for (int y = 0; y < image.height(); y++) {
+        for (int x = 0; x < image.width(); x++) {
+            QRgb p = image.pixel(x, y);
+            output.setPixel(x, y, qRgb(curve(qRed(p)), curve(qGreen(p)), curve(qBlue(p))));
+        }
+    }
+    return output;
+}
+
+// Re-stretching a retained 1536x1536 linear mosaic, as the creators' sliders do
+static bool benchStretch(int iterations) {
+    const int tileSize = 512;
+    const int grid = 3;
+
+    qDebug() << "\n=== Display stretch: 1536x1536 linear mosaic ===";
+
+    QImage linear = makeSyntheticMosaic(grid, tileSize, 8000);
+    const double megapixels = linear.width() * linear.height() / 1e6;
+
+    StretchEngine engine;
+    double histogramMs = bestOfMs(iterations, [&]() { engine = StretchEngine(linear); });
+    StretchParams params = engine.autoLevels(StretchMode::Asinh);
+    params.gamma = 1.4;
+
+    QImage reference;
+    double referenceMs = bestOfMs(std::max(1, iterations / 10), [&]() { reference = referenceAsinhStretch(linear, params); });
+    QImage serial, pooled;
+    double serialMs = bestOfMs(iterations, [&]() { serial = engine.apply(params, false); });
+    double pooledMs = bestOfMs(iterations, [&]() { pooled = engine.apply(params, true); });
+    bool match = serial == reference && pooled == reference;
+
+    // Every mode, including equalization, must stay a pure table lookup of the linear levels
+    bool modesOk = true;
+    for (StretchMode mode : {StretchMode::Linear, StretchMode::Log, StretchMode::HistogramEqualize}) {
+        StretchParams modeParams = engine.autoLevels(mode);
+        StretchLut lut = StretchEngine::buildLut(modeParams, engine.histogram());
+        QImage stretched = engine.apply(modeParams);
+        QRgb in = linear.pixel(700, 300), out = stretched.pixel(700, 300);
+        modesOk = modesOk && qRed(out) == lut[qRed(in)] && qGreen(out) == lut[qGreen(in)] && qBlue(out) == lut[qBlue(in)];
+    }
+
+    qDebug() << QString("  Histogram %1 ms | per-sample reference %2 ms | LUT %3 ms (%4 MP/s) | %5 threads %6 ms (%7 MP/s)")
+                .arg(histogramMs, 0, 'f', 2).arg(referenceMs, 0, 'f', 1)
+                .arg(serialMs, 0, 'f', 2).arg(megapixels / std::max(1e-6, serialMs / 1000.0), 0, 'f', 0)
+                .arg(MosaicRenderer::pool()->maxThreadCount()).arg(pooledMs, 0, 'f', 2)
+                .arg(megapixels / std::max(1e-6, pooledMs / 1000.0), 0, 'f', 0);
+    qDebug() << QString("  Asinh black %1 white %2 gamma %3 vs reference: %4 | other modes: %5")
+                .arg(params.black).arg(params.white).arg(params.gamma, 0, 'f', 2)
+                .arg(match ? "identical" : "DIFFERENT").arg(modesOk ? "table lookups ✅" : "❌");
+
+    return match && modesOk;
+}
+
+// Star field on a sloping, noisy sky: Gaussian stars (sigma 1.5 px) at known sub-pixel positions
+static QImage makeStarField(int size, quint32 seed, QList<QPointF>& stars) {
+    QRandomGenerator rng(seed);
+    std::vector<float> sky(size_t(size) * size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            // Sum of four uniforms: roughly Gaussian noise with sigma 3
+            double noise = 0;
+            for (int i = 0; i < 4; i++) noise += rng.generateDouble();
+            sky[size_t(y) * size + x] = float(30 + (x + y) * 20.0 / (2 * size) + (noise - 2.0) * 5.2);
+        }
+    }
+
+    stars.clear();
+    for (int attempt = 0; attempt < 400; attempt++) {
+        QPointF star(20 + rng.generateDouble() * (size - 40), 20 + rng.generateDouble() * (size - 40));
+        bool isolated = std::all_of(stars.begin(), stars.end(), [&](const QPointF& other) {
+            return std::hypot(other.x() - star.x(), other.y() - star.y()) > 20;
+        });
+        if (!isolated) continue;
+        stars.append(star);
+        double amplitude = 30 + rng.generateDouble() * 170;
+        for (int y = int(star.y()) - 8; y <= int(star.y()) + 8; y++) {
+            for (int x = int(star.x()) - 8; x <= int(star.x()) + 8; x++) {
+                double r2 = (x - star.x()) * (x - star.x()) + (y - star.y()) * (y - star.y());
+                sky[size_t(y) * size + x] += float(amplitude * std::exp(-r2 / (2 * 1.5 * 1.5)));
+            }
+        }
+    }
+
+    QImage field(size, size, QImage::Format_RGB32);
+    for (int y = 0; y < size; y++) {
+        QRgb* line = reinterpret_cast<QRgb*>(field.scanLine(y));
+        for (int x = 0; x < size; x++) {
+            int v = std::clamp(int(std::lround(sky[size_t(y) * size + x])), 0, 255);
+            line[x] = qRgb(v, v, v);
+        }
+    }
+    return field;
+}
+
+// Source extraction on a 1536x1536 frame, in megapixels per second
+static bool benchSources(int iterations) {
+    const int size = 1536;
+
+    qDebug() << "\n=== Source extraction: 1536x1536 star field ===";
+
+    QList<QPointF> stars;
+    QImage field = makeStarField(size, 9000, stars);
+    const double megapixels = size * size / 1e6;
+
+    SourceExtractorOptions serialOptions;
+    serialOptions.multithreaded = false;
+    QList<ExtractedSource> serial, pooled;
+    double serialMs = bestOfMs(iterations, [&]() { serial = SourceExtractor::extract(field, serialOptions); });
+    double pooledMs = bestOfMs(iterations, [&]() { pooled = SourceExtractor::extract(field); });
+
+    // Tiling must not change the result: same sources, same order, same centroids
+    bool consistent = serial.size() == pooled.size();
+    for (int i = 0; consistent && i < serial.size(); i++) {
+        consistent = serial[i].centroid == pooled[i].centroid && serial[i].area == pooled[i].area;
+    }
+
+    int recovered = 0;
+    double worst = 0.0;
+    for (const QPointF& star : stars) {
+        double nearest = 1e9;
+        for (const ExtractedSource& source : pooled) {
+            nearest = std::min(nearest, std::hypot(source.centroid.x() - star.x(), source.centroid.y() - star.y()));
+        }
+        if (nearest < 0.5) {
+            recovered++;
+            worst = std::max(worst, nearest);
+        }
+    }
+    bool complete = recovered >= stars.size() * 95 / 100;
+
+    qDebug() << QString("  Serial %1 ms (%2 MP/s) | %3 threads %4 ms (%5 MP/s) | serial vs pooled: %6")
+                .arg(serialMs, 0, 'f', 1).arg(megapixels / std::max(1e-6, serialMs / 1000.0), 0, 'f', 0)
+                .arg(MosaicRenderer::pool()->maxThreadCount()).arg(pooledMs, 0, 'f', 1)
+                .arg(megapixels / std::max(1e-6, pooledMs / 1000.0), 0, 'f', 0)
+                .arg(consistent ? "identical" : "DIFFERENT");
+    qDebug() << QString("  %1 sources | %2/%3 injected stars within 0.5 px (worst %4 px) %5")
+                .arg(pooled.size()).arg(recovered).arg(stars.size()).arg(worst, 0, 'f', 3)
+                .arg(complete ? "✅" : "❌");
+
+    return consistent && complete;
+}
+
+// Spread between the brightest and faintest tile's median green level, over covered tiles
+static double tileLevelSpread(const QImage& mosaic, int grid, int tileSize) {
+    double lowest = 255.0, highest = 0.0;
+    for (int i = 0; i < grid * grid; i++) {
+        std::vector<int> levels;
+        for (int y = (i / grid) * tileSize; y < (i / grid + 1) * tileSize; y += 4) {
+            for (int x = (i % grid) * tileSize; x < (i % grid + 1) * tileSize; x += 4) {
+                levels.push_back(qGreen(mosaic.pixel(x, y)));
+            }
+        }
+        std::nth_element(levels.begin(), levels.begin() + levels.size() / 2, levels.end());
+        double median = levels[levels.size() / 2];
+        if (median == 0) continue;     // Missing tile
+        lowest = std::min(lowest, median);
+        highest = std::max(highest, median);
+    }
+    return highest - lowest;
+}
+
+// 3x3 mosaic of plates with different sky levels and one missing tile: checkerboard removal and cost
+static bool benchFlatten(int iterations) {
+    const int tileSize = 512;
+    const int grid = 3;
+    const int mosaicSize = grid * tileSize;
+
+    qDebug() << "\n=== Background flattening: 1536x1536 mosaic, plate sky offsets ===";
+
+    MosaicCompositor compositor(mosaicSize, mosaicSize);
+    compositor.clear();
+    for (int i = 0; i < grid * grid; i++) {
+        if (i == 2) continue;
+        compositor.blit(makeUnevenTile(tileSize, 4800, i), (i % grid) * tileSize, (i / grid) * tileSize);
+    }
+    const QImage mosaic = compositor.takeCanvas();
+    const double megapixels = double(mosaicSize) * mosaicSize / 1e6;
+    const double before = tileLevelSpread(mosaic, grid, tileSize);
+
+    bool ok = true;
+    for (FlattenMode mode : {FlattenMode::Subtract, FlattenMode::Divide}) {
+        FlattenParams params;
+        params.mode = mode;
+        QImage serial, pooled;
+        double serialMs = bestOfMs(iterations, [&]() { serial = BackgroundFlattener::apply(mosaic, params, false); });
+        double pooledMs = bestOfMs(iterations, [&]() { pooled = BackgroundFlattener::apply(mosaic, params); });
+
+        double after = tileLevelSpread(pooled, grid, tileSize);
+        bool identical = serial == pooled;
+        bool flattened = after < before / 4;
+        bool gapKept = qGray(pooled.pixel(mosaicSize - tileSize / 2, tileSize / 2)) == 0;
+        ok = ok && identical && flattened && gapKept;
+
+        qDebug() << QString("  %1: serial %2 ms (%3 MP/s) | pooled %4 ms | tile sky spread %5 -> %6 levels | gap %7 | %8 %9")
+                    .arg(BackgroundFlattener::modeName(mode), -8)
+                    .arg(serialMs, 0, 'f', 1).arg(megapixels / std::max(1e-6, serialMs / 1000.0), 0, 'f', 0)
+                    .arg(pooledMs, 0, 'f', 1).arg(before, 0, 'f', 0).arg(after, 0, 'f', 1)
+                    .arg(gapKept ? "black" : "FILLED")
+                    .arg(identical ? "identical" : "DIFFERENT").arg(identical && flattened && gapKept ? "✅" : "❌");
+    }
+
+    return ok;
+}
+
+// Per-pixel TileStats with pixel(): channel extremes, mean and near-black/white counts
+static TileStats referenceTileStats(const QImage& image) {
+    const bool gray = image.format() == QImage::Format_Grayscale8;
+    int low = 255, high = 0;
+    double sum = 0.0;
+    qint64 empty = 0, saturated = 0;
+    for (int y = 0; y < image.height(); y++) {
+        for (int x = 0; x < image.width(); x++) {
+            QRgb p = image.pixel(x, y);
+            int darkest = std::min({qRed(p), qGreen(p), qBlue(p)});
+            int brightest = std::max({qRed(p), qGreen(p), qBlue(p)});
+            low = std::min(low, darkest);
+            high = std::max(high, brightest);
+            sum += gray ? qRed(p) : qRed(p) + qGreen(p) + qBlue(p);
+            empty += brightest <= TileStats::EMPTY_LEVEL;
+            saturated += darkest >= TileStats::SATURATED_LEVEL;
+        }
+    }
+    const double pixels = double(image.width()) * image.height();
+    TileStats stats;
+    stats.minLevel = quint8(low);
+    stats.maxLevel = quint8(high);
+    stats.mean = float(sum / (pixels * (gray ? 1 : 3)));
+    stats.emptyFraction = float(empty / pixels);
+    stats.saturatedFraction = float(saturated / pixels);
+    stats.measured = true;
+    return stats;
+}
+
+// Blank-tile statistics on 512x512 tiles: exactness, classification, and cost next to a JPEG decode
+static bool benchTileStats(int iterations) {
+    const int size = 512;
+
+    qDebug() << "\n=== Tile statistics: 512x512 tiles ===";
+
+    // Survey-edge shapes: JPEG-noisy black, clipped white, half covered, and real sky
+    QRandomGenerator rng(4700);
+    QImage black(size, size, QImage::Format_RGB32);
+    QImage white(size, size, QImage::Format_RGB32);
+    QImage edge = makeSyntheticTile(size, QImage::Format_RGB32, 4701);
+    for (int y = 0; y < size; y++) {
+        QRgb* blackLine = reinterpret_cast<QRgb*>(black.scanLine(y));
+        QRgb* whiteLine = reinterpret_cast<QRgb*>(white.scanLine(y));
+        QRgb* edgeLine = reinterpret_cast<QRgb*>(edge.scanLine(y));
+        for (int x = 0; x < size; x++) {
+            int dark = int(rng.bounded(4));
+            int light = 252 + int(rng.bounded(4));
+            blackLine[x] = qRgb(dark, dark, dark);
+            whiteLine[x] = qRgb(light, light, light);
+            if (x + y < size) edgeLine[x] = qRgb(dark, dark, dark);
+        }
+    }
+    const QImage sky = makeSyntheticTile(size, QImage::Format_RGB32, 4702);
+
+    struct Case { QString name; QImage image; bool blank; };
+    const QList<Case> cases = {
+        {"black", black, true},
+        {"saturated", white, true},
+        {"half covered", edge, false},
+        {"sky", sky, false},
+        {"sky (gray8)", sky.convertToFormat(QImage::Format_Grayscale8), false},
+        {"sky (odd width)", sky.copy(0, 0, size - 3, size - 5), false},
+    };
+
+    bool ok = true;
+    for (const Case& c : cases) {
+        TileStats fast = TileStats::measure(c.image);
+        TileStats reference = referenceTileStats(c.image);
+        bool exact = fast.minLevel == reference.minLevel && fast.maxLevel == reference.maxLevel
+                  && std::abs(fast.mean - reference.mean) < 1e-3f
+                  && fast.emptyFraction == reference.emptyFraction
+                  && fast.saturatedFraction == reference.saturatedFraction;
+        bool classified = fast.isBlank() == c.blank;
+        ok = ok && exact && classified;
+        qDebug() << QString("  %1 levels %2-%3, mean %4, %5% empty, %6% saturated -> %7 %8")
+                    .arg(c.name, -16).arg(int(fast.minLevel)).arg(int(fast.maxLevel)).arg(fast.mean, 0, 'f', 1)
+                    .arg(fast.emptyFraction * 100.0, 0, 'f', 1).arg(fast.saturatedFraction * 100.0, 0, 'f', 1)
+                    .arg(fast.isBlank() ? "blank" : "kept").arg(exact && classified ? "✅" : "❌");
+    }
+
+    QByteArray jpeg;
+    QBuffer buffer(&jpeg);
+    buffer.open(QIODevice::WriteOnly);
+    sky.save(&buffer, "JPG", 90);
+    double decodeMs = bestOfMs(iterations, [&]() { MosaicRenderer::decodeTile(jpeg); });
+    double measureMs = bestOfMs(iterations, [&]() { TileStats::measure(sky); });
+    double referenceMs = bestOfMs(std::max(1, iterations / 10), [&]() { referenceTileStats(sky); });
+
+    qDebug() << QString("  Decode %1 ms | measure %2 ms (%3% of decode) | per-pixel reference %4 ms")
+                .arg(decodeMs, 0, 'f', 2).arg(measureMs, 0, 'f', 3)
+                .arg(100.0 * measureMs / std::max(1e-6, decodeMs), 0, 'f', 1).arg(referenceMs, 0, 'f', 2);
+
+    return ok;
+}
+
+// Decoded formats per survey encoding, and conversions counted through a full render of colour tiles
+static bool benchFormats(int iterations) {
+    const int tileSize = 512;
+    const int grid = 3;
+
+    qDebug() << "\n=== Pixel formats: decode and render conversions ===";
+
+    const QImage sky = makeSyntheticTile(tileSize, QImage::Format_RGB32, 4900);
+    auto encode = [](const QImage& image, const char* format) {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, format, 90);
+        return data;
+    };
+
+    // Qt's JPEG plugin writes colour scans as RGB32; gray plates and palette PNGs need one conversion
+    struct Case { QString name; QByteArray data; qint64 conversions; };
+    const QList<Case> cases = {
+        {"JPEG colour", encode(sky, "JPG"), 0},
+        {"JPEG gray", encode(sky.convertToFormat(QImage::Format_Grayscale8), "JPG"), 1},
+        {"PNG alpha", encode(sky.convertToFormat(QImage::Format_ARGB32), "PNG"), 0},
+        {"PNG palette", encode(sky.convertToFormat(QImage::Format_Indexed8), "PNG"), 1},
+    };
+
+    bool ok = true;
+    for (const Case& c : cases) {
+        QImage plain;
+        plain.loadFromData(c.data);
+        PixelFormat::resetStats();
+        const QImage decoded = MosaicRenderer::decodeTile(c.data);
+        const qint64 conversions = PixelFormat::stats().conversions;
+        double plainMs = bestOfMs(iterations, [&]() { QImage image; image.loadFromData(c.data); });
+        double decodeMs = bestOfMs(iterations, [&]() { MosaicRenderer::decodeTile(c.data); });
+
+        bool good = PixelFormat::isInternal(decoded) && conversions == c.conversions;
+        ok = ok && good;
+        qDebug() << QString("  %1 plugin %2 -> %3, %4 conversion(s) | plugin %5 ms, decodeTile %6 ms %7")
+                    .arg(c.name, -12).arg(formatName(plain.format()), -8).arg(formatName(decoded.format()))
+                    .arg(conversions).arg(plainMs, 0, 'f', 2).arg(decodeMs, 0, 'f', 2).arg(good ? "✅" : "❌");
+    }
+
+    QTemporaryDir outputDir;
+    if (!outputDir.isValid()) {
+        qDebug() << "  ❌ Could not create a temporary output directory";
+        return false;
+    }
+
+    // Decode through render with every stage on: flatten, stretch, sources, files, pyramid and display
+    PixelFormat::resetStats();
+    MosaicRenderRequest request;
+    request.canvasSize = QSize(grid * tileSize, grid * tileSize);
+    for (int i = 0; i < grid * grid; i++) {
+        const QByteArray jpeg = encode(makeSyntheticTile(tileSize, QImage::Format_RGB32, 4910 + i), "JPG");
+        request.tiles.append({MosaicRenderer::decodeTile(jpeg), QPoint((i % grid) * tileSize, (i / grid) * tileSize)});
+    }
+    request.flatten.mode = FlattenMode::Subtract;
+    request.stretch.mode = StretchMode::Asinh;
+    request.extractSources = true;
+    request.outputFile = outputDir.filePath("formats.png");
+    request.previewFile = outputDir.filePath("formats_preview.jpg");
+    const MosaicFrame frame = MosaicRenderer::render(request);
+    const PixelConversionStats stats = PixelFormat::stats();
+
+    bool clean = stats.conversions == 0 && PixelFormat::isInternal(frame.mosaic) && PixelFormat::isInternal(frame.display);
+    ok = ok && clean;
+    qDebug() << QString("  Colour render: %1 conversions (%2 MB) | mosaic %3, display %4 %5")
+                .arg(stats.conversions).arg(stats.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                .arg(formatName(frame.mosaic.format())).arg(formatName(frame.display.format()))
+                .arg(clean ? "✅" : "❌");
+    if (!clean) {
+        PixelFormat::logStats("  Colour render");
+    }
+
+    return ok;
+}
+
+// The per-pixel box blur the creators used before ImageFilters: pixel()/setPixel() with an O(radius) window
+static QImage referenceBoxBlur(const QImage& image, int radius) {
+    QImage horizontal = image.copy();
+    const int width = image.width();
+    const int height = image.height();
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int r = 0, g = 0, b = 0, count = 0;
+            for (int nx = std::max(0, x - radius); nx <= std::min(width - 1, x + radius); nx++) {
+                QRgb pixel = image.pixel(nx, y);
+                r += qRed(pixel); g += qGreen(pixel); b += qBlue(pixel);
+                count++;
+            }
+            horizontal.setPixel(x, y, qRgb(r / count, g / count, b / count));
+        }
+    }
+
+    QImage result = horizontal.copy();
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            int r = 0, g = 0, b = 0, count = 0;
+            for (int ny = std::max(0, y - radius); ny <= std::min(height - 1, y + radius); ny++) {
+                QRgb pixel = horizontal.pixel(x, ny);
+                r += qRed(pixel); g += qGreen(pixel); b += qBlue(pixel);
+                count++;
+            }
+            result.setPixel(x, y, qRgb(r / count, g / count, b / count));
+        }
+    }
+    return result;
+}
+
+// Box and triple-box Gaussian blurs on a 1536x1536 mosaic, as findBrightnessCenter blurs it
+static bool benchBlur(int iterations) {
+    const int tileSize = 512;
+    const int grid = 3;
+    bool allMatch = true;
+
+    qDebug() << "\n=== Blur: 1536x1536 mosaic ===";
+
+    QImage mosaic = makeSyntheticMosaic(grid, tileSize, 5000);
+    double megapixels = double(mosaic.width()) * mosaic.height() / 1e6;
+
+    for (int radius : {3, 15}) {
+        QImage reference;
+        double referenceMs = bestOfMs(1, [&]() { reference = referenceBoxBlur(mosaic, radius); });
+
+        QImage serial, parallel;
+        double serialMs = bestOfMs(iterations, [&]() { serial = ImageFilters::boxBlur(mosaic, radius, false); });
+        double parallelMs = bestOfMs(iterations, [&]() { parallel = ImageFilters::boxBlur(mosaic, radius, true); });
+
+        bool match = serial == reference && parallel == reference;
+        allMatch = allMatch && match;
+        qDebug() << QString("  Box r=%1: pixel() loops %2 ms | running sum %3 ms (%4 MP/s) | %5 threads %6 ms (%7 MP/s) | %8x | output %9")
+                    .arg(radius, -2)
+                    .arg(referenceMs, 0, 'f', 0)
+                    .arg(serialMs, 0, 'f', 2).arg(megapixels / (serialMs / 1000.0), 0, 'f', 0)
+                    .arg(MosaicRenderer::pool()->maxThreadCount())
+                    .arg(parallelMs, 0, 'f', 2).arg(megapixels / (parallelMs / 1000.0), 0, 'f', 0)
+                    .arg(referenceMs / std::max(0.001, parallelMs), 0, 'f', 0)
+                    .arg(match ? "identical" : "DIFFERS");
+    }
+
+    for (double sigma : {2.0, 8.0}) {
+        double ms = bestOfMs(iterations, [&]() { ImageFilters::gaussianBlur(mosaic, sigma); });
+        QList<int> radii = ImageFilters::gaussianBoxRadii(sigma);
+        qDebug() << QString("  Gaussian sigma=%1 (box radii %2, %3, %4): %5 ms (%6 MP/s)")
+                    .arg(sigma, 0, 'f', 0).arg(radii[0]).arg(radii[1]).arg(radii[2])
+                    .arg(ms, 0, 'f', 2).arg(megapixels / (ms / 1000.0), 0, 'f', 0);
+    }
+
+    return allMatch;
+}
+
+// The centroid findBrightnessCenter computed before: blur the RGB mosaic, then two pixel() passes
+static QPoint referenceBrightnessCenter(const QImage& image, int radius, double fraction) {
+    QImage blurred = ImageFilters::boxBlur(image, radius);
+    int maxBrightness = 0;
+    for (int y = 0; y < blurred.height(); y++) {
+        for (int x = 0; x < blurred.width(); x++) {
+            maxBrightness = std::max(maxBrightness, qGray(blurred.pixel(x, y)));
+        }
+    }
+    int threshold = int(maxBrightness * fraction);
+    double weightedX = 0, weightedY = 0, weight = 0;
+    for (int y = 0; y < blurred.height(); y++) {
+        for (int x = 0; x < blurred.width(); x++) {
+            int brightness = qGray(blurred.pixel(x, y));
+            if (brightness > threshold) {
+                double w = double(brightness * brightness);
+                weightedX += x * w;
+                weightedY += y * w;
+                weight += w;
+            }
+        }
+    }
+    return weight > 0 ? QPoint(int(weightedX / weight), int(weightedY / weight))
+                      : QPoint(image.width() / 2, image.height() / 2);
+}
+
+// Same definition as BrightnessCentroid (box mean of qGray), brute force per pixel
+static BrightnessCentroid referenceLuminanceCentroid(const QImage& image, int radius, double fraction) {
+    const int width = image.width();
+    const int height = image.height();
+    std::vector<int> luminance(size_t(width) * height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            luminance[size_t(y) * width + x] = qGray(image.pixel(x, y));
+        }
+    }
+
+    std::vector<int> levels(luminance.size());
+    int maxBrightness = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int sum = 0, count = 0;
+            for (int ny = std::max(0, y - radius); ny <= std::min(height - 1, y + radius); ny++) {
+                for (int nx = std::max(0, x - radius); nx <= std::min(width - 1, x + radius); nx++) {
+                    sum += luminance[size_t(ny) * width + nx];
+                    count++;
+                }
+            }
+            levels[size_t(y) * width + x] = sum / count;
+            maxBrightness = std::max(maxBrightness, sum / count);
+        }
+    }
+
+    BrightnessCentroid result;
+    result.maxBrightness = maxBrightness;
+    result.threshold = int(maxBrightness * fraction);
+    double weightedX = 0, weightedY = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int level = levels[size_t(y) * width + x];
+            if (level > result.threshold) {
+                double w = double(level) * level;
+                weightedX += x * w;
+                weightedY += y * w;
+                result.totalWeight += w;
+            }
+        }
+    }
+    result.center = result.totalWeight > 0 ? QPoint(int(weightedX / result.totalWeight), int(weightedY / result.totalWeight))
+                                           : QPoint(width / 2, height / 2);
+    return result;
+}
+
+// Auto-centering on a 1536x1536 mosaic with an off-centre "galaxy"
+static bool benchCentroid(int iterations) {
+    const int tileSize = 512;
+    const int grid = 3;
+    const int radius = 3;
+    const double fraction = 0.7;
+
+    qDebug() << "\n=== Brightness centroid: 1536x1536 mosaic ===";
+
+    QImage mosaic = makeSyntheticMosaic(grid, tileSize, 6000);
+    QPainter painter(&mosaic);
+    QRadialGradient glow(QPointF(900, 640), 220);
+    glow.setColorAt(0.0, QColor(255, 250, 235));
+    glow.setColorAt(1.0, QColor(255, 250, 235, 0));
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(glow);
+    painter.drawEllipse(QPointF(900, 640), 220, 220);
+    painter.end();
+
+    QPoint previous;
+    double previousMs = bestOfMs(std::max(1, iterations / 10), [&]() {
+        previous = referenceBrightnessCenter(mosaic, radius, fraction);
+    });
+    BrightnessCentroid serial, parallel;
+    double serialMs = bestOfMs(iterations, [&]() { serial = BrightnessCentroid::find(mosaic, radius, fraction, false); });
+    double parallelMs = bestOfMs(iterations, [&]() { parallel = BrightnessCentroid::find(mosaic, radius, fraction, true); });
+
+    BrightnessCentroid exact = referenceLuminanceCentroid(mosaic, radius, fraction);
+    bool match = serial.center == exact.center && parallel.center == exact.center
+              && serial.maxBrightness == exact.maxBrightness && parallel.totalWeight == exact.totalWeight;
+    QPoint drift = parallel.center - previous;
+
+    qDebug() << QString("  Blur + two pixel() passes %1 ms | fused %2 ms | %3 threads %4 ms | %5x")
+                .arg(previousMs, 0, 'f', 1).arg(serialMs, 0, 'f', 2)
+                .arg(MosaicRenderer::pool()->maxThreadCount()).arg(parallelMs, 0, 'f', 2)
+                .arg(previousMs / std::max(0.001, parallelMs), 0, 'f', 0);
+    qDebug() << QString("  Centre (%1,%2) vs per-pixel reference: %3 | previous RGB-blur centre (%4,%5), %6 px apart")
+                .arg(parallel.center.x()).arg(parallel.center.y()).arg(match ? "identical" : "DIFFERENT")
+                .arg(previous.x()).arg(previous.y()).arg(drift.manhattanLength());
+
+    // Coarse-to-fine, as the Messier creator's zoom toggle runs it: the 1/8 copy is built
+    // while tiles decode, so only the coarse search and the refinement window are on the clock
+    QImage coarse;
+    double downsampleMs = bestOfMs(iterations, [&]() { coarse = ImageFilters::boxDownsample(mosaic, 8); });
+    BrightnessCentroid refined;
+    double refineMs = bestOfMs(iterations, [&]() { refined = BrightnessCentroid::coarseToFine(mosaic, coarse, radius, fraction); });
+    QPoint refineDrift = refined.center - parallel.center;
+
+    qDebug() << QString("  Coarse-to-fine: 1/8 downsample %1 ms (during decode) | search + refine %2 ms | (%3,%4), %5 px from full search")
+                .arg(downsampleMs, 0, 'f', 2).arg(refineMs, 0, 'f', 2)
+                .arg(refined.center.x()).arg(refined.center.y()).arg(refineDrift.manhattanLength());
+
+    return match && drift.manhattanLength() <= 4 && refineDrift.manhattanLength() <= 4;
+}
+
+// Mean absolute step between the last pixel of one tile and the first of the next, across every seam
+static double meanSeamStep(const QImage& mosaic, int grid, int tileSize) {
+    double total = 0;
+    qint64 count = 0;
+    for (int seam = 1; seam < grid; seam++) {
+        int edge = seam * tileSize;
+        for (int i = 0; i < mosaic.width(); i++) {
+            QRgb left = mosaic.pixel(edge - 1, i), right = mosaic.pixel(edge, i);
+            QRgb above = mosaic.pixel(i, edge - 1), below = mosaic.pixel(i, edge);
+            total += std::abs(qGreen(left) - qGreen(right)) + std::abs(qGreen(above) - qGreen(below));
+            count += 2;
+        }
+    }
+    return count > 0 ? total / count : 0.0;
+}
+
+// 3x3 and 10x10 grids of tiles whose brightness differs tile to tile, as when surveys fall back
+static bool benchSeams(int iterations) {
+    const int tileSize = 512;
+    const int seamWidth = 32;
+    bool ok = true;
+
+    qDebug() << QString("\n=== Seams: feathered tile boundaries (%1 px) ===").arg(seamWidth);
+
+    for (int grid : {3, 10}) {
+        const int mosaicSize = grid * tileSize;
+        QList<QImage> tiles;
+        for (int i = 0; i < grid * grid; i++) {
+            tiles.append(makeUnevenTile(tileSize, 4000, i));
+        }
+
+        auto compose = [&](int seam) {
+            MosaicCompositor compositor(mosaicSize, mosaicSize);
+            compositor.setSeamWidth(seam);
+            compositor.clear();
+            for (int i = 0; i < grid * grid; i++) {
+                compositor.blit(tiles[i], (i % grid) * tileSize, (i / grid) * tileSize);
+            }
+            return compositor.takeCanvas();
+        };
+
+        int runs = grid > 3 ? std::max(1, iterations / 10) : iterations;
+        QImage plain, feathered;
+        double plainMs = bestOfMs(runs, [&]() { plain = compose(0); });
+        double featherMs = bestOfMs(runs, [&]() { feathered = compose(seamWidth); });
+
+        double plainStep = meanSeamStep(plain, grid, tileSize);
+        double featherStep = meanSeamStep(feathered, grid, tileSize);
+        bool reduced = featherStep < plainStep / 2;
+        ok = ok && reduced;
+
+        double megapixels = double(mosaicSize) * mosaicSize / 1e6;
+        qDebug() << QString("  %1x%1 tiles: plain %2 ms (%3 MP/s) | feathered %4 ms (%5 MP/s) | seam step %6 -> %7 %8")
+                    .arg(grid)
+                    .arg(plainMs, 0, 'f', 2).arg(megapixels / (plainMs / 1000.0), 0, 'f', 0)
+                    .arg(featherMs, 0, 'f', 2).arg(megapixels / (featherMs / 1000.0), 0, 'f', 0)
+                    .arg(plainStep, 0, 'f', 1).arg(featherStep, 0, 'f', 1)
+                    .arg(reduced ? "" : "(NOT REDUCED)");
+    }
+
+    // Tiles with no neighbour to match must come out as plain copies
+    QImage tile = makeSyntheticTile(tileSize, QImage::Format_RGB32, 9);
+    MosaicCompositor copy(1200, 600), isolated(1200, 600);
+    isolated.setSeamWidth(seamWidth);
+    copy.clear();
+    isolated.clear();
+    for (MosaicCompositor* compositor : {&copy, &isolated}) {
+        compositor->blit(tile, 0, 0);
+        compositor->blit(tile, 600, 88);
+    }
+    bool isolatedMatch = copy.canvas() == isolated.canvas();
+    qDebug() << QString("  Isolated tiles, feathered vs plain blit: %1").arg(isolatedMatch ? "identical" : "DIFFERENT");
+
+    return ok && isolatedMatch;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("PipelineBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks for the mosaic pipeline stages");
+    parser.addHelpOption();
+
+    QCommandLineOption iterationsOption("iterations", "Repetitions per measurement (best is reported).", "n", "30");
+    QCommandLineOption onlyOption("only", "Comma-separated benchmarks to run: compose, seams, blur, centroid, stall, reproject, channels, pyramid, mip, stretch, sources, tilestats, flatten, formats.", "list");
+    parser.addOptions({iterationsOption, onlyOption});
+    parser.process(app);
+
+    int iterations = std::max(1, parser.value(iterationsOption).toInt());
+    QStringList only = parser.value(onlyOption).split(',', Qt::SkipEmptyParts);
+    auto wanted = [&only](const QString& name) { return only.isEmpty() || only.contains(name); };
+
+    bool ok = true;
+    if (wanted("compose")) ok = benchCompose(iterations) && ok;
+    if (wanted("seams")) ok = benchSeams(iterations) && ok;
+    if (wanted("blur")) ok = benchBlur(iterations) && ok;
+    if (wanted("centroid")) ok = benchCentroid(iterations) && ok;
+    if (wanted("stall")) ok = benchStall() && ok;
+    if (wanted("reproject")) ok = benchReproject(iterations) && ok;
+    if (wanted("channels")) ok = benchChannels(iterations) && ok;
+    if (wanted("pyramid")) ok = benchPyramid() && ok;
+    if (wanted("mip")) ok = benchMip(iterations) && ok;
+    if (wanted("stretch")) ok = benchStretch(iterations) && ok;
+    if (wanted("sources")) ok = benchSources(iterations) && ok;
+    if (wanted("tilestats")) ok = benchTileStats(iterations) && ok;
+    if (wanted("flatten")) ok = benchFlatten(iterations) && ok;
+    if (wanted("formats")) ok = benchFormats(iterations) && ok;
+
+    if (!ok) {
+        qDebug() << "\n❌ Some optimized paths produced different output than the reference";
+        return 1;
+    }
+    qDebug() << "\n✅ All benchmarked paths match their reference output";
+    return 0;
+}
@@ -0,0 +1,397 @@
+// main_wide_field.cpp - Headless TAN reprojection of fields larger than memory, streamed to TIFF/DZI in strips
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include "ProperHipsClient.h"
+#include "DeepZoomWriter.h"
+#include "HipsReprojector.h"
+#include "MosaicRenderer.h"
+#include "PixelFormat.h"
+#include "ReprojectionMap.h"
+#include "StripImageWriter.h"
+#include "TileCache.h"
+#include "TileFetcher.h"
+#include <algorithm>
+
+class WideFieldRenderer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit WideFieldRenderer(const QString& cacheDir, QObject *parent = nullptr);
+    ~WideFieldRenderer();
+
+    void setProjection(const TanProjection& projection) { m_projection = projection; }
+    void setSurvey(const QString& survey);
+    // False colour: each call adds one survey, stretched and weighted into the output channels
+    void addChannel(const QString& survey, const ChannelBand& band);
+    void setOrder(int order) { m_order = order; }
+    void setStripHeight(int rows) { m_stripHeight = std::max(1, rows); }
+    void setKernel(ResampleKernel kernel) { m_kernel = kernel; }
+    void setOutputFile(const QString& fileName) { m_outputFile = fileName; }
+    void setDeepZoomFile(const QString& fileName) { m_deepZoomFile = fileName; }
+    void setMaxParallel(int maxParallel) { m_fetcher->setMaxParallel(maxParallel); }
+
+    void run();
+
+signals:
+    void finished(bool succeeded);
+
+private slots:
+    void onStripTilesFetched();
+
+private:
+    ProperHipsClient* m_hipsClient;
+    TileCache* m_tileCache;
+    TileFetcher* m_fetcher;
+    StripImageWriter* m_writer;
+    DeepZoomWriter* m_deepZoom;     // Optional pyramid fed the same strips
+
+    TanProjection m_projection;
+    QStringList m_surveys;
+    bool m_falseColour;
+    int m_order;
+    int m_stripHeight;
+    ResampleKernel m_kernel;
+    QString m_outputFile;
+    QString m_deepZoomFile;
+
+    // One band per survey; only the tiles under the current strip are kept decoded
+    QList<ChannelBand> m_bands;
+    TanProjection m_strip;
+    QList<long long> m_stripTiles;
+    int m_nextRow;
+
+    // Accounting
+    QElapsedTimer m_timer;
+    int m_tilesDecoded;
+    int m_tilesMissing;
+    qint64 m_peakBytes;
+
+    TileKey keyFor(int band, long long pixel) const;
+    int tilesHeld() const;
+    void startStrip();
+    void finishRun();
+};
+
+WideFieldRenderer::WideFieldRenderer(const QString& cacheDir, QObject *parent)
+    : QObject(parent), m_writer(nullptr), m_deepZoom(nullptr), m_falseColour(false), m_order(8), m_stripHeight(256),
+      m_kernel(ResampleKernel::Bilinear), m_outputFile("wide_field.tif"), m_nextRow(0),
+      m_tilesDecoded(0), m_tilesMissing(0), m_peakBytes(0) {
+
+    m_hipsClient = new ProperHipsClient(this);
+    m_tileCache = new TileCache(cacheDir, this);
+    m_fetcher = new TileFetcher(m_tileCache, m_hipsClient, this);
+
+    connect(m_fetcher, &TileFetcher::allFinished, this, &WideFieldRenderer::onStripTilesFetched);
+    setSurvey("DSS2_Color");
+}
+
+WideFieldRenderer::~WideFieldRenderer() {
+    delete m_writer;
+    delete m_deepZoom;
+}
+
+void WideFieldRenderer::setSurvey(const QString& survey) {
+    m_surveys = {survey};
+    m_bands = {ChannelBand()};
+    m_falseColour = false;
+}
+
+void WideFieldRenderer::addChannel(const QString& survey, const ChannelBand& band) {
+    if (!m_falseColour) {
+        m_surveys.clear();
+        m_bands.clear();
+        m_falseColour = true;
+    }
+    m_surveys.append(survey);
+    m_bands.append(band);
+}
+
+TileKey WideFieldRenderer::keyFor(int band, long long pixel) const {
+    return {m_surveys[band], m_order, pixel, m_hipsClient->getSurveyFormat(m_surveys[band])};
+}
+
+int WideFieldRenderer::tilesHeld() const {
+    int held = 0;
+    for (const ChannelBand& band : m_bands) {
+        held += band.tiles.tiles.size();
+    }
+    return held;
+}
+
+void WideFieldRenderer::run() {
+    QSize size = m_projection.size;
+    qint64 fullBytes = qint64(size.width()) * size.height() * 4;
+
+    qDebug() << "\n=== Wide-Field Render ===";
+    qDebug() << QString("Field: RA %1, Dec %2, %3x%4 px at %5\"/px (%6 x %7 deg)")
+                .arg(m_projection.centerRaDeg, 0, 'f', 4).arg(m_projection.centerDecDeg, 0, 'f', 4)
+                .arg(size.width()).arg(size.height())
+                .arg(m_projection.pixelScaleDeg * 3600.0, 0, 'f', 2)
+                .arg(size.width() * m_projection.pixelScaleDeg, 0, 'f', 2)
+                .arg(size.height() * m_projection.pixelScaleDeg, 0, 'f', 2);
+    qDebug() << QString("Survey: %1, order %2, strips of %3 rows; a full RGB32 frame would need %4 MB")
+                .arg(m_surveys.join(m_falseColour ? " + " : "")).arg(m_order).arg(m_stripHeight)
+                .arg(fullBytes / (1024.0 * 1024.0), 0, 'f', 0);
+
+    delete m_writer;
+    m_writer = new StripImageWriter(m_outputFile, size, m_stripHeight);
+    if (!m_writer->open()) {
+        emit finished(false);
+        return;
+    }
+    qDebug() << QString("Writing %1 as %2").arg(m_outputFile, m_writer->isBigTiff() ? "BigTIFF" : "TIFF");
+
+    delete m_deepZoom;
+    m_deepZoom = nullptr;
+    if (!m_deepZoomFile.isEmpty()) {
+        m_deepZoom = new DeepZoomWriter(m_deepZoomFile, size);
+        if (!m_deepZoom->open()) {
+            emit finished(false);
+            return;
+        }
+        qDebug() << QString("Writing a %1-level deep zoom pyramid to %2").arg(m_deepZoom->levelCount()).arg(m_deepZoomFile);
+    }
+
+    for (ChannelBand& band : m_bands) {
+        band.tiles.order = m_order;
+        band.tiles.tiles.clear();
+    }
+    m_nextRow = 0;
+    m_timer.start();
+    startStrip();
+}
+
+void WideFieldRenderer::startStrip() {
+    if (m_nextRow >= m_projection.size.height()) {
+        finishRun();
+        return;
+    }
+
+    int rows = std::min(m_stripHeight, m_projection.size.height() - m_nextRow);
+    m_strip = m_projection.strip(m_nextRow, rows);
+    m_stripTiles = HipsReprojector::requiredTiles(m_strip, m_order, m_bands.first().tiles.tileWidth, m_kernel);
+
+    // Consecutive strips share most tiles, so usually only the new bottom row is downloaded.
+    // Every band goes into one batch so the surveys download side by side.
+    QList<TileKey> toFetch;
+    for (int b = 0; b < m_bands.size(); ++b) {
+        for (long long pixel : m_stripTiles) {
+            TileKey key = keyFor(b, pixel);
+            if (m_bands[b].tiles.tiles.contains(pixel) || m_tileCache->isKnownMissing(key)) continue;
+            if (m_tileCache->hasValidTile(key) && m_tileCache->isFresh(key)) continue;
+            toFetch.append(key);
+        }
+    }
+
+    // allFinished also fires when there is nothing to fetch
+    m_fetcher->fetch(toFetch);
+}
+
+void WideFieldRenderer::onStripTilesFetched() {
+    QSet<long long> wanted(m_stripTiles.begin(), m_stripTiles.end());
+
+    // Drop tiles the strip has moved past before decoding the new ones
+    for (ChannelBand& band : m_bands) {
+        for (auto it = band.tiles.tiles.begin(); it != band.tiles.tiles.end();) {
+            it = wanted.contains(it.key()) ? std::next(it) : band.tiles.tiles.erase(it);
+        }
+    }
+
+    // All bands decode together on the render pool
+    QList<QPair<int, long long>> toDecode;
+    QList<QFuture<DecodedTile>> decoding;
+    for (int b = 0; b < m_bands.size(); ++b) {
+        for (long long pixel : m_stripTiles) {
+            if (m_bands[b].tiles.tiles.contains(pixel)) continue;
+            toDecode.append(qMakePair(b, pixel));
+            decoding.append(MosaicRenderer::loadCachedAsync(m_tileCache, keyFor(b, pixel)));
+        }
+    }
+    for (int i = 0; i < decoding.size(); ++i) {
+        DecodedTile decoded = decoding[i].result();
+        // Blank and saturated edge tiles are dropped too, rather than painted as a white or black block
+        bool blank = !decoded.image.isNull()
+                  && m_tileCache->recordStats(keyFor(toDecode[i].first, toDecode[i].second), decoded.stats);
+        if (!decoded.image.isNull() && !blank
+            && m_bands[toDecode[i].first].tiles.insert(toDecode[i].second, decoded.image)) {
+            m_tilesDecoded++;
+        } else {
+            m_tilesMissing++;   // Rendered black, like any survey coverage gap
+        }
+    }
+
+    // The map is as transient as the strip, so it bypasses ReprojectionMapCache
+    const int tileWidth = m_bands.first().tiles.tileWidth;
+    QSharedPointer<const ReprojectionMap> map = HipsReprojector::buildMap(m_strip, m_order, tileWidth);
+    QImage strip = m_falseColour ? HipsReprojector::renderChannels(*map, m_bands, m_kernel)
+                                 : HipsReprojector::render(*map, m_bands.first().tiles, m_kernel);
+
+    qint64 tileBytes = qint64(tilesHeld()) * tileWidth * tileWidth * 4;
+    m_peakBytes = std::max(m_peakBytes, tileBytes + map->memoryBytes() + strip.sizeInBytes());
+
+    if (!m_writer->writeStrip(strip) || (m_deepZoom && !m_deepZoom->writeRows(strip))) {
+        emit finished(false);
+        return;
+    }
+
+    m_nextRow += strip.height();
+    double elapsedSec = std::max(0.001, m_timer.elapsed() / 1000.0);
+    double rowsPerSec = m_nextRow / elapsedSec;
+    qDebug() << QString("  rows %1/%2 (%3%) | %4 tiles held | %5 rows/s | ETA %6s")
+                .arg(m_nextRow).arg(m_projection.size.height())
+                .arg(100.0 * m_nextRow / m_projection.size.height(), 0, 'f', 1)
+                .arg(tilesHeld())
+                .arg(rowsPerSec, 0, 'f', 0)
+                .arg((m_projection.size.height() - m_nextRow) / rowsPerSec, 0, 'f', 0);
+
+    // Back to the event loop so the fetcher's signals are delivered between strips
+    QTimer::singleShot(0, this, &WideFieldRenderer::startStrip);
+}
+
+void WideFieldRenderer::finishRun() {
+    for (ChannelBand& band : m_bands) {
+        band.tiles.tiles.clear();
+    }
+    if (!m_writer->finish() || (m_deepZoom && !m_deepZoom->finish())) {
+        emit finished(false);
+        return;
+    }
+
+    qDebug() << "\n=== Wide-Field Render Complete ===";
+    qDebug() << QString("Saved %1 (%2x%3) in %4s")
+                .arg(m_outputFile).arg(m_projection.size.width()).arg(m_projection.size.height())
+                .arg(m_timer.elapsed() / 1000.0, 0, 'f', 1);
+    qDebug() << QString("Tiles decoded: %1, missing: %2, peak working set: %3 MB")
+                .arg(m_tilesDecoded).arg(m_tilesMissing)
+                .arg(m_peakBytes / (1024.0 * 1024.0), 0, 'f', 1);
+    if (m_deepZoom) {
+        qDebug() << QString("Deep zoom: %1 tiles in %2 levels").arg(m_deepZoom->tilesWritten()).arg(m_deepZoom->levelCount());
+    }
+    PixelFormat::logStats("Pixel formats");
+
+    emit finished(true);
+}
+
+static bool parseKernel(const QString& name, ResampleKernel* kernel) {
+    if (name == "nearest") *kernel = ResampleKernel::Nearest;
+    else if (name == "bilinear") *kernel = ResampleKernel::Bilinear;
+    else if (name == "lanczos3") *kernel = ResampleKernel::Lanczos3;
+    else return false;
+    return true;
+}
+
+// "SURVEY[:black:white[:gamma]]"
+static bool parseChannel(const QString& spec, QString* survey, ChannelBand* band) {
+    QStringList parts = spec.split(':');
+    *survey = parts[0].trimmed();
+    bool ok = !survey->isEmpty() && (parts.size() == 1 || parts.size() == 3 || parts.size() == 4);
+    if (ok && parts.size() >= 3) {
+        bool blackOk = false, whiteOk = false, gammaOk = true;
+        band->black = parts[1].toDouble(&blackOk);
+        band->white = parts[2].toDouble(&whiteOk);
+        if (parts.size() == 4) {
+            band->gamma = parts[3].toDouble(&gammaOk);
+        }
+        ok = blackOk && whiteOk && gammaOk && band->white > band->black && band->gamma > 0.0;
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("HipsWideField");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Reproject a wide HiPS field to a gnomonic TIFF, streamed in strips");
+    parser.addHelpOption();
+
+    // Default field: the Virgo cluster core around M87 and Markarian's Chain
+    QCommandLineOption raOption("ra", "Field centre right ascension.", "deg", "187.7059");
+    QCommandLineOption decOption("dec", "Field centre declination.", "deg", "12.3911");
+    QCommandLineOption widthOption("width", "Output width.", "px", "16384");
+    QCommandLineOption heightOption("height", "Output height.", "px", "12288");
+    QCommandLineOption scaleOption("scale", "Pixel scale.", "arcsec", "1.0");
+    QCommandLineOption rotationOption("rotation", "Position angle of image up, north through east.", "deg", "0");
+    QCommandLineOption surveyOption("survey", "Survey to reproject.", "name", "DSS2_Color");
+    QCommandLineOption rgbOption("rgb", "False colour from three surveys mapped to red, green and blue, "
+                                 "each SURVEY[:black:white[:gamma]], e.g. 2MASS_K,2MASS_H,2MASS_J.", "list");
+    QCommandLineOption orderOption("order", "HiPS order (default: matched to the pixel scale).", "n");
+    QCommandLineOption stripOption("strip", "Rows rendered and written per strip.", "rows", "256");
+    QCommandLineOption kernelOption("kernel", "nearest, bilinear or lanczos3.", "name", "bilinear");
+    QCommandLineOption outputOption("output", "Output TIFF file.", "file", "wide_field.tif");
+    QCommandLineOption deepZoomOption("dzi", "Also write a Deep Zoom tile pyramid.", "file");
+    QCommandLineOption cacheOption("cache", "Tile cache directory.", "dir", "hips_tile_cache");
+    QCommandLineOption parallelOption("parallel", "Concurrent downloads.", "n", "8");
+    parser.addOptions({raOption, decOption, widthOption, heightOption, scaleOption, rotationOption,
+                       surveyOption, rgbOption, orderOption, stripOption, kernelOption, outputOption,
+                       deepZoomOption, cacheOption, parallelOption});
+    parser.process(app);
+
+    TanProjection projection;
+    projection.centerRaDeg = parser.value(raOption).toDouble();
+    projection.centerDecDeg = parser.value(decOption).toDouble();
+    projection.size = QSize(parser.value(widthOption).toInt(), parser.value(heightOption).toInt());
+    projection.pixelScaleDeg = parser.value(scaleOption).toDouble() / 3600.0;
+    projection.rotationDeg = parser.value(rotationOption).toDouble();
+    if (projection.size.isEmpty() || projection.pixelScaleDeg <= 0.0) {
+        qDebug() << "Output size and pixel scale must be positive";
+        return 1;
+    }
+
+    ResampleKernel kernel;
+    if (!parseKernel(parser.value(kernelOption), &kernel)) {
+        qDebug() << "Unknown kernel" << parser.value(kernelOption);
+        return 1;
+    }
+
+    // DSS2 and 2MASS HiPS stop at order 9; finer orders would only request missing tiles
+    int order = parser.isSet(orderOption) ? parser.value(orderOption).toInt()
+                                          : HipsReprojector::orderForScale(projection.pixelScaleDeg, 512, 9);
+
+    WideFieldRenderer renderer(parser.value(cacheOption));
+    renderer.setProjection(projection);
+    renderer.setSurvey(parser.value(surveyOption));
+    if (parser.isSet(rgbOption)) {
+        QStringList specs = parser.value(rgbOption).split(',', Qt::SkipEmptyParts);
+        if (specs.size() != 3) {
+            qDebug() << "--rgb takes exactly three surveys (red, green, blue)";
+            return 1;
+        }
+        for (int channel = 0; channel < 3; ++channel) {
+            QString survey;
+            ChannelBand band;
+            if (!parseChannel(specs[channel], &survey, &band)) {
+                qDebug() << "Bad channel" << specs[channel] << "- expected SURVEY[:black:white[:gamma]]";
+                return 1;
+            }
+            band.red = channel == 0 ? 1.0 : 0.0;
+            band.green = channel == 1 ? 1.0 : 0.0;
+            band.blue = channel == 2 ? 1.0 : 0.0;
+            renderer.addChannel(survey, band);
+        }
+    }
+    renderer.setOrder(order);
+    renderer.setStripHeight(parser.value(stripOption).toInt());
+    renderer.setKernel(kernel);
+    renderer.setOutputFile(parser.value(outputOption));
+    renderer.setDeepZoomFile(parser.value(deepZoomOption));
+    renderer.setMaxParallel(parser.value(parallelOption).toInt());
+
+    QObject::connect(&renderer, &WideFieldRenderer::finished, &app, [&app](bool succeeded) {
+        app.exit(succeeded ? 0 : 2);
+    });
+
+    // Started from the event loop so an immediate failure still reaches app.exit()
+    QTimer::singleShot(0, &renderer, &WideFieldRenderer::run);
+
+    return app.exec();
+}
+
+#include "main_wide_field.moc"